@@ -0,0 +1,449 @@
+#ifndef __INTERFACE_COBITFIELD_H__
+#define __INTERFACE_COBITFIELD_H__
+
+#include <stdint.h>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+
+/// # Bit field accessors
+///
+/// The layout of C bit fields (TPmConverterStatus, TPmStatus, TV2hPmStatus, TPwbStatus,
+/// the BIST unions and TPmSoftVersion) is implementation defined: the bit order
+/// follows the compiler and the byte order follows the host. The accessors below work
+/// on the integer value instead and compile to a shift and a mask, independent of both.
+/// The unions stay available for existing code as thin wrappers: CoGetField() and
+/// CoSetField() access a union through the descriptors, on the integer member of the
+/// union instead of the bit field members. On little-endian targets with GCC or Clang
+/// both views give the same result, tst/CoBitFieldTest.cpp checks this byte for byte.
+///
+/// The wire value is assembled little-endian with Load() (CANopen byte order), so
+/// the accessors can also be used on big-endian hosts:
+///
+///     uint32_t status = TPmConverterStatusFields::Load(data);
+///
+///     if (TPmConverterStatusFields::FanError::Get(status)) ...
+///     status = TPmConverterStatusFields::ConverterActive::Set(status, 1);
+///
+///     TPmConverterStatus converter;
+///
+///     converter.value = TPmConverterStatusFields::Load(data);
+///
+///     if (CoGetField<TPmConverterStatusFields::FanError>(converter)) ...
+///     CoSetField<TPmConverterStatusFields::ConverterActive>(converter, 1);
+///
+/// Each descriptor struct lists the fields of one type as TCoBitField<Offset, Width>
+/// with the names of the union members.
+
+template <unsigned Offset, unsigned Width, typename T = uint32_t>
+struct TCoBitField
+{
+    static_assert((Width > 0) && (Offset + Width <= 8 * sizeof(T)), "field exceeds the storage type");
+
+    typedef T TStorage;
+
+    static constexpr unsigned offset = Offset;
+    static constexpr unsigned width  = Width;
+
+    /// Mask of the field within the value
+    static constexpr T Mask()
+    {
+        return (T)((Width == 8 * sizeof(T)) ? ~(T)0 : (T)((((T)1 << (Width % (8 * sizeof(T)))) - 1) << Offset));
+    }
+
+    static constexpr T Get(T value)
+    {
+        return (T)((value & Mask()) >> Offset);
+    }
+
+    /// Returns *value* with the field replaced by *field*, excess bits of *field* are dropped
+    static constexpr T Set(T value, T field)
+    {
+        return (T)((value & (T)~Mask()) | ((T)(field << Offset) & Mask()));
+    }
+
+    static constexpr bool Test(T value)
+    {
+        return (value & Mask()) != 0;
+    }
+};
+
+/// Assembles a little-endian value of sizeof(T) bytes
+template <typename T>
+constexpr T CoLoadLe(const uint8_t* data, unsigned size = sizeof(T))
+{
+    return size ? (T)(((T)CoLoadLe<T>(data + 1, size - 1) << 8) | data[0]) : (T)0;
+}
+
+template <typename T>
+inline void CoStoreLe(uint8_t* data, T value)
+{
+    for (unsigned i = 0; i < sizeof(T); i++)
+    {
+        data[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+#define COPM_BITFIELD(name, offset, width)  typedef TCoBitField<offset, width, TStorage> name
+
+/// Describes the storage of a type, *T* is the integer type the fields are defined on
+#define COPM_BITFIELD_STORAGE(T)                                                        \
+    typedef T TStorage;                                                                 \
+    static constexpr TStorage Load(const uint8_t* data) { return CoLoadLe<T>(data); }   \
+    static void Store(uint8_t* data, TStorage value) { CoStoreLe<T>(data, value); }
+
+/// TPmConverterStatus, 2101 and status of PM_PDO_STATUS
+struct TPmConverterStatusFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BITFIELD(ConverterActive,   0, 1);
+    COPM_BITFIELD(GlobalError,       1, 1);
+    COPM_BITFIELD(OVPin,             2, 1);
+    COPM_BITFIELD(UVPin,             3, 1);
+    COPM_BITFIELD(OVPout,            4, 1);
+    COPM_BITFIELD(UVPout,            5, 1);
+    COPM_BITFIELD(FanError,          6, 1);
+    COPM_BITFIELD(OTP,               7, 1);
+    COPM_BITFIELD(OCPin,             8, 1);
+    COPM_BITFIELD(OCPout,            9, 1);
+    COPM_BITFIELD(UVPAuxSupply,     10, 1);
+    COPM_BITFIELD(InterlockDetected,11, 1);
+    COPM_BITFIELD(ResetProtection,  12, 1);
+    COPM_BITFIELD(SetpointTimeout,  13, 1);
+    COPM_BITFIELD(SetpointNotMet,   14, 1);
+    COPM_BITFIELD(PFCerror,         15, 1);
+    COPM_BITFIELD(DumploadTooHot,   16, 1);
+    COPM_BITFIELD(DumploadError,    17, 1);
+    COPM_BITFIELD(CanIdError,       18, 1);
+    COPM_BITFIELD(InputCurrentDiff, 19, 1);
+    COPM_BITFIELD(EepromError,      20, 1);
+    COPM_BITFIELD(RelayError,       21, 1);
+    COPM_BITFIELD(FuseError,        22, 1);
+};
+
+/// TPmStatus, the 16 lsb of 2101
+struct TPmStatusFields
+{
+    COPM_BITFIELD_STORAGE(uint16_t);
+
+    COPM_BITFIELD(ChargerOn,                 0, 1);
+    COPM_BITFIELD(GlobalError,               1, 1);
+    COPM_BITFIELD(InputOverVoltageDetect,    2, 1);
+    COPM_BITFIELD(InputUnderVoltageDetect,   3, 1);
+    COPM_BITFIELD(OutputOverVoltageDetect,   4, 1);
+    COPM_BITFIELD(OutputUnderVoltageDetect,  5, 1);
+    COPM_BITFIELD(FanFailure,                6, 1);
+    COPM_BITFIELD(OverTemperatureDetect,     7, 1);
+    COPM_BITFIELD(InputOverCurrentProtect,   8, 1);
+    COPM_BITFIELD(OutputOverCurrentProtect,  9, 1);
+    COPM_BITFIELD(AuxUnderVoltageDetect,    10, 1);
+    COPM_BITFIELD(Interlock,                11, 1);
+    COPM_BITFIELD(ResetDetect,              12, 1);
+    COPM_BITFIELD(SetpointTimeout,          13, 1);
+    COPM_BITFIELD(SetpointNotMet,           14, 1);
+    COPM_BITFIELD(PFCerror,                 15, 1);
+};
+
+/// TV2hPmStatus
+struct TV2hPmStatusFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BITFIELD(DC_OverCurrent_HW,              0, 1);
+    COPM_BITFIELD(DC_AmbientTemperatureAbnormal,  1, 1);
+    COPM_BITFIELD(DC_OverTemperature,             2, 1);
+    COPM_BITFIELD(DC_OverCurrent,                 3, 1);
+    COPM_BITFIELD(DC_BusOverVoltage,              4, 1);
+    COPM_BITFIELD(DC_BusUnderVoltage,             5, 1);
+    COPM_BITFIELD(DC_OverVoltage,                 6, 1);
+    COPM_BITFIELD(DC_UnderVoltage,                7, 1);
+    COPM_BITFIELD(DC_Short,                       8, 1);
+    COPM_BITFIELD(DC_BusUnbalance,                9, 1);
+    COPM_BITFIELD(DC_OverVoltage_HW,             10, 1);
+    COPM_BITFIELD(DC_FanError,                   11, 1);
+    COPM_BITFIELD(DC_ExternalCurrentSensorError, 12, 1);
+    COPM_BITFIELD(DC_IpcVersionUnmatched,        13, 1);
+    COPM_BITFIELD(DC_EepromError,                14, 1);
+    COPM_BITFIELD(DC_CanError,                   15, 1);
+    COPM_BITFIELD(AC_RelayError,                 16, 1);
+    COPM_BITFIELD(AC_CurrentUnbalance,           17, 1);
+    COPM_BITFIELD(AC_OverCurrent,                18, 1);
+    COPM_BITFIELD(AC_OverCurrent_HW,             19, 1);
+    COPM_BITFIELD(AC_GridFail,                   20, 1);
+    COPM_BITFIELD(AC_DcInjectionError,           21, 1);
+    COPM_BITFIELD(AC_SoftStartFail,              22, 1);
+    COPM_BITFIELD(AC_CurrentSensorError,         23, 1);
+    COPM_BITFIELD(AC_GridIslanding,              24, 1);
+    COPM_BITFIELD(AC_BusVoltageSensorError,      25, 1);
+    COPM_BITFIELD(AC_BusVoltageFail,             26, 1);
+    COPM_BITFIELD(AC_BusOverVoltage,             27, 1);
+    COPM_BITFIELD(AC_BusUnderVoltage,            28, 1);
+    COPM_BITFIELD(AC_BusUnbalance,               29, 1);
+    COPM_BITFIELD(DC_DumpLoadError,              30, 1);
+    COPM_BITFIELD(AC_GeneralError,               31, 1);
+};
+
+/// TPwbStatus, PWB_PDO_1
+struct TPwbStatusFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BITFIELD(InterlinkDCPlusClose,   0, 1);
+    COPM_BITFIELD(InterlinkDCMinusClose,  1, 1);
+    COPM_BITFIELD(HasOutletError,         2, 1);
+    COPM_BITFIELD(HasConfigurationError,  3, 1);
+    COPM_BITFIELD(InterlinkDCPlusError,   4, 1);
+    COPM_BITFIELD(InterlinkDCMinusError,  5, 1);
+    COPM_BITFIELD(HasGlobalInterlock,     6, 1);
+    COPM_BITFIELD(HasLatchError,          7, 1);
+    COPM_BITFIELD(Unused,                 8, 24);
+};
+
+/// TPmSoftVersion, one TCoBitField per byte of the two uint16 versions
+struct TPmSoftVersionFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BITFIELD(DcDcDsp,       0, 16);
+    COPM_BITFIELD(DcDcDspHigh,   0, 8);
+    COPM_BITFIELD(DcDcDspLow,    8, 8);
+    COPM_BITFIELD(PfcDsp,       16, 16);
+    COPM_BITFIELD(PfcDspHigh,   16, 8);
+    COPM_BITFIELD(PfcDspLow,    24, 8);
+};
+
+/// The BIST results are 2 bit fields (TPmBistResult2Bit), reserved fields are omitted
+#define COPM_BIST_FIELD(name, slot)     COPM_BITFIELD(name, 2 * (slot), 2)
+
+/// Returns 2 bit field *slot* (0..15) of a BIST result
+inline constexpr uint32_t PmBistField(uint32_t value, unsigned slot)
+{
+    return (value >> (2 * (slot & 15))) & 3;
+}
+
+struct TPmBistResultGeneral1Fields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(TestResult,             0);
+    COPM_BIST_FIELD(Eeprom,                 1);
+    COPM_BIST_FIELD(Fan,                    2);
+    COPM_BIST_FIELD(LEMReference,           3);
+    COPM_BIST_FIELD(DcBusVoltageZero,       4);
+    COPM_BIST_FIELD(DcCurrentZero,          5);
+    COPM_BIST_FIELD(DumploadCurrentZero,    6);
+    COPM_BIST_FIELD(AuxPower15V,            7);
+    COPM_BIST_FIELD(AuxPower12V,            8);
+    COPM_BIST_FIELD(SpiExtAdc,              9);
+    COPM_BIST_FIELD(DcOutputCurrent,       10);
+    COPM_BIST_FIELD(BusVoltage,            11);
+    COPM_BIST_FIELD(OutputVoltage,         12);
+    COPM_BIST_FIELD(DcCapacitors,          13);
+    COPM_BIST_FIELD(DcBus,                 14);
+    COPM_BIST_FIELD(GridConnection,        15);
+};
+
+struct TUugreenBistResultGeneral1Fields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(TestResult,             0);
+    COPM_BIST_FIELD(SystemAcRelayClose,     1);
+    COPM_BIST_FIELD(Communication,          2);
+    COPM_BIST_FIELD(AcOv,                   4);
+    COPM_BIST_FIELD(AcUv,                   5);
+    COPM_BIST_FIELD(PfcOv,                  6);
+    COPM_BIST_FIELD(PfcUv,                  7);
+    COPM_BIST_FIELD(PfcUnbalance,           8);
+    COPM_BIST_FIELD(DcOv,                   9);
+    COPM_BIST_FIELD(DcUv,                  10);
+    COPM_BIST_FIELD(DcUnbalance,           11);
+    COPM_BIST_FIELD(Bleeder,               12);
+    COPM_BIST_FIELD(Fan,                   13);
+    COPM_BIST_FIELD(FanDriver,             14);
+    COPM_BIST_FIELD(PfcDcCommunication,    15);
+};
+
+struct TPmBistResultGeneral2Fields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(CpldInterlock,          0);
+    COPM_BIST_FIELD(CpldOVP,                1);
+    COPM_BIST_FIELD(CpldOCP,                2);
+    COPM_BIST_FIELD(CpldReset,              3);
+    COPM_BIST_FIELD(DcOutputVoltageZero,    4);
+    COPM_BIST_FIELD(DischargeSpeed,         6);
+    COPM_BIST_FIELD(DumploadCurrentSense,   7);
+    COPM_BIST_FIELD(DumploadPowerLimit,     8);
+    COPM_BIST_FIELD(DcOutputOvp,            9);
+};
+
+struct TUugreenBistResultGeneral2Fields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(PfcEeprom,              0);
+    COPM_BIST_FIELD(DcEeprom,               1);
+};
+
+struct TPmBistConvXResultFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(LEMZero,                0);
+    COPM_BIST_FIELD(DcStageCurrentZero,     2);
+    COPM_BIST_FIELD(AcVoltage,              3);
+    COPM_BIST_FIELD(AcCurrent,              4);
+    COPM_BIST_FIELD(Dvdt,                   5);
+    COPM_BIST_FIELD(ResonantStage,          6);
+    COPM_BIST_FIELD(DcCurrent,              7);
+    COPM_BIST_FIELD(DcVoltage,              8);
+};
+
+struct TPmBistTemperatureControlFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(TemperatureADC,         0);
+    COPM_BIST_FIELD(TemperatureIGBT1,       1);
+    COPM_BIST_FIELD(TemperatureRECT1,       2);
+    COPM_BIST_FIELD(TemperatureIGBT3,       3);
+    COPM_BIST_FIELD(TemperatureDiode,       4);
+    COPM_BIST_FIELD(TemperatureInd1,        5);
+    COPM_BIST_FIELD(TemperatureTr1,         6);
+    COPM_BIST_FIELD(TemperatureInd3,        7);
+    COPM_BIST_FIELD(TemperatureTr3,         8);
+    COPM_BIST_FIELD(TemperaturePCB1,        9);
+    COPM_BIST_FIELD(TemperaturePCB2,       10);
+};
+
+struct TBuckBoostBistGeneralResult1Fields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(TestResult,             0);
+    COPM_BIST_FIELD(Eeprom,                 1);
+    COPM_BIST_FIELD(ImodZero,               2);
+    COPM_BIST_FIELD(InletDcBusVoltage,      3);
+    COPM_BIST_FIELD(OutputDcBusVoltageZero, 4);
+    COPM_BIST_FIELD(Fuse,                   5);
+    COPM_BIST_FIELD(Pdpint,                 6);
+    COPM_BIST_FIELD(Interlock,              7);
+    COPM_BIST_FIELD(OverCurrProtImod,       8);
+    COPM_BIST_FIELD(HwDischargePtc,         9);
+};
+
+struct TBuckBoostBistGeneralResult2FanTestFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(FanStop,                0);
+    COPM_BIST_FIELD(FanIdle,                1);
+    COPM_BIST_FIELD(FanSlow,                2);
+    COPM_BIST_FIELD(FanFast,                3);
+};
+
+struct TBuckBoostBistGeneralResult2TempTestFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(TemperatureBB,          0);
+    COPM_BIST_FIELD(TemperatureChip,        1);
+    COPM_BIST_FIELD(TemperatureMA,          2);
+    COPM_BIST_FIELD(TemperatureMB,          3);
+};
+
+struct TBuckBoostBistConvXResultFields
+{
+    COPM_BITFIELD_STORAGE(uint32_t);
+
+    COPM_BIST_FIELD(IphaseZero,                 0);
+    COPM_BIST_FIELD(OverCurrProtIphase,         1);
+    COPM_BIST_FIELD(BuckHighVoltageSetpoint,    2);
+    COPM_BIST_FIELD(BuckLowVoltageSetpoint,     3);
+    COPM_BIST_FIELD(BoostHighVoltageSetpoint,   4);
+    COPM_BIST_FIELD(BoostLowVoltageSetpoint,    5);
+};
+
+/// Connects a union to its descriptors: TFields, and the value of the integer member
+template <typename U>
+struct TCoBitFieldUnion;
+
+#define COPM_BITFIELD_UNION(U, F, member)                                               \
+    template <>                                                                         \
+    struct TCoBitFieldUnion<U>                                                          \
+    {                                                                                   \
+        typedef F TFields;                                                              \
+        static typename F::TStorage Value(const U& u) { return u.member; }              \
+        static void SetValue(U& u, typename F::TStorage value) { u.member = value; }    \
+    }
+
+COPM_BITFIELD_UNION(TPmConverterStatus,                     TPmConverterStatusFields,                   value);
+COPM_BITFIELD_UNION(TPmStatus,                              TPmStatusFields,                            m_value);
+COPM_BITFIELD_UNION(TV2hPmStatus,                           TV2hPmStatusFields,                         value);
+COPM_BITFIELD_UNION(TPwbStatus,                             TPwbStatusFields,                           m_data);
+COPM_BITFIELD_UNION(TPmBistResultGeneral1,                  TPmBistResultGeneral1Fields,                ulAll);
+COPM_BITFIELD_UNION(TUugreenBistResultGeneral1,             TUugreenBistResultGeneral1Fields,           ulAll);
+COPM_BITFIELD_UNION(TPmBistResultGeneral2,                  TPmBistResultGeneral2Fields,                ulAll);
+COPM_BITFIELD_UNION(TUugreenBistResultGeneral2,             TUugreenBistResultGeneral2Fields,           ulAll);
+COPM_BITFIELD_UNION(TPmBistConvXResult,                     TPmBistConvXResultFields,                   ulAll);
+COPM_BITFIELD_UNION(TPmBistTemperatureControl,              TPmBistTemperatureControlFields,            ulAll);
+COPM_BITFIELD_UNION(TBuckBoostBistGeneralResult1,           TBuckBoostBistGeneralResult1Fields,         ulAll);
+COPM_BITFIELD_UNION(TBuckBoostBistGeneralResult2FanTest,    TBuckBoostBistGeneralResult2FanTestFields,  ulAll);
+COPM_BITFIELD_UNION(TBuckBoostBistGeneralResult2TempTest,   TBuckBoostBistGeneralResult2TempTestFields, ulAll);
+COPM_BITFIELD_UNION(TBuckBoostBistConvXResult,              TBuckBoostBistConvXResultFields,            ulAll);
+
+/// TPmSoftVersion is a struct of two uint16 unions, DcDcDsp in the 16 lsb
+template <>
+struct TCoBitFieldUnion<TPmSoftVersion>
+{
+    typedef TPmSoftVersionFields TFields;
+
+    static uint32_t Value(const TPmSoftVersion& u)
+    {
+        return (uint32_t)u.DcDcDsp.value | ((uint32_t)u.PfcDsp.value << 16);
+    }
+
+    static void SetValue(TPmSoftVersion& u, uint32_t value)
+    {
+        u.DcDcDsp.value = (uint16_t)value;
+        u.PfcDsp.value  = (uint16_t)(value >> 16);
+    }
+};
+
+/// Reads field *Field* (a descriptor of the union) of *u*
+template <typename Field, typename U>
+inline typename Field::TStorage CoGetField(const U& u)
+{
+    static_assert(sizeof(typename Field::TStorage) == sizeof(typename TCoBitFieldUnion<U>::TFields::TStorage),
+                  "descriptor of another type");
+
+    return Field::Get(TCoBitFieldUnion<U>::Value(u));
+}
+
+/// Replaces field *Field* (a descriptor of the union) of *u*
+template <typename Field, typename U>
+inline void CoSetField(U& u, typename Field::TStorage field)
+{
+    static_assert(sizeof(typename Field::TStorage) == sizeof(typename TCoBitFieldUnion<U>::TFields::TStorage),
+                  "descriptor of another type");
+
+    TCoBitFieldUnion<U>::SetValue(u, Field::Set(TCoBitFieldUnion<U>::Value(u), field));
+}
+
+// The descriptors must match the status bits of the ICD
+static_assert(TPmConverterStatusFields::ConverterActive::Mask()  == PM_STATUS_ENABLED, "");
+static_assert(TPmConverterStatusFields::FanError::Mask()         == PM_STATUS_FAN_FAILURE, "");
+static_assert(TPmConverterStatusFields::ResetProtection::Mask()  == PM_STATUS_RESET_DETECTED, "");
+static_assert(TPmConverterStatusFields::PFCerror::Mask()         == PM_STATUS_PFC_ERROR, "");
+static_assert(TPmConverterStatusFields::CanIdError::Mask()       == PM_STATUS_CANID_ERROR, "");
+static_assert(TPmConverterStatusFields::FuseError::Mask()        == PM_STATUS_FUSE_ERROR, "");
+static_assert(TPmStatusFields::PFCerror::Mask()                  == PM_STATUS_PFC_ERROR, "");
+static_assert(TPmStatusFields::ResetDetect::Mask()               == PM_STATUS_RESET_DETECTED, "");
+static_assert(TPmSoftVersionFields::PfcDspLow::Get(0x12345678u)  == 0x12, "");
+static_assert(TPwbStatusFields::Unused::Mask()                   == 0xffffff00u, "");
+static_assert(TPmBistResultGeneral1Fields::GridConnection::Get(0xc0000000u) == 3, "");
+
+#endif // __INTERFACE_COBITFIELD_H__
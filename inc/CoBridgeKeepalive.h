@@ -0,0 +1,275 @@
+#ifndef __INTERFACE_COBRIDGE_KEEPALIVE_H__
+#define __INTERFACE_COBRIDGE_KEEPALIVE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoBridge.h"
+#include "CoSdo.h"
+#include "CoTimerWheel.h"
+
+/// # Interlink contactor keepalive
+///
+/// Keeps the interlink DC contactor of PowerBridges closed with timed enable writes
+/// of PWB_SDO_INTERLINK_DC_CONTACTOR (2402 = PWB_INTERLINK_TIMED_ENABLE). The bridge
+/// opens the contactor when no timed enable arrives within 10 s.
+///
+/// All bridges are served from one thread: every bridge has a timer in a
+/// CCoTimerWheel, the application calls Poll() regularly (e.g. every 10 ms) from the
+/// thread that owns the SDO client. It is constructed with the time base of the
+/// later Acquire() and Poll() calls.
+///
+/// - Sessions are reference counted per bridge: the first Acquire() writes at once
+///   and starts the refreshes, the last Release() stops them.
+/// - The refreshes of the bridges are spread over the period: a new bridge gets the
+///   phase (slot of PWB_KEEPALIVE_SPREAD_SLOTS) used by the fewest bridges, so the
+///   writes do not come in bursts.
+/// - A write the client does not accept or that is aborted is retried after
+///   PWB_KEEPALIVE_RETRY_MS.
+/// - A write only counts once the bridge confirmed it: the application passes the
+///   download responses to OnSdoResponse() and the aborts to OnSdoAbort().
+/// - A refresh that is written later than the tolerance is reported as late; when
+///   the time since the last confirmed write reaches the timeout of the bridge the
+///   contactor may have opened and it is reported as expired.
+
+#define PWB_KEEPALIVE_TIMEOUT_MS        10000   // timed enable of the bridge
+#define PWB_KEEPALIVE_PERIOD_MS         3000
+#define PWB_KEEPALIVE_RETRY_MS          100
+#define PWB_KEEPALIVE_LATE_MS           500
+#define PWB_KEEPALIVE_SPREAD_SLOTS      30
+
+enum TPwbKeepaliveMiss
+{
+    PWB_KEEPALIVE_LATE = 0,             // refresh later than the tolerance
+    PWB_KEEPALIVE_EXPIRED,              // no confirmed write within the timeout
+};
+
+class IPwbKeepaliveSink
+{
+public:
+    virtual ~IPwbKeepaliveSink() {}
+
+    /// *sinceWriteMs* is the time since the last confirmed write of the bridge
+    virtual void OnKeepaliveMissed(uint8_t node, TPwbKeepaliveMiss miss, uint64_t sinceWriteMs) = 0;
+};
+
+typedef struct
+{
+    uint64_t    writes;
+    uint64_t    confirmed;
+    uint64_t    retries;            // not accepted or aborted
+    uint64_t    late;
+    uint64_t    expired;
+}TPwbKeepaliveStatistics;
+
+class CPwbKeepalive
+{
+public:
+    CPwbKeepalive(ICoSdoClient& client, IPwbKeepaliveSink& sink, uint64_t nowMs)
+        : m_client(client)
+        , m_sink(sink)
+        , m_periodMs(PWB_KEEPALIVE_PERIOD_MS)
+        , m_wheel(nowMs)
+    {
+        memset(m_phaseLoad, 0, sizeof(m_phaseLoad));
+        memset(&m_statistics, 0, sizeof(m_statistics));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_bridges[node].owner = this;
+            m_bridges[node].node  = (uint8_t)node;
+        }
+    }
+
+    /// Refresh period, well below PWB_KEEPALIVE_TIMEOUT_MS
+    void SetPeriod(uint32_t periodMs) { m_periodMs = periodMs; }
+
+    /// Starts a session on a bridge, returns the number of sessions of the bridge
+    unsigned Acquire(uint8_t node, uint64_t nowMs)
+    {
+        TBridge& bridge = m_bridges[node & COPM_MAX_NODE_ID];
+
+        if (bridge.sessions++ == 0)
+        {
+            bridge.phase       = Phase();
+            bridge.lastWriteMs = nowMs;
+            bridge.expired     = false;
+            m_phaseLoad[bridge.phase]++;
+            Refresh(bridge, nowMs);
+        }
+
+        return bridge.sessions;
+    }
+
+    /// Ends a session; after the last one the contactor opens with the timeout, or at
+    /// once with *open*
+    unsigned Release(uint8_t node, bool open = false)
+    {
+        TBridge& bridge = m_bridges[node & COPM_MAX_NODE_ID];
+
+        if (!bridge.sessions || --bridge.sessions)
+        {
+            return bridge.sessions;
+        }
+
+        m_wheel.Cancel(bridge);
+        m_phaseLoad[bridge.phase]--;
+
+        if (open)
+        {
+            m_client.SdoWrite(CoSdoAccess(bridge.node, PWB_SDO_INTERLINK_DC_CONTACTOR, 0, 1, PWB_INTERLINK_FORCED_OFF));
+        }
+
+        return 0;
+    }
+
+    unsigned Sessions(uint8_t node) const { return m_bridges[node & COPM_MAX_NODE_ID].sessions; }
+
+    /// Confirmation of a timed enable: the bridge restarted its timeout when it got the
+    /// write, at the latest
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        TBridge& bridge = m_bridges[node & COPM_MAX_NODE_ID];
+
+        if ((index != PWB_SDO_INTERLINK_DC_CONTACTOR) || (subIndex != 0) || !bridge.sessions)
+        {
+            return false;
+        }
+
+        m_statistics.confirmed++;
+        bridge.lastWriteMs = bridge.sentMs;
+        bridge.expired     = false;
+
+        return true;
+    }
+
+    /// An aborted timed enable is written again
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex, uint64_t nowMs)
+    {
+        TBridge& bridge = m_bridges[node & COPM_MAX_NODE_ID];
+
+        if ((index != PWB_SDO_INTERLINK_DC_CONTACTOR) || (subIndex != 0) || !bridge.sessions)
+        {
+            return false;
+        }
+
+        m_statistics.retries++;
+        Expired(bridge, nowMs);
+        m_wheel.Schedule(bridge, nowMs + PWB_KEEPALIVE_RETRY_MS);
+
+        return true;
+    }
+
+    /// Writes the refreshes that are due
+    unsigned Poll(uint64_t nowMs)
+    {
+        return m_wheel.Advance(nowMs);
+    }
+
+    const TPwbKeepaliveStatistics& Statistics() const { return m_statistics; }
+
+private:
+    class TBridge : public CCoTimer
+    {
+    public:
+        TBridge()
+            : owner(0)
+            , lastWriteMs(0)
+            , sentMs(0)
+            , sessions(0)
+            , phase(0)
+            , node(0)
+            , expired(false)
+        {
+        }
+
+        virtual void OnTimer(uint64_t nowMs, uint64_t lateMs)
+        {
+            owner->OnRefresh(*this, nowMs, lateMs);
+        }
+
+        CPwbKeepalive*  owner;
+        uint64_t        lastWriteMs;    // last confirmed write, or the first Acquire()
+        uint64_t        sentMs;         // last write queued
+        unsigned        sessions;
+        unsigned        phase;
+        uint8_t         node;
+        bool            expired;        // reported
+    };
+
+    /// Least used phase slot
+    unsigned Phase() const
+    {
+        unsigned best = 0;
+
+        for (unsigned slot = 1; slot < PWB_KEEPALIVE_SPREAD_SLOTS; slot++)
+        {
+            best = (m_phaseLoad[slot] < m_phaseLoad[best]) ? slot : best;
+        }
+
+        return best;
+    }
+
+    /// Next time at the phase of the bridge, within one period
+    uint64_t Next(const TBridge& bridge, uint64_t nowMs) const
+    {
+        uint64_t phaseMs = (uint64_t)bridge.phase * m_periodMs / PWB_KEEPALIVE_SPREAD_SLOTS;
+        uint64_t delay   = (phaseMs + m_periodMs - nowMs % m_periodMs) % m_periodMs;
+
+        return nowMs + (delay ? delay : m_periodMs);
+    }
+
+    void OnRefresh(TBridge& bridge, uint64_t nowMs, uint64_t lateMs)
+    {
+        if (!Expired(bridge, nowMs) && (lateMs > PWB_KEEPALIVE_LATE_MS))
+        {
+            m_statistics.late++;
+            m_sink.OnKeepaliveMissed(bridge.node, PWB_KEEPALIVE_LATE, nowMs - bridge.lastWriteMs);
+        }
+
+        Refresh(bridge, nowMs);
+    }
+
+    /// Reports an expired bridge once, true while it is expired
+    bool Expired(TBridge& bridge, uint64_t nowMs)
+    {
+        if (nowMs - bridge.lastWriteMs < PWB_KEEPALIVE_TIMEOUT_MS)
+        {
+            return false;
+        }
+
+        if (!bridge.expired)
+        {
+            bridge.expired = true;
+            m_statistics.expired++;
+            m_sink.OnKeepaliveMissed(bridge.node, PWB_KEEPALIVE_EXPIRED, nowMs - bridge.lastWriteMs);
+        }
+
+        return true;
+    }
+
+    void Refresh(TBridge& bridge, uint64_t nowMs)
+    {
+        if (m_client.SdoWrite(CoSdoAccess(bridge.node, PWB_SDO_INTERLINK_DC_CONTACTOR, 0, 1, PWB_INTERLINK_TIMED_ENABLE)))
+        {
+            m_statistics.writes++;
+            bridge.sentMs = nowMs;
+            m_wheel.Schedule(bridge, Next(bridge, nowMs));
+            return;
+        }
+
+        m_statistics.retries++;
+        Expired(bridge, nowMs);
+        m_wheel.Schedule(bridge, nowMs + PWB_KEEPALIVE_RETRY_MS);
+    }
+
+    ICoSdoClient&           m_client;
+    IPwbKeepaliveSink&      m_sink;
+    uint32_t                m_periodMs;
+    unsigned                m_phaseLoad[PWB_KEEPALIVE_SPREAD_SLOTS];
+    TBridge                 m_bridges[COPM_MAX_NODE_ID + 1];
+    CCoTimerWheel           m_wheel;            // after the timers, destroyed first
+    TPwbKeepaliveStatistics m_statistics;
+};
+
+#endif // __INTERFACE_COBRIDGE_KEEPALIVE_H__
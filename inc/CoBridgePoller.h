@@ -0,0 +1,353 @@
+#ifndef __INTERFACE_COBRIDGE_POLLER_H__
+#define __INTERFACE_COBRIDGE_POLLER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoBridge.h"
+#include "CoBridgeState.h"
+#include "CoSdo.h"
+#include "CoSeqLock.h"
+
+/// # PowerBridge output and status poller
+///
+/// Reads 2400[1..n] (TPwbVI) and 2401[1..n] (TPwbPmState) of all power modules behind
+/// one PowerBridge. All reads of a cycle are queued at once, up to *window* requests
+/// in flight, so the duration of a cycle is bounded by the bus throughput instead of
+/// 2 \* n round trips. When every read of the cycle has been answered, aborted or has
+/// timed out, the results are committed to the bridge cache as one snapshot.
+///
+/// Note: a CANopen SDO server handles one transfer per SDO channel, so the default
+/// window is 1. A larger window only helps when the stack multiplexes requests to the
+/// same node; polling several bridges with CPwbBridgePollers overlaps their round
+/// trips either way.
+///
+/// Entries that were not answered in a cycle (aborted or timed out) are cleared in
+/// the snapshot, their bits are 0 in validMask and their faults are 0.
+///
+/// Request bit n of a cycle:
+///
+/// | Bit   | Object                 |
+/// |-------|------------------------|
+/// | 0..7  | 2400[1..8]  TPwbVI     |
+/// | 8..15 | 2401[1..8]  TPwbPmState|
+
+#define PWB_POLL_REQUESTS               (2 * PWB_MAX_PM_PER_BRIDGE)
+#define PWB_POLL_DEFAULT_TIMEOUT_MS     500
+#define PWB_POLL_DEFAULT_WINDOW         1
+
+typedef struct
+{
+    uint32_t        cycle;          // number of the poll cycle
+    uint64_t        timestampMs;    // start of the poll cycle
+    uint16_t        validMask;      // request bits answered in this cycle
+    uint8_t         moduleCount;
+    TPwbVI          vi[PWB_MAX_PM_PER_BRIDGE];
+    TPwbPmState     state[PWB_MAX_PM_PER_BRIDGE];
+    uint32_t        faults[PWB_MAX_PM_PER_BRIDGE];  // TPwbFaultBits of state[]
+}TPwbBridgeSnapshot;
+
+typedef CCoSeqLock<TPwbBridgeSnapshot> CPwbBridgeCache;
+
+class CPwbBridgePoller
+{
+public:
+    CPwbBridgePoller(uint8_t node, ICoSdoClient& client, unsigned moduleCount = PWB_MAX_PM_PER_BRIDGE,
+                     unsigned window = PWB_POLL_DEFAULT_WINDOW)
+        : m_node(node)
+        , m_client(client)
+        , m_window(window ? window : 1)
+        , m_type(PWB_UNDEFINED)
+        , m_timeoutMs(PWB_POLL_DEFAULT_TIMEOUT_MS)
+        , m_startMs(0)
+        , m_cycle(0)
+        , m_pending(0)
+        , m_outstanding(0)
+        , m_answered(0)
+        , m_busy(false)
+        , m_overruns(0)
+        , m_timeouts(0)
+    {
+        memset(&m_staging, 0, sizeof(m_staging));
+        SetModuleCount(moduleCount);
+    }
+
+    uint8_t Node() const { return m_node; }
+
+    void SetModuleCount(unsigned count)
+    {
+        m_staging.moduleCount = (uint8_t)(count < PWB_MAX_PM_PER_BRIDGE ? count : PWB_MAX_PM_PER_BRIDGE);
+    }
+
+    /// The module type (2420) selects how the state bytes are normalized
+    void SetModuleType(TPwbPowerModuleType type) { m_type = type; }
+
+    void SetTimeout(uint32_t timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    const CPwbBridgeCache& Cache() const { return m_cache; }
+
+    bool Busy() const { return m_busy; }
+
+    /// Number of cycles that could not start because the previous one was still running
+    uint32_t Overruns() const { return m_overruns; }
+
+    /// Number of reads that were not answered within the timeout
+    uint32_t Timeouts() const { return m_timeouts; }
+
+    /// Starts a poll cycle, returns false when the previous cycle is still running
+    bool Start(uint64_t nowMs)
+    {
+        if (m_busy)
+        {
+            m_overruns++;
+            return false;
+        }
+
+        uint16_t modules = (uint16_t)((1u << m_staging.moduleCount) - 1);
+
+        m_busy        = true;
+        m_startMs     = nowMs;
+        m_pending     = (uint16_t)(modules | (modules << PWB_MAX_PM_PER_BRIDGE));
+        m_outstanding = 0;
+        m_answered    = 0;
+
+        Pump();
+        Complete();
+
+        return true;
+    }
+
+    /// Passes the result of an upload of this node, returns false when it was not ours
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        int request = Request(node, index, subIndex);
+
+        if ((request < 0) || (size < 4))
+        {
+            return false;
+        }
+
+        unsigned pm = (unsigned)request % PWB_MAX_PM_PER_BRIDGE;
+
+        if (index == PWB_SDO_PM_OUTPUT)
+        {
+            m_staging.vi[pm].voltage = CoGetLe16(&data[0]);
+            m_staging.vi[pm].current = CoGetLe16(&data[2]);
+        }
+        else
+        {
+            uint8_t* state = (uint8_t*)&m_staging.state[pm];
+
+            state[0] = data[0];     // temperature
+            state[1] = data[1];     // tab0
+            state[2] = data[2];     // tab1
+            state[3] = data[3];     // tab2
+        }
+
+        m_answered |= (uint16_t)(1u << request);
+        Resolve((unsigned)request);
+
+        return true;
+    }
+
+    /// Passes an SDO abort of this node, returns false when it was not ours
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        int request = Request(node, index, subIndex);
+
+        if (request < 0)
+        {
+            return false;
+        }
+
+        Resolve((unsigned)request);
+
+        return true;
+    }
+
+    /// Retries requests the stack could not queue and ends a cycle that timed out
+    void Poll(uint64_t nowMs)
+    {
+        if (!m_busy)
+        {
+            return;
+        }
+
+        if ((nowMs - m_startMs) >= m_timeoutMs)
+        {
+            m_timeouts   += (uint32_t)__builtin_popcount((unsigned)(m_pending | m_outstanding));
+            m_pending     = 0;
+            m_outstanding = 0;
+        }
+        else
+        {
+            Pump();
+        }
+
+        Complete();
+    }
+
+private:
+    int Request(uint8_t node, uint16_t index, uint8_t subIndex) const
+    {
+        if ((node != m_node) || (subIndex < 1) || (subIndex > PWB_MAX_PM_PER_BRIDGE))
+        {
+            return -1;
+        }
+
+        int request = subIndex - 1;
+
+        if (index == PWB_SDO_PM_STATUS)
+        {
+            request += PWB_MAX_PM_PER_BRIDGE;
+        }
+        else if (index != PWB_SDO_PM_OUTPUT)
+        {
+            return -1;
+        }
+
+        return (m_outstanding & (1u << request)) ? request : -1;
+    }
+
+    void Resolve(unsigned request)
+    {
+        m_outstanding &= (uint16_t)~(1u << request);
+        Pump();
+        Complete();
+    }
+
+    void Pump()
+    {
+        while (m_pending && ((unsigned)__builtin_popcount(m_outstanding) < m_window))
+        {
+            unsigned request  = (unsigned)__builtin_ctz(m_pending);
+            uint16_t index    = (request < PWB_MAX_PM_PER_BRIDGE) ? PWB_SDO_PM_OUTPUT : PWB_SDO_PM_STATUS;
+            uint8_t  subIndex = (uint8_t)(request % PWB_MAX_PM_PER_BRIDGE + 1);
+
+            if (!m_client.SdoRead(m_node, index, subIndex))
+            {
+                break;
+            }
+
+            m_pending     &= (uint16_t)~(1u << request);
+            m_outstanding |= (uint16_t)(1u << request);
+        }
+    }
+
+    void Complete()
+    {
+        if (!m_busy || m_pending || m_outstanding)
+        {
+            return;
+        }
+
+        TPwbBridgeSnapshot& snapshot = m_cache.BeginWrite();
+
+        m_staging.cycle       = ++m_cycle;
+        m_staging.timestampMs = m_startMs;
+        m_staging.validMask   = m_answered;
+
+        // Nothing of an earlier cycle is passed on as current
+        for (unsigned pm = 0; pm < PWB_MAX_PM_PER_BRIDGE; pm++)
+        {
+            if (!(m_answered & (1u << pm)))
+            {
+                memset(&m_staging.vi[pm], 0, sizeof(m_staging.vi[pm]));
+            }
+
+            if (!(m_answered & (1u << (pm + PWB_MAX_PM_PER_BRIDGE))))
+            {
+                memset(&m_staging.state[pm], 0, sizeof(m_staging.state[pm]));
+            }
+        }
+
+        PwbNormalizeStates(m_type, m_staging.state, m_staging.faults);
+        memcpy(&snapshot, &m_staging, sizeof(snapshot));
+
+        m_cache.EndWrite();
+        m_busy = false;
+    }
+
+    uint8_t             m_node;
+    ICoSdoClient&       m_client;
+    unsigned            m_window;
+    TPwbPowerModuleType m_type;
+    uint32_t            m_timeoutMs;
+    uint64_t            m_startMs;
+    uint32_t            m_cycle;
+    uint16_t            m_pending;
+    uint16_t            m_outstanding;
+    uint16_t            m_answered;
+    bool                m_busy;
+    uint32_t            m_overruns;
+    uint32_t            m_timeouts;
+    TPwbBridgeSnapshot  m_staging;
+    CPwbBridgeCache     m_cache;
+};
+
+/// Routes the SDO results of all PowerBridges to their poller and starts their cycles
+/// together, so that the cycles of different bridges overlap on the bus.
+class CPwbBridgePollers
+{
+public:
+    CPwbBridgePollers()
+    {
+        memset(m_byNode, 0, sizeof(m_byNode));
+    }
+
+    void Add(CPwbBridgePoller& poller)
+    {
+        m_byNode[poller.Node() & COPM_MAX_NODE_ID] = &poller;
+    }
+
+    void Remove(uint8_t node)
+    {
+        m_byNode[node & COPM_MAX_NODE_ID] = 0;
+    }
+
+    CPwbBridgePoller* Find(uint8_t node) const
+    {
+        return m_byNode[node & COPM_MAX_NODE_ID];
+    }
+
+    void Start(uint64_t nowMs)
+    {
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (m_byNode[node])
+            {
+                m_byNode[node]->Start(nowMs);
+            }
+        }
+    }
+
+    void Poll(uint64_t nowMs)
+    {
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (m_byNode[node])
+            {
+                m_byNode[node]->Poll(nowMs);
+            }
+        }
+    }
+
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        CPwbBridgePoller* poller = Find(node);
+
+        return poller && poller->OnSdoResponse(node, index, subIndex, data, size);
+    }
+
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        CPwbBridgePoller* poller = Find(node);
+
+        return poller && poller->OnSdoAbort(node, index, subIndex);
+    }
+
+private:
+    CPwbBridgePoller*   m_byNode[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COBRIDGE_POLLER_H__
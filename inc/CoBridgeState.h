@@ -0,0 +1,318 @@
+#ifndef __INTERFACE_COBRIDGE_STATE_H__
+#define __INTERFACE_COBRIDGE_STATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "CoBridge.h"
+
+/// # PowerBridge power module state normalization
+///
+/// The three state bytes of 2401[1..8] (TPwbPmState) have a vendor specific meaning,
+/// see TPwbStateInfy, TPwbStateIncr and TPwbStateUugr. PwbNormalizeState() converts
+/// them into one vendor independent fault bit set (TPwbFaultBits) with three table
+/// lookups. The tables are generated at compile time from the bit maps below, one per
+/// vendor family, state byte and bit.
+///
+/// | Type           | Family  | Remark                                           |
+/// |----------------|---------|--------------------------------------------------|
+/// | PWB_UNDEFINED  | Unknown | every set bit is reported as PWB_FAULT_UNDECODED |
+/// | PWB_INFY\*     | Infy    |                                                  |
+/// | PWB_INCR\*     | Increase|                                                  |
+/// | PWB_UUGR100030 | UUGreen | output loop status (tab2 bit 3..4) is not a fault|
+/// | PWB_ELPC100030 | Elpc    | layout not specified, reported as undecoded      |
+
+enum TPwbFaultBits
+{
+     PWB_FAULT_SHUTDOWN                      = 1u<< 0
+    ,PWB_FAULT_MODULE_FAULT                  = 1u<< 1
+    ,PWB_FAULT_PROTECTED                     = 1u<< 2
+    ,PWB_FAULT_FAN_FAILURE                   = 1u<< 3
+    ,PWB_FAULT_OVER_TEMPERATURE              = 1u<< 4
+    ,PWB_FAULT_UNDER_TEMPERATURE             = 1u<< 5
+    ,PWB_FAULT_DC_OVER_VOLTAGE               = 1u<< 6
+    ,PWB_FAULT_DC_UNDER_VOLTAGE              = 1u<< 7
+    ,PWB_FAULT_DC_SHORT_CIRCUIT              = 1u<< 8
+    ,PWB_FAULT_DC_OVER_CURRENT               = 1u<< 9
+    ,PWB_FAULT_AC_OVER_VOLTAGE               = 1u<<10
+    ,PWB_FAULT_AC_UNDER_VOLTAGE              = 1u<<11
+    ,PWB_FAULT_AC_PHASE                      = 1u<<12
+    ,PWB_FAULT_PFC                           = 1u<<13
+    ,PWB_FAULT_COMMUNICATION_LOST            = 1u<<14
+    ,PWB_FAULT_INTERNAL_COMMUNICATION        = 1u<<15
+    ,PWB_FAULT_LIMITED                       = 1u<<16
+    ,PWB_FAULT_DUPLICATE_ID                  = 1u<<17
+    ,PWB_FAULT_CURRENT_SHARING               = 1u<<18
+    ,PWB_FAULT_BLEEDER                       = 1u<<19
+    ,PWB_FAULT_SLEEPING                      = 1u<<20
+    ,PWB_FAULT_WALK_IN                       = 1u<<21
+    ,PWB_FAULT_UNDECODED                     = 1u<<31
+};
+
+/// Faults that stop the module from delivering power
+#define PWB_FAULT_NOT_OPERATIONAL_MASK  (PWB_FAULT_SHUTDOWN | PWB_FAULT_MODULE_FAULT | PWB_FAULT_PROTECTED | \
+                                         PWB_FAULT_DC_SHORT_CIRCUIT | PWB_FAULT_COMMUNICATION_LOST | \
+                                         PWB_FAULT_DUPLICATE_ID)
+
+inline const char* PwbFault2String(unsigned PwbFault)
+{
+    const char* retValue = "Undefined";
+
+    switch(PwbFault)
+    {
+    case PWB_FAULT_SHUTDOWN:                retValue = "PWB_FAULT_SHUTDOWN"; break;
+    case PWB_FAULT_MODULE_FAULT:            retValue = "PWB_FAULT_MODULE_FAULT"; break;
+    case PWB_FAULT_PROTECTED:               retValue = "PWB_FAULT_PROTECTED"; break;
+    case PWB_FAULT_FAN_FAILURE:             retValue = "PWB_FAULT_FAN_FAILURE"; break;
+    case PWB_FAULT_OVER_TEMPERATURE:        retValue = "PWB_FAULT_OVER_TEMPERATURE"; break;
+    case PWB_FAULT_UNDER_TEMPERATURE:       retValue = "PWB_FAULT_UNDER_TEMPERATURE"; break;
+    case PWB_FAULT_DC_OVER_VOLTAGE:         retValue = "PWB_FAULT_DC_OVER_VOLTAGE"; break;
+    case PWB_FAULT_DC_UNDER_VOLTAGE:        retValue = "PWB_FAULT_DC_UNDER_VOLTAGE"; break;
+    case PWB_FAULT_DC_SHORT_CIRCUIT:        retValue = "PWB_FAULT_DC_SHORT_CIRCUIT"; break;
+    case PWB_FAULT_DC_OVER_CURRENT:         retValue = "PWB_FAULT_DC_OVER_CURRENT"; break;
+    case PWB_FAULT_AC_OVER_VOLTAGE:         retValue = "PWB_FAULT_AC_OVER_VOLTAGE"; break;
+    case PWB_FAULT_AC_UNDER_VOLTAGE:        retValue = "PWB_FAULT_AC_UNDER_VOLTAGE"; break;
+    case PWB_FAULT_AC_PHASE:                retValue = "PWB_FAULT_AC_PHASE"; break;
+    case PWB_FAULT_PFC:                     retValue = "PWB_FAULT_PFC"; break;
+    case PWB_FAULT_COMMUNICATION_LOST:      retValue = "PWB_FAULT_COMMUNICATION_LOST"; break;
+    case PWB_FAULT_INTERNAL_COMMUNICATION:  retValue = "PWB_FAULT_INTERNAL_COMMUNICATION"; break;
+    case PWB_FAULT_LIMITED:                 retValue = "PWB_FAULT_LIMITED"; break;
+    case PWB_FAULT_DUPLICATE_ID:            retValue = "PWB_FAULT_DUPLICATE_ID"; break;
+    case PWB_FAULT_CURRENT_SHARING:         retValue = "PWB_FAULT_CURRENT_SHARING"; break;
+    case PWB_FAULT_BLEEDER:                 retValue = "PWB_FAULT_BLEEDER"; break;
+    case PWB_FAULT_SLEEPING:                retValue = "PWB_FAULT_SLEEPING"; break;
+    case PWB_FAULT_WALK_IN:                 retValue = "PWB_FAULT_WALK_IN"; break;
+    case PWB_FAULT_UNDECODED:               retValue = "PWB_FAULT_UNDECODED"; break;
+    }
+
+    return retValue;
+}
+
+enum TPwbStateFamily
+{
+    PWB_STATE_FAMILY_UNKNOWN = 0,
+    PWB_STATE_FAMILY_INFY,
+    PWB_STATE_FAMILY_INCR,
+    PWB_STATE_FAMILY_UUGR,
+    PWB_STATE_FAMILY_ELPC,
+    PWB_STATE_FAMILY_COUNT
+};
+
+#define PWB_STATE_BYTES                 3
+#define PWB_MAX_PM_PER_BRIDGE           8
+
+/// Family of the state layout, indexed with TPwbPowerModuleType
+constexpr uint8_t g_pwbStateFamily[] =
+{
+    PWB_STATE_FAMILY_UNKNOWN,   // PWB_UNDEFINED
+    PWB_STATE_FAMILY_INFY,      // PWB_INFY50030
+    PWB_STATE_FAMILY_INFY,      // PWB_INFY75025
+    PWB_STATE_FAMILY_INFY,      // PWB_INFY100025
+    PWB_STATE_FAMILY_INCR,      // PWB_INCR50030
+    PWB_STATE_FAMILY_INCR,      // PWB_INCR75025
+    PWB_STATE_FAMILY_UUGR,      // PWB_UUGR100030
+    PWB_STATE_FAMILY_ELPC,      // PWB_ELPC100030
+};
+
+#define PWB_UNDECODED_BYTE  { PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED, \
+                              PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED, PWB_FAULT_UNDECODED }
+
+/// Normalized faults per family, state byte (tab0..tab2) and bit
+constexpr uint32_t g_pwbStateBitMap[PWB_STATE_FAMILY_COUNT][PWB_STATE_BYTES][8] =
+{
+    // PWB_STATE_FAMILY_UNKNOWN
+    { PWB_UNDECODED_BYTE, PWB_UNDECODED_BYTE, PWB_UNDECODED_BYTE },
+
+    // PWB_STATE_FAMILY_INFY, see TPwbStateInfy
+    {
+        {
+            PWB_FAULT_DC_SHORT_CIRCUIT,
+            0,
+            0,
+            0,
+            PWB_FAULT_SLEEPING,
+            0,
+            0,
+            0,
+        },
+        {
+            PWB_FAULT_SHUTDOWN,
+            PWB_FAULT_MODULE_FAULT,
+            PWB_FAULT_PROTECTED,
+            PWB_FAULT_FAN_FAILURE,
+            PWB_FAULT_OVER_TEMPERATURE,
+            PWB_FAULT_DC_OVER_VOLTAGE,
+            PWB_FAULT_WALK_IN,
+            PWB_FAULT_COMMUNICATION_LOST,
+        },
+        {
+            PWB_FAULT_LIMITED,
+            PWB_FAULT_DUPLICATE_ID,
+            PWB_FAULT_CURRENT_SHARING,
+            PWB_FAULT_AC_PHASE,
+            PWB_FAULT_AC_PHASE,
+            PWB_FAULT_AC_UNDER_VOLTAGE,
+            PWB_FAULT_AC_OVER_VOLTAGE,
+            PWB_FAULT_SHUTDOWN,
+        },
+    },
+
+    // PWB_STATE_FAMILY_INCR, see TPwbStateIncr
+    {
+        {
+            PWB_FAULT_SHUTDOWN,
+            PWB_FAULT_MODULE_FAULT,
+            PWB_FAULT_LIMITED,
+            PWB_FAULT_FAN_FAILURE,
+            PWB_FAULT_AC_OVER_VOLTAGE,
+            PWB_FAULT_AC_UNDER_VOLTAGE,
+            PWB_FAULT_DC_OVER_VOLTAGE,
+            PWB_FAULT_DC_UNDER_VOLTAGE,
+        },
+        {
+            PWB_FAULT_PROTECTED | PWB_FAULT_DC_OVER_CURRENT,
+            PWB_FAULT_PROTECTED | PWB_FAULT_OVER_TEMPERATURE,
+            PWB_FAULT_SHUTDOWN,
+            0,
+            0,
+            0,
+            0,
+            0,
+        },
+        { 0, 0, 0, 0, 0, 0, 0, 0 },
+    },
+
+    // PWB_STATE_FAMILY_UUGR, see TPwbStateUugr
+    {
+        {
+            PWB_FAULT_AC_OVER_VOLTAGE,
+            PWB_FAULT_AC_UNDER_VOLTAGE,
+            PWB_FAULT_PROTECTED | PWB_FAULT_AC_OVER_VOLTAGE,
+            PWB_FAULT_PFC,
+            PWB_FAULT_PFC,
+            PWB_FAULT_PFC,
+            PWB_FAULT_DC_OVER_VOLTAGE,
+            PWB_FAULT_PROTECTED | PWB_FAULT_DC_OVER_VOLTAGE,
+        },
+        {
+            PWB_FAULT_DC_UNDER_VOLTAGE,
+            PWB_FAULT_FAN_FAILURE,
+            PWB_FAULT_FAN_FAILURE,
+            PWB_FAULT_PROTECTED | PWB_FAULT_OVER_TEMPERATURE,
+            PWB_FAULT_UNDER_TEMPERATURE,
+            PWB_FAULT_PROTECTED | PWB_FAULT_OVER_TEMPERATURE,
+            PWB_FAULT_PROTECTED | PWB_FAULT_OVER_TEMPERATURE,
+            PWB_FAULT_INTERNAL_COMMUNICATION,
+        },
+        {
+            PWB_FAULT_MODULE_FAULT | PWB_FAULT_PFC,
+            PWB_FAULT_MODULE_FAULT,
+            PWB_FAULT_SHUTDOWN,
+            0,
+            0,
+            PWB_FAULT_CURRENT_SHARING,
+            PWB_FAULT_DUPLICATE_ID,
+            PWB_FAULT_BLEEDER,
+        },
+    },
+
+    // PWB_STATE_FAMILY_ELPC
+    { PWB_UNDECODED_BYTE, PWB_UNDECODED_BYTE, PWB_UNDECODED_BYTE },
+};
+
+#undef PWB_UNDECODED_BYTE
+
+typedef struct
+{
+    uint32_t    entry[PWB_STATE_FAMILY_COUNT][PWB_STATE_BYTES][256];
+}TPwbFaultTable;
+
+// The table is built by a constexpr function with loops
+#if __cplusplus < 201402L
+#error "CoBridgeState.h requires C++14"
+#endif
+
+constexpr TPwbFaultTable PwbBuildFaultTable()
+{
+    TPwbFaultTable table = {};
+
+    for (unsigned family = 0; family < PWB_STATE_FAMILY_COUNT; family++)
+    {
+        for (unsigned byte = 0; byte < PWB_STATE_BYTES; byte++)
+        {
+            for (unsigned value = 0; value < 256; value++)
+            {
+                uint32_t faults = 0;
+
+                for (unsigned bit = 0; bit < 8; bit++)
+                {
+                    if (value & (1u << bit))
+                    {
+                        faults |= g_pwbStateBitMap[family][byte][bit];
+                    }
+                }
+
+                table.entry[family][byte][value] = faults;
+            }
+        }
+    }
+
+    return table;
+}
+
+inline const TPwbFaultTable& PwbFaultTable()
+{
+    static constexpr TPwbFaultTable s_table = PwbBuildFaultTable();
+
+    return s_table;
+}
+
+inline unsigned PwbStateFamily(TPwbPowerModuleType type)
+{
+    unsigned index = (unsigned)type;
+
+    return g_pwbStateFamily[index < sizeof(g_pwbStateFamily) ? index : (unsigned)PWB_UNDEFINED];
+}
+
+/// Returns the TPwbFaultBits of one 2401 response
+inline uint32_t PwbNormalizeState(TPwbPowerModuleType type, const TPwbPmState& state)
+{
+    const uint32_t (*table)[256] = PwbFaultTable().entry[PwbStateFamily(type)];
+    const uint8_t* bytes = (const uint8_t*)&state.state;
+
+    return table[0][bytes[0]] | table[1][bytes[1]] | table[2][bytes[2]];
+}
+
+/// Normalizes the states of *count* modules of one PowerBridge, typically all
+/// PWB_MAX_PM_PER_BRIDGE of them, and returns the union of all faults.
+inline uint32_t PwbNormalizeStates(TPwbPowerModuleType type, const TPwbPmState* states, uint32_t* faults,
+                                   size_t count = PWB_MAX_PM_PER_BRIDGE)
+{
+    const uint32_t (*table)[256] = PwbFaultTable().entry[PwbStateFamily(type)];
+    uint32_t all = 0;
+
+    for (size_t pm = 0; pm < count; pm++)
+    {
+        const uint8_t* bytes = (const uint8_t*)&states[pm].state;
+
+        faults[pm] = table[0][bytes[0]] | table[1][bytes[1]] | table[2][bytes[2]];
+        all       |= faults[pm];
+    }
+
+    return all;
+}
+
+/// Returns a mask with bit n set when module n+1 has any of *faultMask*
+inline uint8_t PwbModulesWithFault(const uint32_t* faults, uint32_t faultMask, size_t count = PWB_MAX_PM_PER_BRIDGE)
+{
+    uint8_t modules = 0;
+
+    for (size_t pm = 0; pm < count; pm++)
+    {
+        modules |= (uint8_t)((uint8_t)((faults[pm] & faultMask) != 0) << pm);
+    }
+
+    return modules;
+}
+
+#endif // __INTERFACE_COBRIDGE_STATE_H__
@@ -0,0 +1,297 @@
+#ifndef __INTERFACE_COBRIDGE_TOPOLOGY_H__
+#define __INTERFACE_COBRIDGE_TOPOLOGY_H__
+
+#include <stdint.h>
+
+#include "CoBridge.h"
+#include "CoSdo.h"
+
+/// # PowerBridge group topology
+///
+/// Keeps the group topology of one PowerBridge as bit masks and derives the objects
+/// that have to be written when power modules drop out or return.
+///
+/// | Object | Description                 | Kept as                                  |
+/// |--------|-----------------------------|------------------------------------------|
+/// | 2406   | AC contactor group state    | contactors, bit n: group n+1             |
+/// | 2421   | Power module config topology| groupCount and popcount of groupMask[n]  |
+/// | 2422   | Power module config group   | groupMask[n], bit n: power module n+1    |
+///
+/// Every group has a *home* mask (the modules that belong to the group when all of
+/// them are healthy), an *allowed* mask (the modules that can be switched into the
+/// group) and a demand (the number of modules the group wants). The layout is a pure
+/// function of the availability mask:
+///
+/// 1. every group keeps its lowest healthy home modules, up to its demand
+/// 2. a group that is short borrows the lowest healthy unassigned allowed modules
+/// 3. the AC contactors of a group are on when it has at least one module
+///
+/// Apply() compares the layout with the layout that was written last and only returns
+/// the sub-indices that changed. Contactors that have to open, and those of every group
+/// whose modules change, are written off before the group objects; contactors that
+/// have to be on are written after them.
+
+#define PWB_TOPOLOGY_MAX_GROUPS         2
+#define PWB_TOPOLOGY_MAX_PM             8
+#define PWB_TOPOLOGY_MAX_WRITES         (2 + 2 * (1 + PWB_TOPOLOGY_MAX_GROUPS))
+
+typedef struct
+{
+    uint8_t     groupCount;
+    uint8_t     groupMask[PWB_TOPOLOGY_MAX_GROUPS];
+    uint8_t     contactors;
+}TPwbTopologyLayout;
+
+inline unsigned PwbPopCount(uint8_t mask)
+{
+    return (unsigned)__builtin_popcount(mask);
+}
+
+/// Returns the *count* least significant bits that are set in *mask*
+inline uint8_t PwbLowestBits(uint8_t mask, unsigned count)
+{
+    uint8_t result = 0;
+
+    while (mask && count)
+    {
+        result |= (uint8_t)(mask & (0 - mask));
+        mask   &= (uint8_t)(mask - 1);
+        count--;
+    }
+
+    return result;
+}
+
+class CPwbTopology
+{
+public:
+    explicit CPwbTopology(uint8_t node)
+        : m_node(node)
+        , m_available(0xFF)
+        , m_valid(false)
+    {
+        m_config.groupCount = 0;
+
+        for (unsigned group = 0; group < PWB_TOPOLOGY_MAX_GROUPS; group++)
+        {
+            m_config.homeMask[group]    = 0;
+            m_config.allowedMask[group] = 0;
+            m_config.demand[group]      = 0;
+        }
+
+        Compute();
+        m_applied = m_layout;
+    }
+
+    /// Sets the number of groups (2421[0], 2422[0]), 0..PWB_TOPOLOGY_MAX_GROUPS
+    void SetGroupCount(unsigned count)
+    {
+        m_config.groupCount = (uint8_t)(count < PWB_TOPOLOGY_MAX_GROUPS ? count : PWB_TOPOLOGY_MAX_GROUPS);
+        Compute();
+    }
+
+    /// Configures group 0..PWB_TOPOLOGY_MAX_GROUPS-1. The home modules are always allowed.
+    void SetGroup(unsigned group, uint8_t homeMask, uint8_t allowedMask, unsigned demand)
+    {
+        if (group >= PWB_TOPOLOGY_MAX_GROUPS)
+        {
+            return;
+        }
+
+        m_config.homeMask[group]    = homeMask;
+        m_config.allowedMask[group] = (uint8_t)(allowedMask | homeMask);
+        m_config.demand[group]      = (uint8_t)(demand < PWB_TOPOLOGY_MAX_PM ? demand : PWB_TOPOLOGY_MAX_PM);
+        Compute();
+    }
+
+    /// Changes the number of modules group wants, e.g. when a session needs less power
+    void SetDemand(unsigned group, unsigned demand)
+    {
+        if (group < PWB_TOPOLOGY_MAX_GROUPS)
+        {
+            SetGroup(group, m_config.homeMask[group], m_config.allowedMask[group], demand);
+        }
+    }
+
+    /// Marks power module 1..8 as healthy or faulty
+    void SetModuleAvailable(unsigned module, bool available)
+    {
+        if ((module < 1) || (module > PWB_TOPOLOGY_MAX_PM))
+        {
+            return;
+        }
+
+        uint8_t bit = (uint8_t)(1u << (module - 1));
+
+        SetAvailable(available ? (uint8_t)(m_available | bit) : (uint8_t)(m_available & ~bit));
+    }
+
+    /// Sets the healthy modules at once, bit n: power module n+1
+    void SetAvailable(uint8_t mask)
+    {
+        if (mask != m_available)
+        {
+            m_available = mask;
+            Compute();
+        }
+    }
+
+    uint8_t Available() const { return m_available; }
+
+    /// The layout for the current configuration and availability
+    const TPwbTopologyLayout& Layout() const { return m_layout; }
+
+    /// The layout that was returned by the last Apply() or set with SetApplied()
+    const TPwbTopologyLayout& Applied() const { return m_applied; }
+
+    /// Returns the group 0..n-1 power module 1..8 is assigned to, or -1
+    int GroupOf(unsigned module) const
+    {
+        if ((module < 1) || (module > PWB_TOPOLOGY_MAX_PM))
+        {
+            return -1;
+        }
+
+        uint8_t bit = (uint8_t)(1u << (module - 1));
+
+        for (unsigned group = 0; group < m_layout.groupCount; group++)
+        {
+            if (m_layout.groupMask[group] & bit)
+            {
+                return (int)group;
+            }
+        }
+
+        return -1;
+    }
+
+    /// Sets the layout that is active in the PowerBridge, e.g. read back at start-up
+    void SetApplied(const TPwbTopologyLayout& layout)
+    {
+        m_applied = layout;
+        m_valid   = true;
+    }
+
+    /// Forces all objects to be written by the next Apply()
+    void Invalidate()
+    {
+        m_valid = false;
+    }
+
+    /// Fills *writes* with the SDO downloads that bring the PowerBridge from the
+    /// applied layout to the current layout and returns their number. The layout is
+    /// considered applied afterwards.
+    unsigned Apply(TCoSdoAccess writes[PWB_TOPOLOGY_MAX_WRITES])
+    {
+        const TPwbTopologyLayout& from = m_applied;
+        const TPwbTopologyLayout& to   = m_layout;
+        unsigned count = 0;
+
+        // Contactors that open and those of groups whose modules change go first, so that
+        // no module is moved while it is on the grid; the latter close again at the end
+        uint8_t moved = 0;
+
+        for (unsigned group = 0; group < PWB_TOPOLOGY_MAX_GROUPS; group++)
+        {
+            if (!m_valid || (from.groupMask[group] != to.groupMask[group]))
+            {
+                moved |= (uint8_t)(1u << group);
+            }
+        }
+
+        uint8_t keep = (uint8_t)(from.contactors & to.contactors & ~moved);
+
+        if (!m_valid || (keep != from.contactors))
+        {
+            writes[count++] = CoSdoAccess(m_node, PWB_SDO_GROUPS_AC_CONTACTORS, 0, 1, keep);
+        }
+
+        if (!m_valid || (from.groupCount != to.groupCount))
+        {
+            writes[count++] = CoSdoAccess(m_node, PWB_SDO_CONFIG_PM_TOPOLOGY, 0, 1, to.groupCount);
+            writes[count++] = CoSdoAccess(m_node, PWB_SDO_CONFIG_PM_GROUP, 0, 4, to.groupCount);
+        }
+
+        for (unsigned group = 0; group < PWB_TOPOLOGY_MAX_GROUPS; group++)
+        {
+            uint8_t changed = (uint8_t)(from.groupMask[group] ^ to.groupMask[group]);
+
+            if (!m_valid || changed)
+            {
+                writes[count++] = CoSdoAccess(m_node, PWB_SDO_CONFIG_PM_GROUP, (uint8_t)(group + 1), 4, to.groupMask[group]);
+            }
+
+            if (!m_valid || (PwbPopCount(from.groupMask[group]) != PwbPopCount(to.groupMask[group])))
+            {
+                writes[count++] = CoSdoAccess(m_node, PWB_SDO_CONFIG_PM_TOPOLOGY, (uint8_t)(group + 1), 1,
+                                              PwbPopCount(to.groupMask[group]));
+            }
+        }
+
+        if (!m_valid || (keep != to.contactors))
+        {
+            writes[count++] = CoSdoAccess(m_node, PWB_SDO_GROUPS_AC_CONTACTORS, 0, 1, to.contactors);
+        }
+
+        m_applied = m_layout;
+        m_valid   = true;
+
+        return count;
+    }
+
+private:
+    void Compute()
+    {
+        uint8_t assigned = 0;
+
+        m_layout.groupCount = m_config.groupCount;
+        m_layout.contactors = 0;
+
+        for (unsigned group = 0; group < PWB_TOPOLOGY_MAX_GROUPS; group++)
+        {
+            m_layout.groupMask[group] = 0;
+
+            if (group < m_config.groupCount)
+            {
+                m_layout.groupMask[group] = PwbLowestBits((uint8_t)(m_config.homeMask[group] & m_available),
+                                                          m_config.demand[group]);
+                assigned |= m_layout.groupMask[group];
+            }
+        }
+
+        for (unsigned group = 0; group < m_config.groupCount; group++)
+        {
+            unsigned have = PwbPopCount(m_layout.groupMask[group]);
+
+            if (have < m_config.demand[group])
+            {
+                uint8_t spare    = (uint8_t)(m_config.allowedMask[group] & m_available & ~assigned);
+                uint8_t borrowed = PwbLowestBits(spare, m_config.demand[group] - have);
+
+                m_layout.groupMask[group] |= borrowed;
+                assigned                  |= borrowed;
+            }
+
+            if (m_layout.groupMask[group])
+            {
+                m_layout.contactors |= (uint8_t)(1u << group);
+            }
+        }
+    }
+
+    struct
+    {
+        uint8_t     groupCount;
+        uint8_t     homeMask[PWB_TOPOLOGY_MAX_GROUPS];
+        uint8_t     allowedMask[PWB_TOPOLOGY_MAX_GROUPS];
+        uint8_t     demand[PWB_TOPOLOGY_MAX_GROUPS];
+    }                   m_config;
+
+    uint8_t             m_node;
+    uint8_t             m_available;
+    bool                m_valid;
+    TPwbTopologyLayout  m_layout;
+    TPwbTopologyLayout  m_applied;
+};
+
+#endif // __INTERFACE_COBRIDGE_TOPOLOGY_H__
@@ -0,0 +1,423 @@
+#ifndef __INTERFACE_COFAN_HEALTH_H__
+#define __INTERFACE_COFAN_HEALTH_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoSdo.h"
+
+/// # Fan health
+///
+/// Watches the fans of the power modules and of the PowerBridges.
+///
+/// PowerBridge: PWB_SDO_FANS_STATE (2405) holds 2 bits per fan for up to 16 fans.
+/// PwbDecodeFans() splits the word into one bit per fan for each state with a few
+/// word-wide shifts and masks, no loop over the fans.
+///
+/// Power module: the fan PWM (2133[4], or the value the application wrote to the
+/// write-only 2113, see SetPwm()) and the tacho (2114) are compared with the speed
+/// expected at that PWM. The expected speed comes from the fleet: per cooling group
+/// (ventilation topology and airflow of PM_SDO_COOLING_PARAMETERS, 2117) a line
+/// rpm = offset + slope \* PWM is fitted over the samples of the healthy modules,
+/// with exponential forgetting. A module joins a group once both topology and
+/// airflow are known. Samples below the minimum PWM (2117[4]) are not used, the
+/// fans may be stopped there; such a sample clears PM_FAN_STALLED.
+///
+/// | Flag                 | Condition                                                  |
+/// |----------------------|------------------------------------------------------------|
+/// | PM_FAN_STALLED       | PWM above the minimum, tacho below PM_FAN_STALL_RPM        |
+/// | PM_FAN_LOW           | average actual / expected speed below the low ratio        |
+/// | PM_FAN_DEGRADING     | the slow average ratio dropped by more than the allowed    |
+/// |                      | amount from the reference learned when the fan was new     |
+/// | PM_FAN_FAILED        | PM_STATUS_FAN_FAILURE is set, the module already tripped   |
+///
+/// A flagged module does not contribute to the baseline of its group.
+
+#define PWB_FAN_MAX                     16
+#define PWB_FAN_STATE_NORMAL            0
+#define PWB_FAN_STATE_ERROR             3
+
+#define PM_FAN_MAX_GROUPS               8
+#define PM_FAN_STALL_RPM                200
+#define PM_FAN_DEFAULT_LOW_RATIO        0.8
+#define PM_FAN_DEFAULT_DEGRADE_DROP     0.05    // drop of the ratio from the reference
+#define PM_FAN_FAST_ALPHA               0.2
+#define PM_FAN_SLOW_ALPHA               0.01
+#define PM_FAN_BASELINE_FORGETTING      0.999
+#define PM_FAN_WARMUP_SAMPLES           100     // samples before the reference is taken
+#define PM_FAN_MIN_BASELINE_WEIGHT      20.0
+
+typedef struct
+{
+    uint16_t    normal;             // bit n - 1 is fan n
+    uint16_t    reserved;           // state 1 or 2
+    uint16_t    error;
+}TPwbFanStates;
+
+/// Keeps the even bits of *value* and packs them into the low 16 bits
+inline uint32_t CoCompactEvenBits(uint32_t value)
+{
+    value &= 0x55555555u;
+    value  = (value | (value >> 1)) & 0x33333333u;
+    value  = (value | (value >> 2)) & 0x0f0f0f0fu;
+    value  = (value | (value >> 4)) & 0x00ff00ffu;
+    value  = (value | (value >> 8)) & 0x0000ffffu;
+
+    return value;
+}
+
+/// Decodes 2405 as read, *fanCount* from PWB_SDO_FAN_CONFIGURATION (2404[1])
+inline TPwbFanStates PwbDecodeFans(uint32_t state, unsigned fanCount = PWB_FAN_MAX)
+{
+    uint32_t      lo    = state & 0x55555555u;
+    uint32_t      hi    = (state >> 1) & 0x55555555u;
+    uint32_t      fans  = (fanCount >= PWB_FAN_MAX) ? 0xffffu : ((1u << fanCount) - 1);
+    TPwbFanStates states;
+
+    states.normal   = (uint16_t)(CoCompactEvenBits(~(lo | hi)) & fans);
+    states.reserved = (uint16_t)(CoCompactEvenBits(lo ^ hi) & fans);
+    states.error    = (uint16_t)(CoCompactEvenBits(lo & hi) & fans);
+
+    return states;
+}
+
+/// Decodes the 2405 words of many bridges
+inline void PwbDecodeFans(const uint32_t* states, unsigned count, TPwbFanStates* out, unsigned fanCount = PWB_FAN_MAX)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        out[i] = PwbDecodeFans(states[i], fanCount);
+    }
+}
+
+enum TPmFanFlags
+{
+    PM_FAN_STALLED      = 1 << 0,
+    PM_FAN_LOW          = 1 << 1,
+    PM_FAN_DEGRADING    = 1 << 2,
+    PM_FAN_FAILED       = 1 << 3,
+};
+
+inline const char* PmFanFlag2String(unsigned flag)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (flag)
+    {
+    case PM_FAN_STALLED:    retValue = "STALLED"; break;
+    case PM_FAN_LOW:        retValue = "LOW"; break;
+    case PM_FAN_DEGRADING:  retValue = "DEGRADING"; break;
+    case PM_FAN_FAILED:     retValue = "FAILED"; break;
+    }
+
+    return retValue;
+}
+
+typedef struct
+{
+    uint8_t     flags;              // TPmFanFlags
+    uint8_t     group;              // cooling group, 0xff before 2117 is known
+    uint8_t     pwm;                // %
+    uint16_t    rpm;
+    float       expectedRpm;        // 0 without a baseline
+    float       ratio;              // fast average of rpm / expected
+    float       slowRatio;
+    float       reference;          // slow ratio when the fan was new, 0 before
+    uint32_t    samples;
+}TPmFanHealth;
+
+class CPmFanHealth
+{
+public:
+    CPmFanHealth()
+        : m_lowRatio(PM_FAN_DEFAULT_LOW_RATIO)
+        , m_degradeDrop(PM_FAN_DEFAULT_DEGRADE_DROP)
+        , m_groupCount(0)
+    {
+        memset(m_modules, 0, sizeof(m_modules));
+        memset(m_cooling, 0, sizeof(m_cooling));
+        memset(m_groups, 0, sizeof(m_groups));
+        memset(m_bridges, 0, sizeof(m_bridges));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_modules[node].group = 0xff;
+        }
+    }
+
+    void SetThresholds(double lowRatio, double degradeDrop)
+    {
+        m_lowRatio    = lowRatio;
+        m_degradeDrop = degradeDrop;
+    }
+
+    /// PM_SDO_COOLING_PARAMETERS (2117) of a module
+    void SetCooling(uint8_t node, uint16_t topology, uint16_t airflow, uint8_t minPwm)
+    {
+        TCooling& cooling = m_cooling[node & COPM_MAX_NODE_ID];
+
+        cooling.topology = topology;
+        cooling.airflow  = airflow;
+        cooling.minPwm   = minPwm;
+        cooling.known    = PM_FAN_COOLING_TOPOLOGY | PM_FAN_COOLING_AIRFLOW;
+        Assign(node & COPM_MAX_NODE_ID);
+    }
+
+    /// Forgets the reference, e.g. after the fan was replaced
+    void ResetReference(uint8_t node)
+    {
+        TPmFanHealth& m = m_modules[node & COPM_MAX_NODE_ID];
+
+        m.reference = 0;
+        m.samples   = 0;
+        m.flags    &= (uint8_t)~PM_FAN_DEGRADING;
+    }
+
+    /// PM_SDO_CONV_STATUS (2101) or the status of PM_PDO_1
+    void SetStatus(uint8_t node, uint32_t status)
+    {
+        TPmFanHealth& m = m_modules[node & COPM_MAX_NODE_ID];
+
+        m.flags = (uint8_t)((status & PM_STATUS_FAN_FAILURE) ? (m.flags | PM_FAN_FAILED) : (m.flags & ~PM_FAN_FAILED));
+    }
+
+    /// Adds a sample of PWM [%] and tacho [rpm] of a module
+    void Sample(uint8_t node, uint8_t pwm, uint16_t rpm)
+    {
+        TPmFanHealth&   m       = m_modules[node & COPM_MAX_NODE_ID];
+        const TCooling& cooling = m_cooling[node & COPM_MAX_NODE_ID];
+        uint8_t         flags   = (uint8_t)(m.flags & PM_FAN_FAILED);
+
+        m.pwm         = pwm;
+        m.rpm         = rpm;
+        m.expectedRpm = 0;
+
+        if ((m.group == 0xff) || (pwm <= cooling.minPwm))
+        {
+            // The fan may be stopped, a stall seen before does not hold any more
+            m.flags &= (uint8_t)~PM_FAN_STALLED;
+            return;
+        }
+
+        if (rpm < PM_FAN_STALL_RPM)
+        {
+            m.flags = (uint8_t)(flags | PM_FAN_STALLED | (m.flags & PM_FAN_DEGRADING));
+            return;
+        }
+
+        TGroup& group    = m_groups[m.group];
+        double  expected = Expected(group, pwm);
+
+        if (expected > 0)
+        {
+            double ratio = rpm / expected;
+
+            m.expectedRpm = (float)expected;
+            m.ratio       = m.samples ? (float)(m.ratio + PM_FAN_FAST_ALPHA * (ratio - m.ratio)) : (float)ratio;
+            m.slowRatio   = m.samples ? (float)(m.slowRatio + PM_FAN_SLOW_ALPHA * (ratio - m.slowRatio)) : (float)ratio;
+            m.samples++;
+
+            if (m.samples == PM_FAN_WARMUP_SAMPLES)
+            {
+                m.reference = m.slowRatio;
+            }
+
+            flags |= (m.ratio < m_lowRatio) ? PM_FAN_LOW : 0;
+            flags |= ((m.reference > 0) && (m.slowRatio < m.reference - m_degradeDrop)) ? PM_FAN_DEGRADING : 0;
+        }
+
+        m.flags = flags;
+
+        if (!flags)
+        {
+            Fit(group, pwm, rpm);
+        }
+    }
+
+    /// The PWM written to PM_SDO_FAN_SPEED (2113), which can not be read back; call it once
+    /// the write succeeded. Used with the next tacho like 2133[4].
+    void SetPwm(uint8_t node, uint8_t pwm)
+    {
+        m_modules[node & COPM_MAX_NODE_ID].pwm = (pwm > 100) ? 100 : pwm;
+    }
+
+    /// Handles 2114, 2117 and 2133[4] as they arrive; the PWM is used with the next tacho
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        if ((node > COPM_MAX_NODE_ID) || (size == 0))
+        {
+            return false;
+        }
+
+        uint16_t  value   = (size >= 2) ? CoGetLe16(data) : data[0];
+        TCooling& cooling = m_cooling[node];
+
+        switch (index)
+        {
+        case PM_SDO_TEMPERATURE_CTRL_STATISTICS:
+            if (subIndex == 4)
+            {
+                m_modules[node].pwm = (uint8_t)((value > 100) ? 100 : value);
+                return true;
+            }
+            break;
+
+        case PM_SDO_FAN_TACHO:
+            Sample(node, m_modules[node].pwm, value);
+            return true;
+
+        case PM_SDO_COOLING_PARAMETERS:
+            switch (subIndex)
+            {
+            case PM_SDO_COOLING_PARMS_TOPOLOGY_IDX:
+                cooling.topology  = value;
+                cooling.known    |= PM_FAN_COOLING_TOPOLOGY;
+                Assign(node);
+                return true;
+
+            case PM_SDO_COOLING_PARMS_AIRFLOW_IDX:
+                cooling.airflow   = value;
+                cooling.known    |= PM_FAN_COOLING_AIRFLOW;
+                Assign(node);
+                return true;
+
+            case PM_SDO_COOLING_PARMS_MIN_FAN_PWM_IDX:
+                cooling.minPwm = data[0];
+                return true;
+            }
+            break;
+        }
+
+        return false;
+    }
+
+    /// 2405 of a PowerBridge, returns the fans that changed to error
+    uint16_t OnBridgeFans(uint8_t node, uint32_t state, unsigned fanCount = PWB_FAN_MAX)
+    {
+        TPwbFanStates& bridge = m_bridges[node & COPM_MAX_NODE_ID];
+        uint16_t       before = bridge.error;
+
+        bridge = PwbDecodeFans(state, fanCount);
+
+        return (uint16_t)(bridge.error & ~before);
+    }
+
+    const TPwbFanStates& Bridge(uint8_t node) const { return m_bridges[node & COPM_MAX_NODE_ID]; }
+
+    const TPmFanHealth& Module(uint8_t node) const { return m_modules[node & COPM_MAX_NODE_ID]; }
+
+    /// Calls fn(uint8_t node, const TPmFanHealth&) for every flagged module
+    template <typename F>
+    void ForEachFlagged(F fn) const
+    {
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (m_modules[node].flags)
+            {
+                fn((uint8_t)node, m_modules[node]);
+            }
+        }
+    }
+
+private:
+    enum
+    {
+        PM_FAN_COOLING_TOPOLOGY = 1 << 0,
+        PM_FAN_COOLING_AIRFLOW  = 1 << 1,
+    };
+
+    struct TCooling
+    {
+        uint16_t    topology;
+        uint16_t    airflow;
+        uint8_t     minPwm;
+        uint8_t     known;          // PM_FAN_COOLING_TOPOLOGY | PM_FAN_COOLING_AIRFLOW
+    };
+
+    /// Puts a module into the group of its cooling, once topology and airflow are known
+    void Assign(uint8_t node)
+    {
+        const TCooling& cooling = m_cooling[node];
+
+        m_modules[node].group = (cooling.known == (PM_FAN_COOLING_TOPOLOGY | PM_FAN_COOLING_AIRFLOW)) ?
+                                Group(cooling.topology, cooling.airflow) : 0xff;
+    }
+
+    /// Weighted least squares sums of rpm over PWM
+    struct TGroup
+    {
+        uint16_t    topology;
+        uint16_t    airflow;
+        double      w;
+        double      sx;
+        double      sy;
+        double      sxx;
+        double      sxy;
+    };
+
+    uint8_t Group(uint16_t topology, uint16_t airflow)
+    {
+        for (unsigned g = 0; g < m_groupCount; g++)
+        {
+            if ((m_groups[g].topology == topology) && (m_groups[g].airflow == airflow))
+            {
+                return (uint8_t)g;
+            }
+        }
+
+        if (m_groupCount == PM_FAN_MAX_GROUPS)
+        {
+            return 0xff;
+        }
+
+        m_groups[m_groupCount].topology = topology;
+        m_groups[m_groupCount].airflow  = airflow;
+
+        return (uint8_t)m_groupCount++;
+    }
+
+    static void Fit(TGroup& group, double pwm, double rpm)
+    {
+        const double f = PM_FAN_BASELINE_FORGETTING;
+
+        group.w   = f * group.w + 1;
+        group.sx  = f * group.sx + pwm;
+        group.sy  = f * group.sy + rpm;
+        group.sxx = f * group.sxx + pwm * pwm;
+        group.sxy = f * group.sxy + pwm * rpm;
+    }
+
+    /// 0 until the group has enough samples over more than one PWM
+    static double Expected(const TGroup& group, double pwm)
+    {
+        double denominator = group.w * group.sxx - group.sx * group.sx;
+
+        if (group.w < PM_FAN_MIN_BASELINE_WEIGHT)
+        {
+            return 0.0;
+        }
+
+        if (denominator <= 1e-6 * group.w * group.w)
+        {
+            // One PWM only: the average speed
+            return group.sy / group.w;
+        }
+
+        double slope  = (group.w * group.sxy - group.sx * group.sy) / denominator;
+        double offset = (group.sy - slope * group.sx) / group.w;
+
+        return offset + slope * pwm;
+    }
+
+    double          m_lowRatio;
+    double          m_degradeDrop;
+    unsigned        m_groupCount;
+    TPmFanHealth    m_modules[COPM_MAX_NODE_ID + 1];
+    TCooling        m_cooling[COPM_MAX_NODE_ID + 1];
+    TGroup          m_groups[PM_FAN_MAX_GROUPS];
+    TPwbFanStates   m_bridges[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COFAN_HEALTH_H__
@@ -0,0 +1,407 @@
+#ifndef __INTERFACE_COLATENCY_H__
+#define __INTERFACE_COLATENCY_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// # Latency instrumentation
+///
+/// Measures the time a frame spends in each stage of the processing path, per frame
+/// class:
+///
+/// | Point               | Stage (time until the next point) |
+/// |---------------------|-----------------------------------|
+/// | COLAT_POINT_RX      | COLAT_STAGE_RX_RING               |
+/// | COLAT_POINT_RING    | COLAT_STAGE_RING_DECODE           |
+/// | COLAT_POINT_DECODE  | COLAT_STAGE_DECODE_COMMIT         |
+/// | COLAT_POINT_COMMIT  | COLAT_STAGE_COMMIT_NOTIFY         |
+/// | COLAT_POINT_NOTIFY  | COLAT_STAGE_TOTAL is RX to NOTIFY |
+///
+/// The instrumentation is only compiled in with COPM_LATENCY_ENABLED defined to 1;
+/// otherwise the macros expand to nothing and TCoLatencyStamps is empty:
+///
+///     TCoLatencyStamps stamps;
+///
+///     COPM_LATENCY_MARK(stamps, COLAT_POINT_RX);
+///     ...
+///     COPM_LATENCY_MARK(stamps, COLAT_POINT_NOTIFY);
+///     COPM_LATENCY_COMMIT(stamps, COLAT_CLASS_PDO_1);
+///
+/// Every thread records into its own histograms, so recording takes no lock and no
+/// atomic read-modify-write. CCoLatency::Summary() merges the histograms of all
+/// threads while they keep recording. When a thread exits its histograms are added to
+/// those of the exited threads and the block is reused by the next thread, so the
+/// memory is bounded by the number of threads that record at the same time.
+///
+/// The histograms are log-linear: values below 16 ns are exact, above that each power
+/// of two is split in 16 buckets, so a percentile is accurate to 1/16 (6.25%). Values
+/// above 2^34 ns (17 s) are counted in the last bucket.
+
+#ifndef COPM_LATENCY_ENABLED
+#define COPM_LATENCY_ENABLED            0
+#endif
+
+#define COLAT_SUB_BITS                  4
+#define COLAT_SUB_BUCKETS               (1 << COLAT_SUB_BITS)
+#define COLAT_MAX_EXPONENT              34
+#define COLAT_BUCKETS                   ((COLAT_MAX_EXPONENT - COLAT_SUB_BITS + 2) * COLAT_SUB_BUCKETS)
+
+enum TCoLatencyClass
+{
+    COLAT_CLASS_PDO_1 = 0,
+    COLAT_CLASS_PDO_2,
+    COLAT_CLASS_PDO_3,
+    COLAT_CLASS_PWB_PDO_1,
+    COLAT_CLASS_SDO_RESPONSE,
+    COLAT_CLASS_COUNT
+};
+
+enum TCoLatencyPoint
+{
+    COLAT_POINT_RX = 0,
+    COLAT_POINT_RING,
+    COLAT_POINT_DECODE,
+    COLAT_POINT_COMMIT,
+    COLAT_POINT_NOTIFY,
+    COLAT_POINT_COUNT
+};
+
+enum TCoLatencyStage
+{
+    COLAT_STAGE_RX_RING = 0,
+    COLAT_STAGE_RING_DECODE,
+    COLAT_STAGE_DECODE_COMMIT,
+    COLAT_STAGE_COMMIT_NOTIFY,
+    COLAT_STAGE_TOTAL,
+    COLAT_STAGE_COUNT
+};
+
+inline const char* CoLatencyClass2String(unsigned latencyClass)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (latencyClass)
+    {
+    case COLAT_CLASS_PDO_1:         retValue = "PDO_1"; break;
+    case COLAT_CLASS_PDO_2:         retValue = "PDO_2"; break;
+    case COLAT_CLASS_PDO_3:         retValue = "PDO_3"; break;
+    case COLAT_CLASS_PWB_PDO_1:     retValue = "PWB_PDO_1"; break;
+    case COLAT_CLASS_SDO_RESPONSE:  retValue = "SDO_RESPONSE"; break;
+    }
+
+    return retValue;
+}
+
+inline const char* CoLatencyStage2String(unsigned stage)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (stage)
+    {
+    case COLAT_STAGE_RX_RING:       retValue = "RX_RING"; break;
+    case COLAT_STAGE_RING_DECODE:   retValue = "RING_DECODE"; break;
+    case COLAT_STAGE_DECODE_COMMIT: retValue = "DECODE_COMMIT"; break;
+    case COLAT_STAGE_COMMIT_NOTIFY: retValue = "COMMIT_NOTIFY"; break;
+    case COLAT_STAGE_TOTAL:         retValue = "TOTAL"; break;
+    }
+
+    return retValue;
+}
+
+inline uint64_t CoLatencyNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned CoLatencyBucket(uint64_t ns)
+{
+    if (ns < COLAT_SUB_BUCKETS)
+    {
+        return (unsigned)ns;
+    }
+
+    unsigned exponent = 63u - (unsigned)__builtin_clzll(ns);
+
+    if (exponent > COLAT_MAX_EXPONENT)
+    {
+        return COLAT_BUCKETS - 1;
+    }
+
+    return (exponent - COLAT_SUB_BITS + 1) * COLAT_SUB_BUCKETS +
+           (unsigned)((ns >> (exponent - COLAT_SUB_BITS)) & (COLAT_SUB_BUCKETS - 1));
+}
+
+/// Lowest value of a bucket
+inline uint64_t CoLatencyBucketValue(unsigned bucket)
+{
+    if (bucket < COLAT_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned exponent = bucket / COLAT_SUB_BUCKETS + COLAT_SUB_BITS - 1;
+
+    return (uint64_t)(COLAT_SUB_BUCKETS + bucket % COLAT_SUB_BUCKETS) << (exponent - COLAT_SUB_BITS);
+}
+
+typedef struct
+{
+    uint64_t    count;
+    uint64_t    p50;        // ns
+    uint64_t    p99;        // ns
+    uint64_t    p999;       // ns
+    uint64_t    max;        // ns
+}TCoLatencySummary;
+
+/// Histograms of one thread, written by that thread only
+struct TCoLatencyHistograms
+{
+    std::atomic<uint64_t>   buckets[COLAT_CLASS_COUNT][COLAT_STAGE_COUNT][COLAT_BUCKETS];
+    std::atomic<uint64_t>   max[COLAT_CLASS_COUNT][COLAT_STAGE_COUNT];
+
+    void Add(unsigned latencyClass, unsigned stage, uint64_t ns)
+    {
+        std::atomic<uint64_t>& bucket = buckets[latencyClass][stage][CoLatencyBucket(ns)];
+
+        // Single writer: a plain increment, the atomics only keep the readers defined
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        if (ns > max[latencyClass][stage].load(std::memory_order_relaxed))
+        {
+            max[latencyClass][stage].store(ns, std::memory_order_relaxed);
+        }
+    }
+};
+
+class CCoLatency
+{
+public:
+    static void Record(unsigned latencyClass, unsigned stage, uint64_t ns)
+    {
+        static thread_local TThread t_thread;
+
+        if (!t_thread.histograms)
+        {
+            t_thread.histograms = Instance().Register();
+        }
+
+        t_thread.histograms->Add(latencyClass, stage, ns);
+    }
+
+    /// Merges the histograms of all threads
+    static TCoLatencySummary Summary(unsigned latencyClass, unsigned stage)
+    {
+        std::vector<uint64_t> merged(COLAT_BUCKETS, 0);
+        TCoLatencySummary     summary;
+        CCoLatency&           instance = Instance();
+
+        memset(&summary, 0, sizeof(summary));
+
+        std::lock_guard<std::mutex> lock(instance.m_mutex);
+
+        for (size_t t = 0; t <= instance.m_threads.size(); t++)
+        {
+            const TCoLatencyHistograms& histograms = (t < instance.m_threads.size()) ? *instance.m_threads[t] : instance.m_exited;
+            uint64_t                    max        = histograms.max[latencyClass][stage].load(std::memory_order_relaxed);
+
+            for (unsigned b = 0; b < COLAT_BUCKETS; b++)
+            {
+                merged[b] += histograms.buckets[latencyClass][stage][b].load(std::memory_order_relaxed);
+            }
+
+            summary.max = (max > summary.max) ? max : summary.max;
+        }
+
+        for (unsigned b = 0; b < COLAT_BUCKETS; b++)
+        {
+            summary.count += merged[b];
+        }
+
+        summary.p50  = Percentile(merged, summary.count, 0.5);
+        summary.p99  = Percentile(merged, summary.count, 0.99);
+        summary.p999 = Percentile(merged, summary.count, 0.999);
+
+        return summary;
+    }
+
+    /// Clears all histograms, only while no thread records
+    static void Reset()
+    {
+        CCoLatency&                 instance = Instance();
+        std::lock_guard<std::mutex> lock(instance.m_mutex);
+
+        for (size_t t = 0; t < instance.m_threads.size(); t++)
+        {
+            Clear(*instance.m_threads[t]);
+        }
+
+        Clear(instance.m_exited);
+    }
+
+private:
+    /// Returns the histograms of a thread when it exits
+    struct TThread
+    {
+        TThread() : histograms(0) {}
+
+        ~TThread()
+        {
+            if (histograms)
+            {
+                Instance().Unregister(histograms);
+            }
+        }
+
+        TCoLatencyHistograms*   histograms;
+    };
+
+    CCoLatency()
+    {
+        Clear(m_exited);
+    }
+
+    static CCoLatency& Instance()
+    {
+        static CCoLatency s_instance;
+
+        return s_instance;
+    }
+
+    /// Takes a block of an exited thread when there is one
+    TCoLatencyHistograms* Register()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_free.empty())
+        {
+            m_threads.push_back(std::unique_ptr<TCoLatencyHistograms>(new TCoLatencyHistograms));
+        }
+        else
+        {
+            m_threads.push_back(std::move(m_free.back()));
+            m_free.pop_back();
+        }
+
+        Clear(*m_threads.back());
+
+        return m_threads.back().get();
+    }
+
+    /// Keeps the samples of an exiting thread in the summary and frees its block
+    void Unregister(TCoLatencyHistograms* histograms)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (unsigned c = 0; c < COLAT_CLASS_COUNT; c++)
+        {
+            for (unsigned s = 0; s < COLAT_STAGE_COUNT; s++)
+            {
+                for (unsigned b = 0; b < COLAT_BUCKETS; b++)
+                {
+                    m_exited.buckets[c][s][b].fetch_add(histograms->buckets[c][s][b].load(std::memory_order_relaxed),
+                                                        std::memory_order_relaxed);
+                }
+
+                if (histograms->max[c][s].load(std::memory_order_relaxed) > m_exited.max[c][s].load(std::memory_order_relaxed))
+                {
+                    m_exited.max[c][s].store(histograms->max[c][s].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+            }
+        }
+
+        for (size_t t = 0; t < m_threads.size(); t++)
+        {
+            if (m_threads[t].get() == histograms)
+            {
+                m_free.push_back(std::move(m_threads[t]));
+                m_threads[t] = std::move(m_threads.back());
+                m_threads.pop_back();
+                break;
+            }
+        }
+    }
+
+    static void Clear(TCoLatencyHistograms& histograms)
+    {
+        for (unsigned c = 0; c < COLAT_CLASS_COUNT; c++)
+        {
+            for (unsigned s = 0; s < COLAT_STAGE_COUNT; s++)
+            {
+                for (unsigned b = 0; b < COLAT_BUCKETS; b++)
+                {
+                    histograms.buckets[c][s][b].store(0, std::memory_order_relaxed);
+                }
+
+                histograms.max[c][s].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Middle of the bucket that holds the given fraction of the samples
+    static uint64_t Percentile(const std::vector<uint64_t>& merged, uint64_t count, double fraction)
+    {
+        uint64_t rank = (uint64_t)((double)count * fraction);
+        uint64_t seen = 0;
+
+        for (unsigned b = 0; count && (b < COLAT_BUCKETS); b++)
+        {
+            seen += merged[b];
+
+            if (seen > rank)
+            {
+                uint64_t low  = CoLatencyBucketValue(b);
+                uint64_t high = (b + 1 < COLAT_BUCKETS) ? CoLatencyBucketValue(b + 1) : low;
+
+                return low + (high - low) / 2;
+            }
+        }
+
+        return 0;
+    }
+
+    std::mutex                                          m_mutex;
+    std::vector<std::unique_ptr<TCoLatencyHistograms>>  m_threads;     // running threads
+    std::vector<std::unique_ptr<TCoLatencyHistograms>>  m_free;
+    TCoLatencyHistograms                                m_exited;      // sum of the exited threads
+};
+
+#if COPM_LATENCY_ENABLED
+
+typedef struct
+{
+    uint64_t    ns[COLAT_POINT_COUNT];
+}TCoLatencyStamps;
+
+/// Records the passing of a point
+#define COPM_LATENCY_MARK(stamps, point)        ((stamps).ns[(point)] = CoLatencyNowNs())
+
+/// Records the stages between the marked points and the total
+#define COPM_LATENCY_COMMIT(stamps, latencyClass)                                                   \
+    do                                                                                              \
+    {                                                                                               \
+        for (unsigned stage_ = 0; stage_ < COLAT_POINT_COUNT - 1; stage_++)                         \
+        {                                                                                           \
+            CCoLatency::Record((latencyClass), stage_, (stamps).ns[stage_ + 1] - (stamps).ns[stage_]); \
+        }                                                                                           \
+        CCoLatency::Record((latencyClass), COLAT_STAGE_TOTAL,                                       \
+                           (stamps).ns[COLAT_POINT_NOTIFY] - (stamps).ns[COLAT_POINT_RX]);          \
+    } while (0)
+
+#else
+
+typedef struct
+{
+}TCoLatencyStamps;
+
+#define COPM_LATENCY_MARK(stamps, point)            ((void)0)
+#define COPM_LATENCY_COMMIT(stamps, latencyClass)   ((void)0)
+
+#endif
+
+#endif // __INTERFACE_COLATENCY_H__
@@ -0,0 +1,257 @@
+#ifndef __INTERFACE_COLIVENESS_H__
+#define __INTERFACE_COLIVENESS_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoSdo.h"
+#include "CoBridgeState.h"
+#include "CoTimerWheel.h"
+
+/// # Node liveness
+///
+/// Detects power modules and PowerBridges that stop sending PDO_1. Every node sends
+/// its PDO_1 at least once per event timer of TPDO1 (1800[5], ms), so a node is lost
+/// when no PDO_1 arrived within the event timer plus a margin for the jitter of the
+/// bus (default half an event timer). A lost node is therefore reported less than one
+/// event timer after the first PDO_1 that did not arrive.
+///
+/// Every node has a deadline in a CCoTimerWheel: OnPdo1() moves it (O(1)), Poll()
+/// only visits the deadlines that expired. The wheel starts at the *nowMs* given to
+/// the constructor, in the time base of all later calls. The event timer is read from
+/// the node when it is not given to Add(); a node that does not answer uses
+/// COLIVE_DEFAULT_EVENT_TIMER_MS. A node with event timer 0 only sends on change and
+/// is not monitored.
+///
+/// The events carry PWB_FAULT_COMMUNICATION_LOST, the normalized fault of
+/// bfCommunicationLost in TPwbStateInfy, so the loss of a node can be handled like a
+/// communication fault that a PowerBridge reports for one of its modules.
+
+#define COPM_SDO_TPDO1_COMMUNICATION            0x1800
+#define COPM_SDO_TPDO_EVENT_TIMER_SUB           5
+#define COLIVE_DEFAULT_EVENT_TIMER_MS           1000
+#define COLIVE_DEFAULT_MARGIN_PERCENT           50
+
+class ICoLivenessSink
+{
+public:
+    virtual ~ICoLivenessSink() {}
+
+    /// No PDO_1 for *silentMs*, *fault* is PWB_FAULT_COMMUNICATION_LOST
+    virtual void OnCommunicationLost(uint8_t node, uint32_t fault, uint64_t silentMs) = 0;
+
+    /// PDO_1 received again after *lostMs*
+    virtual void OnCommunicationRestored(uint8_t node, uint64_t lostMs) = 0;
+};
+
+typedef struct
+{
+    uint64_t    pdos;
+    uint64_t    lost;
+    uint64_t    restored;
+}TCoLivenessStatistics;
+
+class CCoLiveness
+{
+public:
+    CCoLiveness(ICoSdoClient& client, ICoLivenessSink& sink, uint64_t nowMs)
+        : m_client(client)
+        , m_sink(sink)
+        , m_marginPercent(COLIVE_DEFAULT_MARGIN_PERCENT)
+        , m_lostCount(0)
+        , m_readsPending(0)
+        , m_wheel(nowMs)
+    {
+        memset(&m_statistics, 0, sizeof(m_statistics));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_nodes[node].owner = this;
+            m_nodes[node].node  = (uint8_t)node;
+        }
+    }
+
+    /// Jitter margin in percent of the event timer
+    void SetMargin(unsigned percent) { m_marginPercent = percent; }
+
+    /// Starts monitoring a node, *eventTimerMs* 0 reads 1800[5] from the node
+    void Add(uint8_t node, uint64_t nowMs, uint16_t eventTimerMs = 0)
+    {
+        TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        Remove(node);
+        n.used        = true;
+        n.lastPdoMs   = nowMs;
+        n.eventTimer  = eventTimerMs;
+        n.onChange    = false;
+        n.readPending = !eventTimerMs && !m_client.SdoRead(n.node, COPM_SDO_TPDO1_COMMUNICATION,
+                                                           COPM_SDO_TPDO_EVENT_TIMER_SUB);
+        m_readsPending += n.readPending ? 1 : 0;
+
+        // Until the event timer is known the default applies
+        Arm(n, eventTimerMs ? eventTimerMs : COLIVE_DEFAULT_EVENT_TIMER_MS);
+    }
+
+    void Remove(uint8_t node)
+    {
+        TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        m_wheel.Cancel(n);
+        m_lostCount    -= n.lost ? 1 : 0;
+        m_readsPending -= n.readPending ? 1 : 0;
+        n.used        = false;
+        n.lost        = false;
+        n.readPending = false;
+    }
+
+    /// Call for every PDO_1 of a module or bridge
+    void OnPdo1(uint8_t node, uint64_t nowMs)
+    {
+        TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!n.used)
+        {
+            return;
+        }
+
+        m_statistics.pdos++;
+
+        if (n.lost)
+        {
+            n.lost = false;
+            m_lostCount--;
+            m_statistics.restored++;
+            m_sink.OnCommunicationRestored(n.node, nowMs - n.lostMs);
+        }
+
+        n.lastPdoMs = nowMs;
+
+        if (!n.onChange)
+        {
+            Arm(n, n.eventTimer ? n.eventTimer : COLIVE_DEFAULT_EVENT_TIMER_MS);
+        }
+    }
+
+    /// Answer to the read of 1800[5]
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if ((index != COPM_SDO_TPDO1_COMMUNICATION) || (subIndex != COPM_SDO_TPDO_EVENT_TIMER_SUB) ||
+            (size < 2) || !n.used)
+        {
+            return false;
+        }
+
+        n.eventTimer = CoGetLe16(data);
+        n.onChange   = !n.eventTimer;
+
+        if (n.onChange)
+        {
+            // Sent on change only, there is no deadline
+            m_wheel.Cancel(n);
+            return true;
+        }
+
+        if (!n.lost)
+        {
+            Arm(n, n.eventTimer);
+        }
+
+        return true;
+    }
+
+    /// The node keeps the default event timer
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        return (index == COPM_SDO_TPDO1_COMMUNICATION) && (subIndex == COPM_SDO_TPDO_EVENT_TIMER_SUB) &&
+               m_nodes[node & COPM_MAX_NODE_ID].used;
+    }
+
+    /// Reports the nodes whose deadline passed and repeats refused reads, returns the
+    /// number of expired deadlines
+    unsigned Poll(uint64_t nowMs)
+    {
+        for (unsigned node = 0; m_readsPending && (node <= COPM_MAX_NODE_ID); node++)
+        {
+            TNode& n = m_nodes[node];
+
+            if (n.readPending)
+            {
+                n.readPending   = !m_client.SdoRead(n.node, COPM_SDO_TPDO1_COMMUNICATION, COPM_SDO_TPDO_EVENT_TIMER_SUB);
+                m_readsPending -= n.readPending ? 0 : 1;
+            }
+        }
+
+        return m_wheel.Advance(nowMs);
+    }
+
+    bool Lost(uint8_t node) const { return m_nodes[node & COPM_MAX_NODE_ID].lost; }
+
+    /// PWB_FAULT_COMMUNICATION_LOST while the node is lost, else 0
+    uint32_t Faults(uint8_t node) const { return Lost(node) ? (uint32_t)PWB_FAULT_COMMUNICATION_LOST : 0; }
+
+    unsigned LostCount() const { return m_lostCount; }
+
+    uint16_t EventTimer(uint8_t node) const { return m_nodes[node & COPM_MAX_NODE_ID].eventTimer; }
+
+    const TCoLivenessStatistics& Statistics() const { return m_statistics; }
+
+private:
+    class TNode : public CCoTimer
+    {
+    public:
+        TNode()
+            : owner(0)
+            , lastPdoMs(0)
+            , lostMs(0)
+            , eventTimer(0)
+            , node(0)
+            , used(false)
+            , lost(false)
+            , onChange(false)
+            , readPending(false)
+        {
+        }
+
+        virtual void OnTimer(uint64_t nowMs, uint64_t)
+        {
+            owner->OnExpired(*this, nowMs);
+        }
+
+        CCoLiveness*    owner;
+        uint64_t        lastPdoMs;
+        uint64_t        lostMs;
+        uint16_t        eventTimer;     // 0 when not known yet
+        uint8_t         node;
+        bool            used;
+        bool            lost;
+        bool            onChange;       // event timer 0, not monitored
+        bool            readPending;    // read of 1800[5] was refused
+    };
+
+    void Arm(TNode& n, uint16_t eventTimerMs)
+    {
+        m_wheel.Schedule(n, n.lastPdoMs + eventTimerMs + (uint64_t)eventTimerMs * m_marginPercent / 100);
+    }
+
+    void OnExpired(TNode& n, uint64_t nowMs)
+    {
+        n.lost   = true;
+        n.lostMs = nowMs;
+        m_lostCount++;
+        m_statistics.lost++;
+        m_sink.OnCommunicationLost(n.node, PWB_FAULT_COMMUNICATION_LOST, nowMs - n.lastPdoMs);
+    }
+
+    ICoSdoClient&           m_client;
+    ICoLivenessSink&        m_sink;
+    unsigned                m_marginPercent;
+    unsigned                m_lostCount;
+    unsigned                m_readsPending;
+    TNode                   m_nodes[COPM_MAX_NODE_ID + 1];
+    CCoTimerWheel           m_wheel;            // after the timers, destroyed first
+    TCoLivenessStatistics   m_statistics;
+};
+
+#endif // __INTERFACE_COLIVENESS_H__
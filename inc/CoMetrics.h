@@ -0,0 +1,401 @@
+#ifndef __INTERFACE_COMETRICS_H__
+#define __INTERFACE_COMETRICS_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+#include "CoSeqLock.h"
+
+/// # Metrics page
+///
+/// Publishes the library counters, the liveness of every node and the last device
+/// statistics read from PM_SDO_CAN_STATISTICS (2131), PM_SDO_I2C_STATISTICS (2132) and
+/// PM_SDO_SYSTEM_STATISTICS (2135) in a POSIX shared memory object. One process writes
+/// (CCoMetricsWriter), any number of scrapers map the object read-only
+/// (CCoMetricsReader). Every section has its own sequence lock, so a reader never
+/// blocks the writer and gets a consistent copy of a section without a system call.
+///
+/// | Section                          | Contents                                   |
+/// |----------------------------------|--------------------------------------------|
+/// | TCoMetricsHeader                 | magic, layout version and size, writer pid |
+/// | CCoSeqLock<TCoMetricsLibrary>    | library counters                           |
+/// | CCoSeqLock<TCoMetricsNode> [128] | per node liveness and device statistics    |
+///
+/// The device statistics are stored as read, sub-index n in element n - 1. A reader
+/// must check the magic, COMETRICS_VERSION and the size before using the page; the
+/// generation changes every time a writer (re)creates the page. A writer that dies
+/// inside an update leaves its section locked: the reads give up after
+/// COMETRICS_READ_RETRIES copies, and WriterAlive() tells whether the writer is gone.
+
+#define COMETRICS_DEFAULT_NAME          "/copm_metrics"
+#define COMETRICS_MAGIC                 0x4d4d5043  // "CPMM"
+#define COMETRICS_VERSION               1
+#define COMETRICS_READ_RETRIES          1000
+
+#define COMETRICS_CAN_COUNTERS          13  // 2131[1..13]
+#define COMETRICS_I2C_COUNTERS          12  // 2132[1..12]
+#define COMETRICS_SYSTEM_COUNTERS       6   // 2135[1..6]
+
+enum TCoMetricsLiveness
+{
+    COMETRICS_NODE_UNKNOWN = 0,
+    COMETRICS_NODE_ALIVE,
+    COMETRICS_NODE_LOST,
+};
+
+typedef struct
+{
+    uint32_t    magic;          // COMETRICS_MAGIC
+    uint16_t    version;        // COMETRICS_VERSION
+    uint16_t    nodeCount;      // COPM_MAX_NODE_ID + 1
+    uint32_t    size;           // sizeof(TCoMetricsPage)
+    uint32_t    writerPid;
+    uint64_t    generation;     // creation time of the page [ns], CLOCK_REALTIME
+}TCoMetricsHeader;
+
+typedef struct
+{
+    uint64_t    framesReceived;
+    uint64_t    framesSent;
+    uint64_t    framesDropped;      // e.g. CCoTraceRecorder::Dropped()
+    uint64_t    sdoRequests;
+    uint64_t    sdoResponses;
+    uint64_t    sdoAborts;
+    uint64_t    sdoTimeouts;
+    uint64_t    pollCycles;
+    uint64_t    pollOverruns;
+    uint64_t    nodesAlive;
+    uint64_t    nodesLost;
+    uint64_t    updatedMs;
+}TCoMetricsLibrary;
+
+typedef struct
+{
+    uint8_t     liveness;       // TCoMetricsLiveness
+    uint8_t     reserved[3];
+    uint32_t    serial;         // PM_SDO_ASM_SERIAL
+    uint64_t    lastSeenMs;
+    uint64_t    canUpdatedMs;
+    uint64_t    i2cUpdatedMs;
+    uint64_t    systemUpdatedMs;
+    uint32_t    can[COMETRICS_CAN_COUNTERS];
+    uint32_t    i2c[COMETRICS_I2C_COUNTERS];
+    uint32_t    system[COMETRICS_SYSTEM_COUNTERS];
+}TCoMetricsNode;
+
+struct TCoMetricsPage
+{
+    TCoMetricsHeader                header;
+    CCoSeqLock<TCoMetricsLibrary>   library;
+    CCoSeqLock<TCoMetricsNode>      nodes[COPM_MAX_NODE_ID + 1];
+};
+
+class CCoMetricsWriter
+{
+public:
+    CCoMetricsWriter()
+        : m_page(0)
+    {
+    }
+
+    ~CCoMetricsWriter()
+    {
+        Close();
+    }
+
+    /// Creates or replaces the shared memory object *name*; *generation* 0 stamps the
+    /// page with the current time
+    bool Open(const char* name = COMETRICS_DEFAULT_NAME, uint64_t generation = 0)
+    {
+        Close();
+
+        if (!generation)
+        {
+            struct timespec now;
+
+            clock_gettime(CLOCK_REALTIME, &now);
+            generation = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+        }
+
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (ftruncate(fd, sizeof(TCoMetricsPage)) != 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void* base = mmap(0, sizeof(TCoMetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        close(fd);
+
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+
+        // The magic is written last, a reader ignores the page until it is complete
+        ((TCoMetricsPage*)base)->header.magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_page = new (base) TCoMetricsPage;
+        m_page->header.version    = COMETRICS_VERSION;
+        m_page->header.nodeCount  = COPM_MAX_NODE_ID + 1;
+        m_page->header.size       = sizeof(TCoMetricsPage);
+        m_page->header.writerPid  = (uint32_t)getpid();
+        m_page->header.generation = generation;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_page->header.magic      = COMETRICS_MAGIC;
+
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_page)
+        {
+            munmap(m_page, sizeof(TCoMetricsPage));
+            m_page = 0;
+        }
+    }
+
+    bool IsOpen() const { return m_page != 0; }
+
+    /// Updates the library counters in place: fn(TCoMetricsLibrary&)
+    template <typename F>
+    void UpdateLibrary(F fn)
+    {
+        if (m_page)
+        {
+            fn(m_page->library.BeginWrite());
+            m_page->library.EndWrite();
+        }
+    }
+
+    /// Updates a node in place: fn(TCoMetricsNode&)
+    template <typename F>
+    void UpdateNode(uint8_t node, F fn)
+    {
+        if (m_page)
+        {
+            CCoSeqLock<TCoMetricsNode>& entry = m_page->nodes[node & COPM_MAX_NODE_ID];
+
+            fn(entry.BeginWrite());
+            entry.EndWrite();
+        }
+    }
+
+    void SetLiveness(uint8_t node, TCoMetricsLiveness liveness, uint64_t nowMs)
+    {
+        UpdateNode(node, [&](TCoMetricsNode& entry)
+        {
+            entry.liveness = (uint8_t)liveness;
+
+            if (liveness == COMETRICS_NODE_ALIVE)
+            {
+                entry.lastSeenMs = nowMs;
+            }
+        });
+    }
+
+    void SetSerial(uint8_t node, uint32_t serial)
+    {
+        UpdateNode(node, [&](TCoMetricsNode& entry) { entry.serial = serial; });
+    }
+
+    /// *sub* holds the values of sub-index 1..count
+    void SetCanStatistics(uint8_t node, const uint32_t* sub, unsigned count, uint64_t nowMs)
+    {
+        UpdateNode(node, [&](TCoMetricsNode& entry)
+        {
+            Copy(entry.can, COMETRICS_CAN_COUNTERS, sub, count);
+            entry.canUpdatedMs = nowMs;
+        });
+    }
+
+    void SetI2cStatistics(uint8_t node, const uint32_t* sub, unsigned count, uint64_t nowMs)
+    {
+        UpdateNode(node, [&](TCoMetricsNode& entry)
+        {
+            Copy(entry.i2c, COMETRICS_I2C_COUNTERS, sub, count);
+            entry.i2cUpdatedMs = nowMs;
+        });
+    }
+
+    void SetSystemStatistics(uint8_t node, const uint32_t* sub, unsigned count, uint64_t nowMs)
+    {
+        UpdateNode(node, [&](TCoMetricsNode& entry)
+        {
+            Copy(entry.system, COMETRICS_SYSTEM_COUNTERS, sub, count);
+            entry.systemUpdatedMs = nowMs;
+        });
+    }
+
+    /// Stores one sub-index of 2131, 2132 or 2135 as it arrives, e.g. from OnSdoResponse
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size, uint64_t nowMs)
+    {
+        if ((size < 4) || (subIndex == 0))
+        {
+            return false;
+        }
+
+        uint32_t value = CoGetLe32(data);
+        unsigned i     = subIndex - 1u;
+
+        switch (index)
+        {
+        case PM_SDO_CAN_STATISTICS:
+            if (i < COMETRICS_CAN_COUNTERS)
+            {
+                UpdateNode(node, [&](TCoMetricsNode& entry) { entry.can[i] = value; entry.canUpdatedMs = nowMs; });
+                return true;
+            }
+            break;
+
+        case PM_SDO_I2C_STATISTICS:
+            if (i < COMETRICS_I2C_COUNTERS)
+            {
+                UpdateNode(node, [&](TCoMetricsNode& entry) { entry.i2c[i] = value; entry.i2cUpdatedMs = nowMs; });
+                return true;
+            }
+            break;
+
+        case PM_SDO_SYSTEM_STATISTICS:
+            if (i < COMETRICS_SYSTEM_COUNTERS)
+            {
+                UpdateNode(node, [&](TCoMetricsNode& entry) { entry.system[i] = value; entry.systemUpdatedMs = nowMs; });
+                return true;
+            }
+            break;
+        }
+
+        return false;
+    }
+
+    static bool Remove(const char* name = COMETRICS_DEFAULT_NAME)
+    {
+        return shm_unlink(name) == 0;
+    }
+
+private:
+    static void Copy(uint32_t* counters, unsigned size, const uint32_t* sub, unsigned count)
+    {
+        for (unsigned i = 0; (i < size) && (i < count); i++)
+        {
+            counters[i] = sub[i];
+        }
+    }
+
+    TCoMetricsPage* m_page;
+};
+
+class CCoMetricsReader
+{
+public:
+    CCoMetricsReader()
+        : m_page(0)
+    {
+    }
+
+    ~CCoMetricsReader()
+    {
+        Close();
+    }
+
+    /// Fails when the page does not exist yet or has another layout
+    bool Open(const char* name = COMETRICS_DEFAULT_NAME)
+    {
+        Close();
+
+        int         fd = shm_open(name, O_RDONLY, 0);
+        struct stat st;
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(TCoMetricsPage)))
+        {
+            close(fd);
+            return false;
+        }
+
+        void* base = mmap(0, sizeof(TCoMetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+
+        close(fd);
+
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_page = (const TCoMetricsPage*)base;
+
+        if (!Valid())
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_page)
+        {
+            munmap((void*)m_page, sizeof(TCoMetricsPage));
+            m_page = 0;
+        }
+    }
+
+    /// False when the writer replaced the page with an incompatible one
+    bool Valid() const
+    {
+        return m_page && (m_page->header.magic == COMETRICS_MAGIC) && (m_page->header.version == COMETRICS_VERSION) &&
+               (m_page->header.size == sizeof(TCoMetricsPage)) && (m_page->header.nodeCount == COPM_MAX_NODE_ID + 1);
+    }
+
+    bool IsOpen() const { return m_page != 0; }
+
+    const TCoMetricsHeader* Header() const { return m_page ? &m_page->header : 0; }
+
+    /// False when the process that created the page no longer exists
+    bool WriterAlive() const
+    {
+        return m_page && ((kill((pid_t)m_page->header.writerPid, 0) == 0) || (errno == EPERM));
+    }
+
+    /// Fails when the page is not open or the section stays in an update, *sequence*
+    /// receives the sequence number of the copy
+    bool ReadLibrary(TCoMetricsLibrary& library, uint32_t* sequence = 0) const
+    {
+        return m_page && m_page->library.TryRead(library, COMETRICS_READ_RETRIES, sequence);
+    }
+
+    bool ReadNode(uint8_t node, TCoMetricsNode& entry, uint32_t* sequence = 0) const
+    {
+        return m_page && m_page->nodes[node & COPM_MAX_NODE_ID].TryRead(entry, COMETRICS_READ_RETRIES, sequence);
+    }
+
+private:
+    const TCoMetricsPage* m_page;
+};
+
+#endif // __INTERFACE_COMETRICS_H__
@@ -0,0 +1,278 @@
+#ifndef __INTERFACE_COPM_AC_METER_H__
+#define __INTERFACE_COPM_AC_METER_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # AC meter
+///
+/// Aggregates the AC side measurements of the power modules:
+///
+/// | Object                  | Values                            | Unit |
+/// |-------------------------|-----------------------------------|------|
+/// | PM_SDO_AC_VOLTAGE 2120  | phase A, B, C                     | 0.1V |
+/// | PM_SDO_AC_CURRENT 2121  | phase A, B, C                     | 0.1A |
+/// | PM_SDO_AC_ENERGY 2122   | charging, discharging             | Wh   |
+///
+/// Per module the apparent power per phase (V \* I) and the phase imbalance (largest
+/// deviation of a phase current from the average, relative to the average) are
+/// computed. The uint16 energy counters wrap at 65535 Wh and are extended to 64 bits
+/// with PmExtendCounter16().
+///
+/// The totals per bridge group and for the site are updated incrementally: every
+/// update of a module adds the difference to its group and to the site, so a rollup
+/// costs O(1) per sample and only the running state is stored.
+
+#define PM_AC_PHASES                    3
+#define PM_AC_MAX_GROUPS                16
+#define PM_AC_NO_GROUP                  0xff
+#define PM_AC_DEFAULT_MAX_ENERGY_STEP   16384   // Wh, larger steps are a counter reset
+
+/// A uint16 counter extended to 64 bits
+typedef struct
+{
+    uint64_t    total;
+    uint16_t    last;
+    bool        valid;
+}TPmCounter16;
+
+/// Adds a new reading of a wrapping uint16 counter, returns the increase. The first
+/// reading only sets the base. A step above *maxStep* can not be a wrap between two
+/// readings; the device restarted counting from 0, so the new reading is the increase.
+inline uint32_t PmExtendCounter16(TPmCounter16& counter, uint16_t raw, uint32_t maxStep = PM_AC_DEFAULT_MAX_ENERGY_STEP)
+{
+    uint32_t step = (uint16_t)(raw - counter.last);
+
+    if (!counter.valid)
+    {
+        step = 0;
+    }
+    else if (step > maxStep)
+    {
+        step = raw;
+    }
+
+    counter.total += step;
+    counter.last   = raw;
+    counter.valid  = true;
+
+    return step;
+}
+
+typedef struct
+{
+    uint16_t        voltage[PM_AC_PHASES];          // 0.1V
+    uint16_t        current[PM_AC_PHASES];          // 0.1A
+    uint32_t        apparentPower[PM_AC_PHASES];    // VA
+    uint32_t        apparentPowerTotal;             // VA
+    float           imbalance;                      // 0..2, 0 = balanced
+    TPmCounter16    charged;                        // Wh
+    TPmCounter16    discharged;                     // Wh
+}TPmAcModule;
+
+typedef struct
+{
+    uint64_t    apparentPower;      // VA
+    uint64_t    chargedWh;
+    uint64_t    dischargedWh;
+    uint16_t    modules;
+}TPmAcRollup;
+
+class CPmAcMeter
+{
+public:
+    CPmAcMeter()
+        : m_maxEnergyStep(PM_AC_DEFAULT_MAX_ENERGY_STEP)
+    {
+        memset(m_modules, 0, sizeof(m_modules));
+        memset(m_groups, 0, sizeof(m_groups));
+        memset(&m_site, 0, sizeof(m_site));
+        memset(m_groupOf, PM_AC_NO_GROUP, sizeof(m_groupOf));
+        memset(m_phases, PM_AC_PHASES, sizeof(m_phases));
+    }
+
+    void SetMaxEnergyStep(uint32_t wh) { m_maxEnergyStep = wh; }
+
+    /// Adds a module to a bridge group (0..PM_AC_MAX_GROUPS - 1) and to the site
+    bool Add(uint8_t node, uint8_t group = 0)
+    {
+        if ((node > COPM_MAX_NODE_ID) || (group >= PM_AC_MAX_GROUPS))
+        {
+            return false;
+        }
+
+        Remove(node);
+
+        m_groupOf[node] = group;
+        m_groups[group].modules++;
+        m_site.modules++;
+        Rollup(group, (int64_t)m_modules[node].apparentPowerTotal, 0, 0);
+
+        return true;
+    }
+
+    /// Removes a module, its energy stays in the totals
+    void Remove(uint8_t node)
+    {
+        uint8_t group = m_groupOf[node & COPM_MAX_NODE_ID];
+
+        if (group != PM_AC_NO_GROUP)
+        {
+            Rollup(group, -(int64_t)m_modules[node & COPM_MAX_NODE_ID].apparentPowerTotal, 0, 0);
+            m_groups[group].modules--;
+            m_site.modules--;
+            m_groupOf[node & COPM_MAX_NODE_ID] = PM_AC_NO_GROUP;
+        }
+    }
+
+    /// Number of phases of the grid connection (PM_SDO_NUMBER_OF_PHASES), 1 or 3
+    void SetPhases(uint8_t node, uint8_t phases)
+    {
+        m_phases[node & COPM_MAX_NODE_ID] = (phases >= 1) && (phases <= PM_AC_PHASES) ? phases : PM_AC_PHASES;
+    }
+
+    /// 2120[1..3]
+    void OnVoltage(uint8_t node, const uint16_t voltage[PM_AC_PHASES])
+    {
+        memcpy(m_modules[node & COPM_MAX_NODE_ID].voltage, voltage, sizeof(m_modules[0].voltage));
+        Update(node & COPM_MAX_NODE_ID);
+    }
+
+    /// 2121[1..3]
+    void OnCurrent(uint8_t node, const uint16_t current[PM_AC_PHASES])
+    {
+        memcpy(m_modules[node & COPM_MAX_NODE_ID].current, current, sizeof(m_modules[0].current));
+        Update(node & COPM_MAX_NODE_ID);
+    }
+
+    /// 2122[1..2]
+    void OnEnergy(uint8_t node, uint16_t charged, uint16_t discharged)
+    {
+        TPmAcModule& module = m_modules[node & COPM_MAX_NODE_ID];
+
+        AddEnergy(node & COPM_MAX_NODE_ID, PmExtendCounter16(module.charged, charged, m_maxEnergyStep),
+                  PmExtendCounter16(module.discharged, discharged, m_maxEnergyStep));
+    }
+
+    /// Passes one sub-index of 2120, 2121 or 2122 as it arrives
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        if ((node > COPM_MAX_NODE_ID) || (size < 2) || (subIndex < 1))
+        {
+            return false;
+        }
+
+        TPmAcModule& module = m_modules[node];
+        uint16_t     value  = CoGetLe16(data);
+        unsigned     i      = subIndex - 1u;
+
+        switch (index)
+        {
+        case PM_SDO_AC_VOLTAGE:
+        case PM_SDO_AC_CURRENT:
+            if (i < PM_AC_PHASES)
+            {
+                uint16_t phases[PM_AC_PHASES];
+
+                memcpy(phases, (index == PM_SDO_AC_VOLTAGE) ? module.voltage : module.current, sizeof(phases));
+                phases[i] = value;
+                (index == PM_SDO_AC_VOLTAGE) ? OnVoltage(node, phases) : OnCurrent(node, phases);
+                return true;
+            }
+            break;
+
+        case PM_SDO_AC_ENERGY:
+            // Only the counter that was read, the other one may not have a base yet
+            if (i == 0)
+            {
+                AddEnergy(node, PmExtendCounter16(module.charged, value, m_maxEnergyStep), 0);
+                return true;
+            }
+
+            if (i == 1)
+            {
+                AddEnergy(node, 0, PmExtendCounter16(module.discharged, value, m_maxEnergyStep));
+                return true;
+            }
+            break;
+        }
+
+        return false;
+    }
+
+    const TPmAcModule& Module(uint8_t node) const { return m_modules[node & COPM_MAX_NODE_ID]; }
+
+    const TPmAcRollup& Group(uint8_t group) const { return m_groups[group % PM_AC_MAX_GROUPS]; }
+
+    const TPmAcRollup& Site() const { return m_site; }
+
+private:
+    void Update(uint8_t node)
+    {
+        TPmAcModule& module = m_modules[node];
+        uint32_t     old    = module.apparentPowerTotal;
+        unsigned     phases = m_phases[node];
+        uint32_t     sum    = 0;
+        uint32_t     total  = 0;
+
+        for (unsigned p = 0; p < PM_AC_PHASES; p++)
+        {
+            // 0.1V * 0.1A = 0.01VA
+            module.apparentPower[p] = (p < phases) ? ((uint32_t)module.voltage[p] * module.current[p] + 50) / 100 : 0;
+            total += module.apparentPower[p];
+            sum   += (p < phases) ? module.current[p] : 0;
+        }
+
+        module.apparentPowerTotal = total;
+        module.imbalance          = 0.0f;
+
+        if ((phases > 1) && sum)
+        {
+            float average   = (float)sum / (float)phases;
+            float deviation = 0.0f;
+
+            for (unsigned p = 0; p < phases; p++)
+            {
+                deviation = fmaxf(deviation, fabsf((float)module.current[p] - average));
+            }
+
+            module.imbalance = deviation / average;
+        }
+
+        if (m_groupOf[node] != PM_AC_NO_GROUP)
+        {
+            Rollup(m_groupOf[node], (int64_t)total - (int64_t)old, 0, 0);
+        }
+    }
+
+    void AddEnergy(uint8_t node, uint32_t charged, uint32_t discharged)
+    {
+        if (m_groupOf[node] != PM_AC_NO_GROUP)
+        {
+            Rollup(m_groupOf[node], 0, charged, discharged);
+        }
+    }
+
+    void Rollup(uint8_t group, int64_t apparentPower, uint32_t charged, uint32_t discharged)
+    {
+        m_groups[group].apparentPower = (uint64_t)((int64_t)m_groups[group].apparentPower + apparentPower);
+        m_groups[group].chargedWh    += charged;
+        m_groups[group].dischargedWh += discharged;
+        m_site.apparentPower          = (uint64_t)((int64_t)m_site.apparentPower + apparentPower);
+        m_site.chargedWh             += charged;
+        m_site.dischargedWh          += discharged;
+    }
+
+    uint32_t        m_maxEnergyStep;
+    TPmAcModule     m_modules[COPM_MAX_NODE_ID + 1];
+    uint8_t         m_groupOf[COPM_MAX_NODE_ID + 1];
+    uint8_t         m_phases[COPM_MAX_NODE_ID + 1];
+    TPmAcRollup     m_groups[PM_AC_MAX_GROUPS];
+    TPmAcRollup     m_site;
+};
+
+#endif // __INTERFACE_COPM_AC_METER_H__
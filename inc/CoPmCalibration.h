@@ -0,0 +1,129 @@
+#ifndef __INTERFACE_COPM_CALIBRATION_H__
+#define __INTERFACE_COPM_CALIBRATION_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "CoPm.h"
+
+/// # Calibration
+///
+/// Applies the calibration parameters of PM_SDO_CALIBRATION_PARM (215a) to raw output
+/// voltages (2107) and currents (2108), for example to recorded values:
+///
+///     y = clamp(((x * gain + 8192) >> 14) + offset, 0, 65535)
+///
+/// x and y are in 0.1 V or 0.1 A, gain is Q14 (16384 = 1.0) and offset is in 0.1 units.
+/// The product is computed in 32 bits without overflow, the shift rounds half up.
+/// The ICD does not specify the rounding of the firmware; PmCalibrate() is the
+/// reference and the SSE2 and AVX2 kernels give exactly the same result for every
+/// input.
+///
+/// | 215a | Field          | Unit      |
+/// |------|----------------|-----------|
+/// | 1    | voltageOffset  | 0.1V      |
+/// | 2    | voltageGain    | 1/16384   |
+/// | 3    | currentOffset  | 0.1A      |
+/// | 4    | currentGain    | 1/16384   |
+
+#define PM_CALIBRATION_ELEMENTS         4
+#define PM_CALIBRATION_GAIN_ONE         16384
+
+typedef struct
+{
+    int16_t     voltageOffset;  // 0.1V
+    uint16_t    voltageGain;    // Q14
+    int16_t     currentOffset;  // 0.1A
+    uint16_t    currentGain;    // Q14
+}TPmCalibration;
+
+/// Parses 215a[0..4], *sub* holds the sub-index values zero extended to 32 bits
+inline bool PmParseCalibration(const uint32_t* sub, unsigned count, TPmCalibration& calibration)
+{
+    if ((count < PM_CALIBRATION_ELEMENTS + 1) || (sub[0] < PM_CALIBRATION_ELEMENTS))
+    {
+        return false;
+    }
+
+    calibration.voltageOffset = (int16_t)(uint16_t)sub[1];
+    calibration.voltageGain   = (uint16_t)sub[2];
+    calibration.currentOffset = (int16_t)(uint16_t)sub[3];
+    calibration.currentGain   = (uint16_t)sub[4];
+
+    return true;
+}
+
+/// Reference implementation for one value
+inline uint16_t PmCalibrate(uint16_t raw, uint16_t gain, int16_t offset)
+{
+    int32_t value = (int32_t)(((uint32_t)raw * gain + 8192) >> 14) + offset;
+
+    return (uint16_t)((value < 0) ? 0 : (value > 0xffff) ? 0xffff : value);
+}
+
+/// Calibrates a column of values, *in* and *out* may be the same array
+inline void PmCalibrate(const uint16_t* in, uint16_t* out, size_t count, uint16_t gain, int16_t offset)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i g     = _mm256_set1_epi16((int16_t)gain);
+    const __m256i round = _mm256_set1_epi32(8192);
+    const __m256i off   = _mm256_set1_epi32(offset);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i x  = _mm256_loadu_si256((const __m256i*)&in[i]);
+        __m256i lo = _mm256_mullo_epi16(x, g);
+        __m256i hi = _mm256_mulhi_epu16(x, g);
+        __m256i p0 = _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round), 14), off);
+        __m256i p1 = _mm256_add_epi32(_mm256_srli_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round), 14), off);
+
+        // The unpack and the pack both work per 128 bit lane, so the order is kept
+        _mm256_storeu_si256((__m256i*)&out[i], _mm256_packus_epi32(p0, p1));
+    }
+#elif defined(__SSE2__)
+    const __m128i g     = _mm_set1_epi16((int16_t)gain);
+    const __m128i round = _mm_set1_epi32(8192);
+    const __m128i off   = _mm_set1_epi32(offset - 32768);
+    const __m128i bias  = _mm_set1_epi16((int16_t)0x8000);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i x  = _mm_loadu_si128((const __m128i*)&in[i]);
+        __m128i lo = _mm_mullo_epi16(x, g);
+        __m128i hi = _mm_mulhi_epu16(x, g);
+        __m128i p0 = _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 14), off);
+        __m128i p1 = _mm_add_epi32(_mm_srli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 14), off);
+
+        // SSE2 only has a signed saturating pack: saturate around -32768 and shift back
+        _mm_storeu_si128((__m128i*)&out[i], _mm_xor_si128(_mm_packs_epi32(p0, p1), bias));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = PmCalibrate(in[i], gain, offset);
+    }
+}
+
+/// Calibrates a column of output voltages (2107)
+inline void PmCalibrateVoltage(const TPmCalibration& calibration, const uint16_t* in, uint16_t* out, size_t count)
+{
+    PmCalibrate(in, out, count, calibration.voltageGain, calibration.voltageOffset);
+}
+
+/// Calibrates a column of output currents (2108)
+inline void PmCalibrateCurrent(const TPmCalibration& calibration, const uint16_t* in, uint16_t* out, size_t count)
+{
+    PmCalibrate(in, out, count, calibration.currentGain, calibration.currentOffset);
+}
+
+#endif // __INTERFACE_COPM_CALIBRATION_H__
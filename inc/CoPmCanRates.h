@@ -0,0 +1,232 @@
+#ifndef __INTERFACE_COPM_CAN_RATES_H__
+#define __INTERFACE_COPM_CAN_RATES_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # CAN statistics rates
+///
+/// Turns the cumulative uint32 counters of PM_SDO_CAN_STATISTICS (2131) of all nodes
+/// into per second rates. The samples of a poll cycle are staged per node with
+/// Stage(); Update() then processes the whole fleet in one pass. The state is kept
+/// per counter in arrays over the node id (structure of arrays) and the pass has no
+/// data dependent branches, so the compiler vectorizes it.
+///
+/// Deltas are computed modulo 2^32, so a counter that wraps gives the right rate.
+/// A node restarted when its reset count (2131[11]) changed or when the packets sent
+/// counter went back by more than half the range; the sample then only becomes the
+/// new baseline and PM_CAN_RATE_RESET is set for that cycle.
+///
+/// Rising detection, per rate of TX queue full, RX queue full, CAN errors and TX
+/// timeouts: a fast and a slow exponential average are kept; the rate is rising when
+/// the fast average exceeds *ratio* times the slow average plus *floor* (events/s).
+///
+/// | Counter                   | 2131 | Rate index                     |
+/// |---------------------------|------|--------------------------------|
+/// | Packets sent              | 1    | PM_CAN_RATE_SENT               |
+/// | Unicast packets received  | 2    | PM_CAN_RATE_UNICAST_RX         |
+/// | Broadcast packets received| 3    | PM_CAN_RATE_BROADCAST_RX       |
+/// | TX queue full             | 4    | PM_CAN_RATE_TX_QUEUE_FULL      |
+/// | RX queue full             | 5    | PM_CAN_RATE_RX_QUEUE_FULL      |
+/// | CAN errors                | 6    | PM_CAN_RATE_CAN_ERRORS         |
+/// | TX timeouts               | 8    | PM_CAN_RATE_TX_TIMEOUTS        |
+/// | PDO1 packets received     | 13   | PM_CAN_RATE_PDO1_RX            |
+
+#define PM_CAN_STATISTICS_ELEMENTS      13
+#define PM_CAN_STATISTICS_RESET_IDX     11
+#define PM_CAN_RATE_NODES               (COPM_MAX_NODE_ID + 1)
+#define PM_CAN_RATE_FAST_ALPHA          0.5f
+#define PM_CAN_RATE_SLOW_ALPHA          0.05f
+#define PM_CAN_RATE_DEFAULT_RATIO       2.0f
+#define PM_CAN_RATE_DEFAULT_FLOOR       0.1f    // events/s
+
+enum TPmCanRateIndex
+{
+    PM_CAN_RATE_SENT = 0,
+    PM_CAN_RATE_UNICAST_RX,
+    PM_CAN_RATE_BROADCAST_RX,
+    PM_CAN_RATE_TX_QUEUE_FULL,
+    PM_CAN_RATE_RX_QUEUE_FULL,
+    PM_CAN_RATE_CAN_ERRORS,
+    PM_CAN_RATE_TX_TIMEOUTS,
+    PM_CAN_RATE_PDO1_RX,
+    PM_CAN_RATE_COUNT
+};
+
+/// The first PM_CAN_RATE_WATCHED rates are watched for a rising trend
+#define PM_CAN_RATE_WATCHED_FIRST       PM_CAN_RATE_TX_QUEUE_FULL
+#define PM_CAN_RATE_WATCHED             4
+
+enum TPmCanRateFlags
+{
+    PM_CAN_RATE_TX_QUEUE_FULL_RISING    = 1 << 0,
+    PM_CAN_RATE_RX_QUEUE_FULL_RISING    = 1 << 1,
+    PM_CAN_RATE_CAN_ERRORS_RISING       = 1 << 2,
+    PM_CAN_RATE_TX_TIMEOUTS_RISING      = 1 << 3,
+    PM_CAN_RATE_RESET                   = 1 << 4,   // restarted, no rates this cycle
+    PM_CAN_RATE_VALID                   = 1 << 5,   // the rates are from this cycle
+};
+
+class CPmCanRates
+{
+public:
+    CPmCanRates()
+        : m_ratio(PM_CAN_RATE_DEFAULT_RATIO)
+        , m_floor(PM_CAN_RATE_DEFAULT_FLOOR)
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        memset(m_current, 0, sizeof(m_current));
+        memset(m_previous, 0, sizeof(m_previous));
+        memset(m_currentReset, 0, sizeof(m_currentReset));
+        memset(m_previousReset, 0, sizeof(m_previousReset));
+        memset(m_currentMs, 0, sizeof(m_currentMs));
+        memset(m_previousMs, 0, sizeof(m_previousMs));
+        memset(m_staged, 0, sizeof(m_staged));
+        memset(m_known, 0, sizeof(m_known));
+        memset(m_rate, 0, sizeof(m_rate));
+        memset(m_fast, 0, sizeof(m_fast));
+        memset(m_slow, 0, sizeof(m_slow));
+        memset(m_flags, 0, sizeof(m_flags));
+    }
+
+    void SetThreshold(float ratio, float floor)
+    {
+        m_ratio = ratio;
+        m_floor = floor;
+    }
+
+    /// Stages a sample, *sub* holds 2131[1..count]
+    bool Stage(uint8_t node, const uint32_t* sub, unsigned count, uint64_t nowMs)
+    {
+        static const uint8_t s_sub[PM_CAN_RATE_COUNT] = { 1, 2, 3, 4, 5, 6, 8, 13 };
+
+        if ((node > COPM_MAX_NODE_ID) || (count < PM_CAN_STATISTICS_ELEMENTS))
+        {
+            return false;
+        }
+
+        for (unsigned r = 0; r < PM_CAN_RATE_COUNT; r++)
+        {
+            m_current[r][node] = sub[s_sub[r] - 1];
+        }
+
+        m_currentReset[node] = sub[PM_CAN_STATISTICS_RESET_IDX - 1];
+        m_currentMs[node]    = nowMs;
+        m_staged[node]       = 1;
+
+        return true;
+    }
+
+    /// Computes the rates of all staged nodes in one pass
+    void Update()
+    {
+        uint8_t  use[PM_CAN_RATE_NODES];     // 1 when the rates of the node are computed
+        uint8_t  reset[PM_CAN_RATE_NODES];
+        float    perSecond[PM_CAN_RATE_NODES];
+
+        for (unsigned n = 0; n < PM_CAN_RATE_NODES; n++)
+        {
+            uint64_t dt      = m_currentMs[n] - m_previousMs[n];
+            uint8_t  restart = (uint8_t)((m_currentReset[n] != m_previousReset[n]) |
+                                         ((m_current[PM_CAN_RATE_SENT][n] - m_previous[PM_CAN_RATE_SENT][n]) > 0x80000000u));
+
+            reset[n]     = (uint8_t)(m_staged[n] & m_known[n] & restart);
+            use[n]       = (uint8_t)(m_staged[n] & m_known[n] & (uint8_t)!restart & (uint8_t)(dt != 0));
+            perSecond[n] = use[n] ? 1000.0f / (float)dt : 0.0f;
+        }
+
+        for (unsigned r = 0; r < PM_CAN_RATE_COUNT; r++)
+        {
+            uint32_t*       previous = m_previous[r];
+            const uint32_t* current  = m_current[r];
+            float*          rate     = m_rate[r];
+
+            for (unsigned n = 0; n < PM_CAN_RATE_NODES; n++)
+            {
+                float value = (float)(uint32_t)(current[n] - previous[n]) * perSecond[n];
+
+                rate[n]     = use[n] ? value : rate[n];
+                previous[n] = m_staged[n] ? current[n] : previous[n];
+            }
+        }
+
+        for (unsigned w = 0; w < PM_CAN_RATE_WATCHED; w++)
+        {
+            const float* rate = m_rate[PM_CAN_RATE_WATCHED_FIRST + w];
+            float*       fast = m_fast[w];
+            float*       slow = m_slow[w];
+
+            for (unsigned n = 0; n < PM_CAN_RATE_NODES; n++)
+            {
+                float f = fast[n] + PM_CAN_RATE_FAST_ALPHA * (rate[n] - fast[n]);
+                float s = slow[n] + PM_CAN_RATE_SLOW_ALPHA * (rate[n] - slow[n]);
+
+                fast[n] = use[n] ? f : fast[n];
+                slow[n] = use[n] ? s : slow[n];
+            }
+        }
+
+        for (unsigned n = 0; n < PM_CAN_RATE_NODES; n++)
+        {
+            uint8_t flags = 0;
+
+            for (unsigned w = 0; w < PM_CAN_RATE_WATCHED; w++)
+            {
+                flags |= (uint8_t)((m_fast[w][n] > m_ratio * m_slow[w][n] + m_floor) << w);
+            }
+
+            m_flags[n] = (uint8_t)(flags | (reset[n] ? PM_CAN_RATE_RESET : 0) | (use[n] ? PM_CAN_RATE_VALID : 0));
+
+            m_previousReset[n] = m_staged[n] ? m_currentReset[n] : m_previousReset[n];
+            m_previousMs[n]    = m_staged[n] ? m_currentMs[n] : m_previousMs[n];
+            m_known[n]        |= m_staged[n];
+            m_staged[n]        = 0;
+        }
+    }
+
+    /// Events per second of the last cycle with a valid sample
+    float Rate(uint8_t node, TPmCanRateIndex index) const
+    {
+        return m_rate[index][node & COPM_MAX_NODE_ID];
+    }
+
+    /// TPmCanRateFlags of the last Update()
+    uint8_t Flags(uint8_t node) const
+    {
+        return m_flags[node & COPM_MAX_NODE_ID];
+    }
+
+    bool Rising(uint8_t node) const
+    {
+        return (Flags(node) & (PM_CAN_RATE_TX_QUEUE_FULL_RISING | PM_CAN_RATE_RX_QUEUE_FULL_RISING |
+                               PM_CAN_RATE_CAN_ERRORS_RISING | PM_CAN_RATE_TX_TIMEOUTS_RISING)) != 0;
+    }
+
+    /// Rates of all nodes for one counter, indexed by node id
+    const float* Rates(TPmCanRateIndex index) const { return m_rate[index]; }
+
+private:
+    float       m_ratio;
+    float       m_floor;
+    uint32_t    m_current[PM_CAN_RATE_COUNT][PM_CAN_RATE_NODES];
+    uint32_t    m_previous[PM_CAN_RATE_COUNT][PM_CAN_RATE_NODES];
+    uint32_t    m_currentReset[PM_CAN_RATE_NODES];
+    uint32_t    m_previousReset[PM_CAN_RATE_NODES];
+    uint64_t    m_currentMs[PM_CAN_RATE_NODES];
+    uint64_t    m_previousMs[PM_CAN_RATE_NODES];
+    uint8_t     m_staged[PM_CAN_RATE_NODES];
+    uint8_t     m_known[PM_CAN_RATE_NODES];        // a previous sample exists
+    float       m_rate[PM_CAN_RATE_COUNT][PM_CAN_RATE_NODES];
+    float       m_fast[PM_CAN_RATE_WATCHED][PM_CAN_RATE_NODES];
+    float       m_slow[PM_CAN_RATE_WATCHED][PM_CAN_RATE_NODES];
+    uint8_t     m_flags[PM_CAN_RATE_NODES];
+};
+
+#endif // __INTERFACE_COPM_CAN_RATES_H__
@@ -0,0 +1,304 @@
+#ifndef __INTERFACE_COPM_CAPABILITIES_H__
+#define __INTERFACE_COPM_CAPABILITIES_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoSdo.h"
+
+/// # Capability cache
+///
+/// Parses PM_SDO_CAPABILITIES (2110) and PWB_SDO_CONFIG_PM_CAPABILITIES (2424) into
+/// one TPmCapabilities and keeps it per module serial (PM_SDO_ASM_SERIAL), so the
+/// objects only have to be read once per module.
+///
+/// | 2110[0] | Source             | Max power                       |
+/// |---------|--------------------|---------------------------------|
+/// | 6       | PM_CAPS_SOURCE_ACB | PM_CAPS_ACB_POWER_MAX (10 kW)   |
+/// | 7       | PM_CAPS_SOURCE_DCB | 2110[7]                         |
+///
+/// | 2424[0] | Source             | Remark                          |
+/// |---------|--------------------|---------------------------------|
+/// | 3       | PM_CAPS_SOURCE_PWB | only maxima, minima are 0       |
+///
+/// An entry is only invalidated when its node reports a rising PM_STATUS_RESET_DETECTED
+/// (2101 or the status of PM_PDO_STATUS, the bit has the same position) or when
+/// PM_SDO_CONVERTER_TYPE differs from the converter type stored with the entry.
+///
+/// The cache is saved as a flat binary file:
+///
+/// | Offset | Description                              | Size                       |
+/// |--------|------------------------------------------|----------------------------|
+/// | 0      | PM_CAPS_FILE_MAGIC                       | uint32                     |
+/// | 4      | PM_CAPS_FILE_VERSION                     | uint32                     |
+/// | 8      | Number of records                        | uint32                     |
+/// | 12     | Records                                  | TPmCapabilityRecord[]      |
+
+#define PM_CAPS_ACB_ELEMENTS            6
+#define PM_CAPS_DCB_ELEMENTS            7
+#define PM_CAPS_PWB_ELEMENTS            3
+#define PM_CAPS_ACB_POWER_MAX           100     // 0.1 kW
+#define PM_CAPS_FILE_MAGIC              0x41434d50  // "PMCA"
+#define PM_CAPS_FILE_VERSION            1
+
+enum TPmCapabilitySource
+{
+    PM_CAPS_SOURCE_NONE = 0,
+    PM_CAPS_SOURCE_ACB,
+    PM_CAPS_SOURCE_DCB,
+    PM_CAPS_SOURCE_PWB,
+};
+
+#pragma pack(1)
+
+typedef struct
+{
+    uint8_t     source;             // TPmCapabilitySource
+    uint8_t     version;            // 2110[1], 0 for 2424
+    uint16_t    acVoltageMin;       // 0.1V
+    uint16_t    acVoltageMax;       // 0.1V
+    uint16_t    acCurrentMin;       // 0.1A
+    uint16_t    acCurrentMax;       // 0.1A
+    uint16_t    dcVoltageMin;       // 0.1V
+    uint16_t    dcVoltageMax;       // 0.1V
+    uint16_t    dcCurrentMin;       // 0.1A
+    uint16_t    dcCurrentMax;       // 0.1A
+    int16_t     temperatureMin;     // 0.1 °C
+    int16_t     temperatureMax;     // 0.1 °C
+    uint16_t    powerMax;           // 0.1 kW
+}TPmCapabilities;
+
+typedef struct
+{
+    uint32_t        serial;
+    uint16_t        converterType;  // tConverterType
+    TPmCapabilities caps;
+}TPmCapabilityRecord;
+
+#pragma pack()
+
+/// Parses 2110[0..n], *sub* holds the sub-index values zero extended to 32 bits. The
+/// min/max pairs carry the minimum in the low word.
+inline bool PmParseCapabilities(const uint32_t* sub, unsigned count, TPmCapabilities& caps)
+{
+    if ((count < PM_CAPS_ACB_ELEMENTS + 1) ||
+        ((sub[PM_SDO_CAPABILITIES_NR_OF_ELEMENTS_IDX] != PM_CAPS_ACB_ELEMENTS) &&
+         (sub[PM_SDO_CAPABILITIES_NR_OF_ELEMENTS_IDX] != PM_CAPS_DCB_ELEMENTS)))
+    {
+        return false;
+    }
+
+    bool dcb = (sub[PM_SDO_CAPABILITIES_NR_OF_ELEMENTS_IDX] == PM_CAPS_DCB_ELEMENTS);
+
+    if (dcb && (count < PM_CAPS_DCB_ELEMENTS + 1))
+    {
+        return false;
+    }
+
+    caps.source         = dcb ? PM_CAPS_SOURCE_DCB : PM_CAPS_SOURCE_ACB;
+    caps.version        = (uint8_t)sub[PM_SDO_CAPABILITIES_VERSION_IDX];
+    caps.acVoltageMin   = (uint16_t)sub[PM_SDO_CAPABILITIES_AC_U_MIN_MAX_IDX];
+    caps.acVoltageMax   = (uint16_t)(sub[PM_SDO_CAPABILITIES_AC_U_MIN_MAX_IDX] >> 16);
+    caps.acCurrentMin   = (uint16_t)sub[PM_SDO_CAPABILITIES_AC_I_MIN_MAX_IDX];
+    caps.acCurrentMax   = (uint16_t)(sub[PM_SDO_CAPABILITIES_AC_I_MIN_MAX_IDX] >> 16);
+    caps.dcVoltageMin   = (uint16_t)sub[PM_SDO_CAPABILITIES_DC_U_MIN_MAX_IDX];
+    caps.dcVoltageMax   = (uint16_t)(sub[PM_SDO_CAPABILITIES_DC_U_MIN_MAX_IDX] >> 16);
+    caps.dcCurrentMin   = (uint16_t)sub[PM_SDO_CAPABILITIES_DC_I_MIN_MAX_IDX];
+    caps.dcCurrentMax   = (uint16_t)(sub[PM_SDO_CAPABILITIES_DC_I_MIN_MAX_IDX] >> 16);
+    caps.temperatureMin = (int16_t)(uint16_t)sub[PM_SDO_CAPABILITIES_TEMP_MIN_MAX_IDX];
+    caps.temperatureMax = (int16_t)(uint16_t)(sub[PM_SDO_CAPABILITIES_TEMP_MIN_MAX_IDX] >> 16);
+    caps.powerMax       = dcb ? (uint16_t)sub[PM_SDO_CAPABILITIES_POWER_MAX_IDX] : (uint16_t)PM_CAPS_ACB_POWER_MAX;
+
+    return true;
+}
+
+/// Parses 2424[0..3]
+inline bool PwbParseCapabilities(const uint32_t* sub, unsigned count, TPmCapabilities& caps)
+{
+    if ((count < PM_CAPS_PWB_ELEMENTS + 1) || (sub[PWB_SDO_CONFIG_PM_CAPABILITIES_IDX_NUMBER] < PM_CAPS_PWB_ELEMENTS))
+    {
+        return false;
+    }
+
+    memset(&caps, 0, sizeof(caps));
+    caps.source       = PM_CAPS_SOURCE_PWB;
+    caps.dcVoltageMax = (uint16_t)sub[PWB_SDO_CONFIG_PM_CAPABILITIES_IDX_VOLTAGE];
+    caps.dcCurrentMax = (uint16_t)sub[PWB_SDO_CONFIG_PM_CAPABILITIES_IDX_CURRENT];
+    caps.powerMax     = (uint16_t)sub[PWB_SDO_CONFIG_PM_CAPABILITIES_IDX_POWER];
+
+    return true;
+}
+
+class CPmCapabilityCache
+{
+public:
+    CPmCapabilityCache()
+    {
+        memset(m_nodes, 0, sizeof(m_nodes));
+    }
+
+    /// Associates a node with the serial of the module, e.g. after discovery
+    void Bind(uint8_t node, uint32_t serial)
+    {
+        TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        entry.serial = serial;
+        entry.bound  = true;
+    }
+
+    void Unbind(uint8_t node)
+    {
+        m_nodes[node & COPM_MAX_NODE_ID].bound = false;
+    }
+
+    /// Returns the cached capabilities of the module at node, 0 when they must be read
+    const TPmCapabilities* Find(uint8_t node) const
+    {
+        const TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!entry.bound)
+        {
+            return 0;
+        }
+
+        std::unordered_map<uint32_t, TPmCapabilityRecord>::const_iterator it = m_records.find(entry.serial);
+
+        return (it != m_records.end()) ? &it->second.caps : 0;
+    }
+
+    /// Stores the capabilities read from a bound node
+    bool Store(uint8_t node, const TPmCapabilities& caps, uint16_t converterType)
+    {
+        const TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!entry.bound)
+        {
+            return false;
+        }
+
+        TPmCapabilityRecord& record = m_records[entry.serial];
+
+        record.serial        = entry.serial;
+        record.converterType = converterType;
+        record.caps          = caps;
+
+        return true;
+    }
+
+    /// Passes 2101 or the status of PM_PDO_STATUS, returns true when the entry was invalidated
+    bool OnConverterStatus(uint8_t node, uint32_t status)
+    {
+        TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+        bool   reset = (status & PM_STATUS_RESET_DETECTED) != 0;
+        bool   edge  = reset && !entry.resetDetected;
+
+        entry.resetDetected = reset;
+
+        return edge && Invalidate(node);
+    }
+
+    /// Passes 2158, returns true when the entry was invalidated
+    bool OnConverterType(uint8_t node, uint16_t converterType)
+    {
+        const TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!entry.bound)
+        {
+            return false;
+        }
+
+        std::unordered_map<uint32_t, TPmCapabilityRecord>::const_iterator it = m_records.find(entry.serial);
+
+        return (it != m_records.end()) && (it->second.converterType != converterType) && Invalidate(node);
+    }
+
+    bool Invalidate(uint8_t node)
+    {
+        const TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        return entry.bound && (m_records.erase(entry.serial) != 0);
+    }
+
+    size_t Size() const { return m_records.size(); }
+
+    bool Save(const char* path) const
+    {
+        char  temp[512];
+        FILE* file;
+
+        snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+        if ((file = fopen(temp, "wb")) == 0)
+        {
+            return false;
+        }
+
+        uint32_t header[3] = { PM_CAPS_FILE_MAGIC, PM_CAPS_FILE_VERSION, (uint32_t)m_records.size() };
+        bool     ok        = fwrite(header, sizeof(header), 1, file) == 1;
+
+        for (std::unordered_map<uint32_t, TPmCapabilityRecord>::const_iterator it = m_records.begin();
+             ok && (it != m_records.end()); ++it)
+        {
+            ok = fwrite(&it->second, sizeof(it->second), 1, file) == 1;
+        }
+
+        ok = (fclose(file) == 0) && ok;
+
+        return ok && (rename(temp, path) == 0);
+    }
+
+    /// Replaces the cached records with the contents of a saved file
+    bool Load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+
+        if (!file)
+        {
+            return false;
+        }
+
+        // The record count of the header is bounded by the size of the file
+        long     size = ((fseek(file, 0, SEEK_END) == 0) && (ftell(file) > 0)) ? ftell(file) : 0;
+        uint32_t header[3];
+        bool     ok = (fseek(file, 0, SEEK_SET) == 0) && (fread(header, sizeof(header), 1, file) == 1) &&
+                      (header[0] == PM_CAPS_FILE_MAGIC) && (header[1] == PM_CAPS_FILE_VERSION) &&
+                      (header[2] <= ((unsigned long)size - sizeof(header)) / sizeof(TPmCapabilityRecord));
+
+        if (ok)
+        {
+            m_records.clear();
+            m_records.reserve(header[2]);
+
+            for (uint32_t i = 0; ok && (i < header[2]); i++)
+            {
+                TPmCapabilityRecord record;
+
+                if ((ok = (fread(&record, sizeof(record), 1, file) == 1)))
+                {
+                    m_records[record.serial] = record;
+                }
+            }
+        }
+
+        fclose(file);
+
+        return ok;
+    }
+
+private:
+    struct TNode
+    {
+        uint32_t    serial;
+        bool        bound;
+        bool        resetDetected;
+    };
+
+    TNode                                               m_nodes[COPM_MAX_NODE_ID + 1];
+    std::unordered_map<uint32_t, TPmCapabilityRecord>   m_records;
+};
+
+#endif // __INTERFACE_COPM_CAPABILITIES_H__
@@ -0,0 +1,596 @@
+#ifndef __INTERFACE_COPM_DISCOVERY_H__
+#define __INTERFACE_COPM_DISCOVERY_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoSdo.h"
+
+/// # Discovery
+///
+/// Finds the power modules and PowerBridges on the bus. All candidate node ids are
+/// probed at the same time, one read per node in flight (an SDO server handles one
+/// transfer at a time), so a cold scan takes one round of reads per probe object
+/// instead of one round per node and object:
+///
+/// | Kind | Probe reads                                                         |
+/// |------|---------------------------------------------------------------------|
+/// | PM   | 2156 CAN ID, 2158 converter type, 2153 serial, 210e[2], 2101 status |
+/// | PWB  | 2153 serial, 2410 power module address and group                    |
+///
+/// The nodes that were found are saved as a topology snapshot. When a snapshot was
+/// loaded, Start() first verifies it optimistically: only the serial of every known
+/// node is read, again all nodes at once. When every node answers with the expected
+/// serial the discovery is Ready() after one round trip. A verified node takes the
+/// other fields from the snapshot, its status is 0 (not read; PM_PDO_1 carries it).
+/// Nodes that do not match are probed again; the remaining candidates are probed in
+/// the background after the verification, unless disabled.
+///
+/// A node is marked duplicate when it reports PM_STATUS_CANID_ERROR while probed,
+/// when a read is answered twice with different data, or when its serial was already
+/// found on another node.
+
+#define PM_DISCOVERY_TIMEOUT_MS         250
+#define PM_DISCOVERY_FILE_MAGIC         0x53494450  // "PDIS"
+#define PM_DISCOVERY_FILE_VERSION       1
+
+enum TPmDiscoveryKind
+{
+    PM_DISCOVERY_KIND_NONE = 0,
+    PM_DISCOVERY_KIND_PM,
+    PM_DISCOVERY_KIND_PWB,
+};
+
+enum TPmDiscoveryState
+{
+    PM_DISCOVERY_IDLE = 0,
+    PM_DISCOVERY_VERIFYING,
+    PM_DISCOVERY_PROBING,
+    PM_DISCOVERY_FOUND,
+    PM_DISCOVERY_ABSENT,
+};
+
+#pragma pack(1)
+
+typedef struct
+{
+    uint8_t     node;
+    uint8_t     kind;           // TPmDiscoveryKind
+    uint8_t     canId;          // 2156
+    uint8_t     pmAddress;      // 2410, PWB only
+    uint8_t     pmGroup;        // 2410, PWB only
+    uint8_t     notDiscovered;  // 210e[2]
+    uint16_t    converterType;  // 2158
+    uint32_t    serial;         // 2153
+    uint32_t    status;         // 2101
+}TPmDiscoveryEntry;
+
+#pragma pack()
+
+class CPmDiscovery
+{
+public:
+    explicit CPmDiscovery(ICoSdoClient& client)
+        : m_client(client)
+        , m_timeoutMs(PM_DISCOVERY_TIMEOUT_MS)
+        , m_backgroundScan(true)
+        , m_running(false)
+        , m_verify(false)
+        , m_ready(false)
+    {
+        memset(m_nodes, 0, sizeof(m_nodes));
+    }
+
+    void AddCandidates(uint8_t first, uint8_t last, TPmDiscoveryKind kind)
+    {
+        for (unsigned node = first; (node <= last) && (node <= COPM_MAX_NODE_ID); node++)
+        {
+            m_nodes[node].candidate = (uint8_t)kind;
+        }
+    }
+
+    /// Time a node has to answer each read
+    void SetTimeout(uint32_t timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    /// Probe the candidates that are not in the snapshot after a successful verification
+    void SetBackgroundScan(bool enable) { m_backgroundScan = enable; }
+
+    /// Starts a scan, a warm start when a snapshot was loaded and *warm* is set
+    void Start(uint64_t nowMs, bool warm = true)
+    {
+        bool verify = false;
+
+        m_running = true;
+        m_ready   = false;
+
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            TNode& n = m_nodes[node];
+
+            n.state     = PM_DISCOVERY_IDLE;
+            n.duplicate = false;
+            n.pending   = 0;
+            n.outstanding = 0;
+            n.answered  = 0;
+
+            if (warm && n.cached)
+            {
+                Begin(node, PM_DISCOVERY_VERIFYING, nowMs);
+                verify = true;
+            }
+        }
+
+        m_verify = verify;
+
+        if (!verify)
+        {
+            ProbeRemaining(nowMs);
+        }
+
+        Pump(nowMs);
+        Check(nowMs);
+    }
+
+    /// True when every known node is verified or probed
+    bool Ready() const { return m_ready; }
+
+    /// True while reads are pending or outstanding, including the background scan
+    bool Running() const { return m_running; }
+
+    const TPmDiscoveryEntry* Find(uint8_t node) const
+    {
+        const TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        return (n.state == PM_DISCOVERY_FOUND) ? &n.entry : 0;
+    }
+
+    TPmDiscoveryState State(uint8_t node) const
+    {
+        return (TPmDiscoveryState)m_nodes[node & COPM_MAX_NODE_ID].state;
+    }
+
+    bool Duplicate(uint8_t node) const
+    {
+        return m_nodes[node & COPM_MAX_NODE_ID].duplicate;
+    }
+
+    /// Calls fn(const TPmDiscoveryEntry&) for every node that was found
+    template <typename F>
+    void ForEach(F fn) const
+    {
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (m_nodes[node].state == PM_DISCOVERY_FOUND)
+            {
+                fn(m_nodes[node].entry);
+            }
+        }
+    }
+
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size, uint64_t nowMs)
+    {
+        int read = Read(index, subIndex);
+
+        if ((read < 0) || (node > COPM_MAX_NODE_ID) || (size == 0))
+        {
+            return false;
+        }
+
+        TNode&   n     = m_nodes[node];
+        uint8_t  bit   = (uint8_t)(1u << read);
+        uint32_t value = Value(data, size);
+
+        if (!(n.outstanding & bit))
+        {
+            // A second answer to the same read means two nodes share the id
+            if ((n.answered & bit) && (Stored(n.entry, read) != value))
+            {
+                n.duplicate = true;
+            }
+
+            return (n.answered & bit) != 0;
+        }
+
+        Store(n.entry, read, data, value);
+        n.outstanding &= (uint8_t)~bit;
+        n.answered    |= bit;
+
+        if ((read == READ_STATUS) && (value & PM_STATUS_CANID_ERROR))
+        {
+            n.duplicate = true;
+        }
+
+        if (!n.pending && !n.outstanding)
+        {
+            Finish(node, nowMs);
+        }
+
+        Pump(nowMs);
+        Check(nowMs);
+
+        return true;
+    }
+
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex, uint64_t nowMs)
+    {
+        int read = Read(index, subIndex);
+
+        if ((read < 0) || (node > COPM_MAX_NODE_ID) || !(m_nodes[node].outstanding & (1u << read)))
+        {
+            return false;
+        }
+
+        // The node exists but does not implement the object
+        m_nodes[node].outstanding &= (uint8_t)~(1u << read);
+
+        if (!m_nodes[node].pending && !m_nodes[node].outstanding)
+        {
+            Finish(node, nowMs);
+        }
+
+        Pump(nowMs);
+        Check(nowMs);
+
+        return true;
+    }
+
+    /// Retries reads the stack could not queue and handles nodes that did not answer
+    void Poll(uint64_t nowMs)
+    {
+        for (unsigned node = 1; m_running && (node <= COPM_MAX_NODE_ID); node++)
+        {
+            TNode& n = m_nodes[node];
+
+            // Only a queued read times out; reads held back by the stack wait for Pump()
+            if (((n.state == PM_DISCOVERY_VERIFYING) || (n.state == PM_DISCOVERY_PROBING)) && n.outstanding &&
+                ((nowMs - n.startMs) >= m_timeoutMs))
+            {
+                n.pending     = 0;
+                n.outstanding = 0;
+                Finish(node, nowMs);
+            }
+        }
+
+        Pump(nowMs);
+        Check(nowMs);
+    }
+
+    bool Save(const char* path) const
+    {
+        char     temp[512];
+        FILE*    file;
+        uint32_t count = 0;
+
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            count += (m_nodes[node].state == PM_DISCOVERY_FOUND) ? 1 : 0;
+        }
+
+        snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+        if ((file = fopen(temp, "wb")) == 0)
+        {
+            return false;
+        }
+
+        uint32_t header[3] = { PM_DISCOVERY_FILE_MAGIC, PM_DISCOVERY_FILE_VERSION, count };
+        bool     ok        = fwrite(header, sizeof(header), 1, file) == 1;
+
+        for (unsigned node = 1; ok && (node <= COPM_MAX_NODE_ID); node++)
+        {
+            if (m_nodes[node].state == PM_DISCOVERY_FOUND)
+            {
+                ok = fwrite(&m_nodes[node].entry, sizeof(TPmDiscoveryEntry), 1, file) == 1;
+            }
+        }
+
+        ok = (fclose(file) == 0) && ok;
+
+        return ok && (rename(temp, path) == 0);
+    }
+
+    /// Replaces the snapshot; a file that can not be read completely changes nothing
+    bool Load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+
+        if (!file)
+        {
+            return false;
+        }
+
+        TPmDiscoveryEntry entries[COPM_MAX_NODE_ID + 1];
+        uint32_t          header[3];
+        bool              ok = (fread(header, sizeof(header), 1, file) == 1) &&
+                               (header[0] == PM_DISCOVERY_FILE_MAGIC) && (header[1] == PM_DISCOVERY_FILE_VERSION);
+
+        memset(entries, 0, sizeof(entries));
+
+        for (uint32_t i = 0; ok && (i < header[2]); i++)
+        {
+            TPmDiscoveryEntry entry;
+
+            if ((ok = (fread(&entry, sizeof(entry), 1, file) == 1)) && entry.node && (entry.node <= COPM_MAX_NODE_ID))
+            {
+                entries[entry.node] = entry;
+            }
+        }
+
+        fclose(file);
+
+        if (!ok)
+        {
+            return false;
+        }
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_nodes[node].cached   = entries[node].node != 0;
+            m_nodes[node].expected = entries[node];
+        }
+
+        return true;
+    }
+
+private:
+    enum
+    {
+        READ_CAN_ID = 0,
+        READ_CONVERTER_TYPE,
+        READ_SERIAL,
+        READ_NOT_DISCOVERED,
+        READ_STATUS,
+        READ_PM_ADDRESS,
+        READ_COUNT
+    };
+
+    struct TNode
+    {
+        uint8_t             candidate;      // TPmDiscoveryKind
+        uint8_t             state;          // TPmDiscoveryState
+        uint8_t             pending;        // reads to queue
+        uint8_t             outstanding;    // reads queued
+        uint8_t             answered;
+        bool                duplicate;
+        bool                cached;
+        uint64_t            startMs;        // last read queued
+        TPmDiscoveryEntry   entry;
+        TPmDiscoveryEntry   expected;       // from the snapshot
+    };
+
+    static int Read(uint16_t index, uint8_t subIndex)
+    {
+        switch (index)
+        {
+        case PM_SDO_CAN_ID:             return READ_CAN_ID;
+        case PM_SDO_CONVERTER_TYPE:     return READ_CONVERTER_TYPE;
+        case PM_SDO_ASM_SERIAL:         return READ_SERIAL;
+        case PM_SDO_CONV_STATUS:        return READ_STATUS;
+        case PWB_SDO_PM_ADDRESS:        return READ_PM_ADDRESS;
+        case PM_SDO_CONV_INHIBIT:
+            return (subIndex == PM_SDO_COMV_INHIBIT_NOT_DISCOVERED_IDX) ? (int)READ_NOT_DISCOVERED : -1;
+        }
+
+        return -1;
+    }
+
+    static void Object(int read, uint16_t& index, uint8_t& subIndex)
+    {
+        static const uint16_t s_index[READ_COUNT] = { PM_SDO_CAN_ID, PM_SDO_CONVERTER_TYPE, PM_SDO_ASM_SERIAL,
+                                                      PM_SDO_CONV_INHIBIT, PM_SDO_CONV_STATUS, PWB_SDO_PM_ADDRESS };
+
+        index    = s_index[read];
+        subIndex = (read == READ_NOT_DISCOVERED) ? PM_SDO_COMV_INHIBIT_NOT_DISCOVERED_IDX : 0;
+    }
+
+    static uint32_t Value(const uint8_t* data, unsigned size)
+    {
+        uint32_t value = 0;
+
+        for (unsigned i = 0; (i < size) && (i < 4); i++)
+        {
+            value |= (uint32_t)data[i] << (8 * i);
+        }
+
+        return value;
+    }
+
+    static uint32_t Stored(const TPmDiscoveryEntry& entry, int read)
+    {
+        switch (read)
+        {
+        case READ_CAN_ID:           return entry.canId;
+        case READ_CONVERTER_TYPE:   return entry.converterType;
+        case READ_SERIAL:           return entry.serial;
+        case READ_NOT_DISCOVERED:   return entry.notDiscovered;
+        case READ_STATUS:           return entry.status;
+        case READ_PM_ADDRESS:       return (uint32_t)entry.pmAddress | ((uint32_t)entry.pmGroup << 8);
+        }
+
+        return 0;
+    }
+
+    static void Store(TPmDiscoveryEntry& entry, int read, const uint8_t* data, uint32_t value)
+    {
+        switch (read)
+        {
+        case READ_CAN_ID:           entry.canId = (uint8_t)value; break;
+        case READ_CONVERTER_TYPE:   entry.converterType = (uint16_t)value; break;
+        case READ_SERIAL:           entry.serial = value; break;
+        case READ_NOT_DISCOVERED:   entry.notDiscovered = (uint8_t)value; break;
+        case READ_STATUS:           entry.status = value; break;
+        case READ_PM_ADDRESS:       entry.pmAddress = data[0]; entry.pmGroup = (uint8_t)(value >> 8); break;
+        }
+    }
+
+    static uint8_t ProbeReads(uint8_t kind)
+    {
+        if (kind == PM_DISCOVERY_KIND_PWB)
+        {
+            return (uint8_t)((1u << READ_SERIAL) | (1u << READ_PM_ADDRESS));
+        }
+
+        return (uint8_t)((1u << READ_CAN_ID) | (1u << READ_CONVERTER_TYPE) | (1u << READ_SERIAL) |
+                         (1u << READ_NOT_DISCOVERED) | (1u << READ_STATUS));
+    }
+
+    /// One read, so the verification takes one round trip
+    static uint8_t VerifyReads()
+    {
+        return (uint8_t)(1u << READ_SERIAL);
+    }
+
+    void Begin(unsigned node, TPmDiscoveryState state, uint64_t nowMs)
+    {
+        TNode&  n    = m_nodes[node];
+        uint8_t kind = (state == PM_DISCOVERY_VERIFYING) ? n.expected.kind : n.candidate;
+
+        if (kind == PM_DISCOVERY_KIND_NONE)
+        {
+            n.state = PM_DISCOVERY_ABSENT;
+            return;
+        }
+
+        memset(&n.entry, 0, sizeof(n.entry));
+        n.entry.node  = (uint8_t)node;
+        n.entry.kind  = kind;
+        n.state       = (uint8_t)state;
+        n.startMs     = nowMs;
+        n.pending     = (state == PM_DISCOVERY_VERIFYING) ? VerifyReads() : ProbeReads(kind);
+        n.outstanding = 0;
+        n.answered    = 0;
+    }
+
+    void Finish(unsigned node, uint64_t nowMs)
+    {
+        TNode& n = m_nodes[node];
+
+        if (n.state == PM_DISCOVERY_VERIFYING)
+        {
+            if ((n.answered & (1u << READ_SERIAL)) && (n.entry.serial == n.expected.serial))
+            {
+                // Optimistic: the remaining fields are taken over from the snapshot
+                n.entry        = n.expected;
+                n.entry.status = 0;
+                n.state        = PM_DISCOVERY_FOUND;
+            }
+            else
+            {
+                Begin(node, PM_DISCOVERY_PROBING, nowMs);
+                return;
+            }
+        }
+        else
+        {
+            n.state = (n.answered & (1u << READ_SERIAL)) ? PM_DISCOVERY_FOUND : PM_DISCOVERY_ABSENT;
+        }
+
+        if (n.state == PM_DISCOVERY_FOUND)
+        {
+            for (unsigned other = 1; other <= COPM_MAX_NODE_ID; other++)
+            {
+                if ((other != node) && (m_nodes[other].state == PM_DISCOVERY_FOUND) &&
+                    (m_nodes[other].entry.serial == n.entry.serial))
+                {
+                    n.duplicate              = true;
+                    m_nodes[other].duplicate = true;
+                }
+            }
+        }
+    }
+
+    void ProbeRemaining(uint64_t nowMs)
+    {
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (m_nodes[node].candidate && (m_nodes[node].state == PM_DISCOVERY_IDLE))
+            {
+                Begin(node, PM_DISCOVERY_PROBING, nowMs);
+            }
+        }
+    }
+
+    /// Queues the next read of every node that has none in flight; an SDO server
+    /// handles one transfer at a time
+    void Pump(uint64_t nowMs)
+    {
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            TNode& n = m_nodes[node];
+
+            if (n.pending && !n.outstanding)
+            {
+                int      read = __builtin_ctz(n.pending);
+                uint16_t index;
+                uint8_t  subIndex;
+
+                Object(read, index, subIndex);
+
+                if (!m_client.SdoRead((uint8_t)node, index, subIndex))
+                {
+                    return;
+                }
+
+                n.pending     &= (uint8_t)~(1u << read);
+                n.outstanding |= (uint8_t)(1u << read);
+                n.startMs      = nowMs;
+            }
+        }
+    }
+
+    void Check(uint64_t nowMs)
+    {
+        bool busy = false;
+
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            busy |= (m_nodes[node].state == PM_DISCOVERY_VERIFYING) || (m_nodes[node].state == PM_DISCOVERY_PROBING);
+        }
+
+        if (!m_running || busy)
+        {
+            return;
+        }
+
+        if (m_verify)
+        {
+            // Every known node is settled; look for new nodes without holding up the start
+            m_verify = false;
+            m_ready  = true;
+
+            if (m_backgroundScan)
+            {
+                ProbeRemaining(nowMs);
+                Pump(nowMs);
+                Check(nowMs);
+                return;
+            }
+        }
+
+        m_ready   = true;
+        m_running = false;
+
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_nodes[node].cached = (m_nodes[node].state == PM_DISCOVERY_FOUND);
+
+            if (m_nodes[node].cached)
+            {
+                m_nodes[node].expected = m_nodes[node].entry;
+            }
+        }
+    }
+
+    ICoSdoClient&   m_client;
+    uint32_t        m_timeoutMs;
+    bool            m_backgroundScan;
+    bool            m_running;
+    bool            m_verify;           // verifying the snapshot
+    bool            m_ready;
+    TNode           m_nodes[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COPM_DISCOVERY_H__
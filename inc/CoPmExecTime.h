@@ -0,0 +1,295 @@
+#ifndef __INTERFACE_COPM_EXEC_TIME_H__
+#define __INTERFACE_COPM_EXEC_TIME_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoLatency.h"
+#include "CoSdo.h"
+#include "CoUnits.h"
+
+/// # Firmware execution time tracker
+///
+/// Collects the execution times of PM_SDO_SYSTEM_STATISTICS (2135[2..4], 11.11 ns
+/// ticks) per firmware group. A group is the converter type (PM_SDO_CONVERTER_TYPE)
+/// together with a firmware version chosen by the caller, e.g. PM_SDO_DCB_VERSION
+/// (2150) or PWB_SDO_PM_CAN_CONTROLLER_VERSION (2425) for modules behind a bridge.
+///
+/// The 2135 values are maxima and minima since the last reboot, so every node only
+/// keeps its latest value per metric. The distribution of a group is built from these
+/// values, one per node of the group: the mean and variance (Welford) and a log-linear
+/// histogram (the buckets of CoLatency.h, 6.25% resolution). How often a node is
+/// polled does not change its weight. Compare() reports the shift of one group
+/// against a baseline group: the change of the mean and the 99th percentile, and the
+/// Kolmogorov-Smirnov distance of the two histograms.
+
+#define PM_EXEC_TIME_DEFAULT_KS         0.2     // KS distance that counts as a shift
+#define PM_EXEC_TIME_DEFAULT_P99        0.05    // relative p99 increase that counts as a regression
+
+enum TPmExecTimeMetric
+{
+    PM_EXEC_TIME_MAX_CONTROL = 0,       // 2135[2]
+    PM_EXEC_TIME_MAX_BACKGROUND,        // 2135[3]
+    PM_EXEC_TIME_MIN_BACKGROUND,        // 2135[4]
+    PM_EXEC_TIME_METRICS
+};
+
+typedef struct
+{
+    uint64_t    count;
+    double      mean;           // ns
+    double      stddev;         // ns
+    uint64_t    min;            // ns
+    uint64_t    max;            // ns
+    uint64_t    p50;            // ns
+    uint64_t    p99;            // ns
+}TPmExecTimeStats;
+
+typedef struct
+{
+    TPmExecTimeStats    baseline;
+    TPmExecTimeStats    candidate;
+    double              meanChange;     // relative, 0.1 = 10% slower
+    double              p99Change;      // relative
+    double              ks;             // 0..1
+    bool                shifted;        // ks above the threshold
+    bool                regression;     // shifted and p99 increase above the threshold
+}TPmExecTimeShift;
+
+/// Group of converter type and firmware version
+inline uint64_t PmExecTimeGroup(uint16_t converterType, uint32_t firmwareVersion)
+{
+    return ((uint64_t)converterType << 32) | firmwareVersion;
+}
+
+class CPmExecTimeTracker
+{
+public:
+    CPmExecTimeTracker()
+        : m_ksThreshold(PM_EXEC_TIME_DEFAULT_KS)
+        , m_p99Threshold(PM_EXEC_TIME_DEFAULT_P99)
+    {
+        memset(m_nodes, 0, sizeof(m_nodes));
+    }
+
+    void SetThresholds(double ks, double p99)
+    {
+        m_ksThreshold  = ks;
+        m_p99Threshold = p99;
+    }
+
+    /// Assigns a node to a group, e.g. after discovery or a firmware update; the values
+    /// of the node are cleared
+    void Bind(uint8_t node, uint16_t converterType, uint32_t firmwareVersion)
+    {
+        TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        memset(&entry, 0, sizeof(entry));
+        entry.group = PmExecTimeGroup(converterType, firmwareVersion);
+        entry.bound = true;
+    }
+
+    void Unbind(uint8_t node)
+    {
+        memset(&m_nodes[node & COPM_MAX_NODE_ID], 0, sizeof(TNode));
+    }
+
+    /// Takes 2135[1..count] of a bound node
+    bool Sample(uint8_t node, const uint32_t* sub, unsigned count)
+    {
+        TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!entry.bound || (count < PM_EXEC_TIME_METRICS + 1))
+        {
+            return false;
+        }
+
+        for (unsigned m = 0; m < PM_EXEC_TIME_METRICS; m++)
+        {
+            entry.ns[m]  = CoTicksToNs(sub[m + 1]);
+            entry.known |= (uint8_t)(1u << m);
+        }
+
+        return true;
+    }
+
+    /// Takes one sub-index of 2135 as it arrives, e.g. from OnSdoResponse
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        TNode& entry = m_nodes[node & COPM_MAX_NODE_ID];
+
+        if (!entry.bound || (index != PM_SDO_SYSTEM_STATISTICS) || (size < 4) ||
+            (subIndex < 2) || (subIndex > PM_EXEC_TIME_METRICS + 1))
+        {
+            return false;
+        }
+
+        entry.ns[subIndex - 2]  = CoTicksToNs(CoGetLe32(data));
+        entry.known            |= (uint8_t)(1u << (subIndex - 2));
+
+        return true;
+    }
+
+    /// False when no node of the group has a value
+    bool Stats(uint64_t group, TPmExecTimeMetric metric, TPmExecTimeStats& stats) const
+    {
+        TMetric values;
+
+        if (!Collect(group, metric, values))
+        {
+            return false;
+        }
+
+        Summarize(values, stats);
+
+        return true;
+    }
+
+    /// Calls fn(uint64_t group) once for every group with values
+    template <typename F>
+    void ForEachGroup(F fn) const
+    {
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            if (!m_nodes[node].bound || !m_nodes[node].known || (First(m_nodes[node].group) != node))
+            {
+                continue;
+            }
+
+            fn(m_nodes[node].group);
+        }
+    }
+
+    /// Compares *candidate* against *baseline*, false when a group has no values
+    bool Compare(uint64_t baseline, uint64_t candidate, TPmExecTimeMetric metric, TPmExecTimeShift& shift) const
+    {
+        TMetric x;
+        TMetric y;
+        double  cx = 0;
+        double  cy = 0;
+
+        if (!Collect(baseline, metric, x) || !Collect(candidate, metric, y))
+        {
+            return false;
+        }
+
+        Summarize(x, shift.baseline);
+        Summarize(y, shift.candidate);
+
+        shift.ks = 0;
+
+        for (unsigned i = 0; i < COLAT_BUCKETS; i++)
+        {
+            cx += (double)x.buckets[i] / (double)x.count;
+            cy += (double)y.buckets[i] / (double)y.count;
+            shift.ks = fmax(shift.ks, fabs(cx - cy));
+        }
+
+        shift.meanChange = (shift.baseline.mean > 0) ? shift.candidate.mean / shift.baseline.mean - 1.0 : 0.0;
+        shift.p99Change  = shift.baseline.p99 ? (double)shift.candidate.p99 / (double)shift.baseline.p99 - 1.0 : 0.0;
+        shift.shifted    = shift.ks > m_ksThreshold;
+        shift.regression = shift.shifted && (shift.p99Change > m_p99Threshold);
+
+        return true;
+    }
+
+private:
+    struct TMetric
+    {
+        uint64_t    count;
+        double      mean;
+        double      m2;
+        uint64_t    min;
+        uint64_t    max;
+        uint32_t    buckets[COLAT_BUCKETS];
+    };
+
+    struct TNode
+    {
+        uint64_t    group;
+        uint64_t    ns[PM_EXEC_TIME_METRICS];   // latest value
+        uint8_t     known;                      // bit m: ns[m] was read
+        bool        bound;
+    };
+
+    /// Distribution of the latest values of the nodes of a group
+    bool Collect(uint64_t group, TPmExecTimeMetric metric, TMetric& values) const
+    {
+        memset(&values, 0, sizeof(values));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            const TNode& entry = m_nodes[node];
+
+            if (entry.bound && (entry.group == group) && (entry.known & (1u << metric)))
+            {
+                Add(values, entry.ns[metric]);
+            }
+        }
+
+        return values.count != 0;
+    }
+
+    /// Lowest bound node with values in *group*
+    unsigned First(uint64_t group) const
+    {
+        unsigned node = 0;
+
+        while (!m_nodes[node].bound || !m_nodes[node].known || (m_nodes[node].group != group))
+        {
+            node++;
+        }
+
+        return node;
+    }
+
+    static void Add(TMetric& metric, uint64_t ns)
+    {
+        double delta = (double)ns - metric.mean;
+
+        metric.count++;
+        metric.mean += delta / (double)metric.count;
+        metric.m2   += delta * ((double)ns - metric.mean);
+        metric.min   = ((metric.count == 1) || (ns < metric.min)) ? ns : metric.min;
+        metric.max   = (ns > metric.max) ? ns : metric.max;
+        metric.buckets[CoLatencyBucket(ns)]++;
+    }
+
+    static uint64_t Percentile(const TMetric& metric, double fraction)
+    {
+        uint64_t rank = (uint64_t)((double)metric.count * fraction);
+        uint64_t seen = 0;
+
+        for (unsigned b = 0; b < COLAT_BUCKETS; b++)
+        {
+            seen += metric.buckets[b];
+
+            if (seen > rank)
+            {
+                return CoLatencyBucketValue(b);
+            }
+        }
+
+        return metric.max;
+    }
+
+    static void Summarize(const TMetric& metric, TPmExecTimeStats& stats)
+    {
+        stats.count  = metric.count;
+        stats.mean   = metric.mean;
+        stats.stddev = (metric.count > 1) ? sqrt(metric.m2 / (double)(metric.count - 1)) : 0.0;
+        stats.min    = metric.min;
+        stats.max    = metric.max;
+        stats.p50    = Percentile(metric, 0.5);
+        stats.p99    = Percentile(metric, 0.99);
+    }
+
+    double      m_ksThreshold;
+    double      m_p99Threshold;
+    TNode       m_nodes[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COPM_EXEC_TIME_H__
@@ -0,0 +1,340 @@
+#ifndef __INTERFACE_COPM_GRID_FAULT_H__
+#define __INTERFACE_COPM_GRID_FAULT_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # Grid fault correlator
+///
+/// Joins a grid fault of a power module into one incident:
+///
+/// | Source                         | Contents                                        |
+/// |--------------------------------|-------------------------------------------------|
+/// | PM_PDO_2                       | AC power, frequency and TV2hPmStatus around the |
+/// |                                | edge, from a bounded ring per node              |
+/// | PM_SDO_GRID_FAULT_RECORD 2162  | fault type, trip setting, trip time, measured   |
+/// | PM_SDO_GRID_CODE 2170          | configured grid standard                        |
+///
+/// Every PM_PDO_2 is stored in the ring of its node. When an AC_\* bit of TV2hPmStatus
+/// rises, the last PM_GRID_FAULT_BEFORE samples are copied into a new incident and
+/// 2162[1..4] is read; the grid code is read once per node and then cached. A node
+/// has one read in flight at a time, an SDO server handles one transfer at a time. The
+/// incident collects up to PM_GRID_FAULT_AFTER further samples, bits that rise in the
+/// meantime are added to it. It is passed to the IPmGridFaultSink when the reads have
+/// been answered or aborted and the samples after the edge are complete, or when the
+/// timeout expires. 2162 is only read on an edge, never polled.
+
+#define PM_GRID_FAULT_RING              16      // samples per node, power of two
+#define PM_GRID_FAULT_BEFORE            8       // samples up to and including the edge
+#define PM_GRID_FAULT_AFTER             8       // samples after the edge
+#define PM_GRID_FAULT_WINDOW            (PM_GRID_FAULT_BEFORE + PM_GRID_FAULT_AFTER)
+#define PM_GRID_FAULT_TIMEOUT_MS        1000
+
+/// AC_* bits of TV2hPmStatus
+#define PM_GRID_FAULT_AC_MASK           0xbfff0000u
+
+enum TPmGridCode
+{
+    PM_GRID_CODE_UNDEFINED = 0,
+    PM_GRID_CODE_DIN_VDE_0126_FR = 1,
+    PM_GRID_CODE_G99 = 2,
+    PM_GRID_CODE_UNKNOWN = 0xffff,      // not read
+};
+
+inline const char* PmGridCode2String(unsigned gridCode)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (gridCode)
+    {
+    case PM_GRID_CODE_UNDEFINED:        retValue = "UNDEFINED"; break;
+    case PM_GRID_CODE_DIN_VDE_0126_FR:  retValue = "DIN_VDE_0126_FR"; break;
+    case PM_GRID_CODE_G99:              retValue = "G99"; break;
+    }
+
+    return retValue;
+}
+
+typedef struct
+{
+    uint64_t        timestampMs;
+    PM_PDO_2        pdo;
+}TPmGridSample;
+
+typedef struct
+{
+    uint8_t     valid;              // the record was read
+    uint8_t     faultType;          // 2162[1]
+    uint16_t    tripSetting;        // 2162[2]
+    uint16_t    tripTime;           // 2162[3]
+    uint16_t    measured;           // 2162[4]
+}TPmGridFaultRecord;
+
+typedef struct
+{
+    uint8_t             node;
+    uint16_t            gridCode;       // TPmGridCode
+    uint64_t            edgeMs;         // time of the sample with the rising edge
+    uint32_t            risingBits;     // AC_* bits that rose during the incident
+    uint32_t            status;         // TV2hPmStatus of the edge
+    bool                timedOut;       // emitted before the record or the window was complete
+    TPmGridFaultRecord  record;
+    uint8_t             count;          // samples in window
+    uint8_t             edge;           // index of the edge sample in window
+    TPmGridSample       window[PM_GRID_FAULT_WINDOW];
+}TPmGridIncident;
+
+class IPmGridFaultSink
+{
+public:
+    virtual ~IPmGridFaultSink() {}
+
+    virtual void OnGridIncident(const TPmGridIncident& incident) = 0;
+};
+
+class CPmGridFaultCorrelator
+{
+public:
+    CPmGridFaultCorrelator(ICoSdoClient& client, IPmGridFaultSink& sink)
+        : m_client(client)
+        , m_sink(sink)
+        , m_timeoutMs(PM_GRID_FAULT_TIMEOUT_MS)
+    {
+        memset(m_nodes, 0, sizeof(m_nodes));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            m_nodes[node].gridCode = PM_GRID_CODE_UNKNOWN;
+        }
+    }
+
+    void SetTimeout(uint32_t timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    /// Sets the grid code, e.g. after writing 2170, so it is not read
+    void SetGridCode(uint8_t node, uint16_t gridCode)
+    {
+        m_nodes[node & COPM_MAX_NODE_ID].gridCode = gridCode;
+    }
+
+    /// True while an incident of the node is being collected
+    bool Active(uint8_t node) const
+    {
+        return m_nodes[node & COPM_MAX_NODE_ID].active;
+    }
+
+    /// Stores a received PM_PDO_2 and starts an incident on a rising AC_* bit
+    void OnPdo2(uint8_t node, const PM_PDO_2& pdo, uint64_t nowMs)
+    {
+        TNode&          n      = m_nodes[node & COPM_MAX_NODE_ID];
+        TPmGridSample&  sample = n.ring[n.head++ & (PM_GRID_FAULT_RING - 1)];
+        uint32_t        rising = pdo.errorcode.value & ~n.status & PM_GRID_FAULT_AC_MASK;
+
+        sample.timestampMs = nowMs;
+        sample.pdo         = pdo;
+        n.status           = pdo.errorcode.value;
+
+        if (n.active)
+        {
+            TPmGridIncident& incident = n.incident;
+
+            incident.risingBits |= rising;
+
+            if (incident.count < incident.edge + 1 + PM_GRID_FAULT_AFTER)
+            {
+                incident.window[incident.count++] = sample;
+            }
+        }
+        else if (rising)
+        {
+            Begin(node & COPM_MAX_NODE_ID, rising, nowMs);
+        }
+
+        Pump();
+        Complete(node & COPM_MAX_NODE_ID, nowMs);
+    }
+
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size, uint64_t nowMs)
+    {
+        int read = Read(index, subIndex);
+
+        if ((read < 0) || (node > COPM_MAX_NODE_ID) || !(m_nodes[node].outstanding & (1u << read)) || !size)
+        {
+            return false;
+        }
+
+        TNode&              n      = m_nodes[node];
+        TPmGridFaultRecord& record = n.incident.record;
+        uint16_t            value  = (size >= 2) ? CoGetLe16(data) : data[0];
+
+        switch (read)
+        {
+        case READ_FAULT_TYPE:       record.faultType   = data[0]; break;
+        case READ_TRIP_SETTING:     record.tripSetting = value; break;
+        case READ_TRIP_TIME:        record.tripTime    = value; break;
+        case READ_MEASURED:         record.measured    = value; break;
+        case READ_GRID_CODE:        n.gridCode         = value; break;
+        }
+
+        n.outstanding &= (uint8_t)~(1u << read);
+        n.answered    |= (uint8_t)(1u << read);
+
+        Pump();
+        Complete(node, nowMs);
+
+        return true;
+    }
+
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex, uint64_t nowMs)
+    {
+        int read = Read(index, subIndex);
+
+        if ((read < 0) || (node > COPM_MAX_NODE_ID) || !(m_nodes[node].outstanding & (1u << read)))
+        {
+            return false;
+        }
+
+        m_nodes[node].outstanding &= (uint8_t)~(1u << read);
+
+        Pump();
+        Complete(node, nowMs);
+
+        return true;
+    }
+
+    /// Retries reads the stack could not queue and emits incidents that timed out
+    void Poll(uint64_t nowMs)
+    {
+        Pump();
+
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            Complete((uint8_t)node, nowMs);
+        }
+    }
+
+private:
+    enum TRead
+    {
+        READ_FAULT_TYPE = 0,
+        READ_TRIP_SETTING,
+        READ_TRIP_TIME,
+        READ_MEASURED,
+        READ_GRID_CODE,
+        READ_COUNT,
+        READ_RECORD = (1 << READ_FAULT_TYPE) | (1 << READ_TRIP_SETTING) | (1 << READ_TRIP_TIME) | (1 << READ_MEASURED)
+    };
+
+    struct TNode
+    {
+        TPmGridSample       ring[PM_GRID_FAULT_RING];
+        uint32_t            head;           // samples stored
+        uint32_t            status;         // TV2hPmStatus of the last sample
+        uint16_t            gridCode;
+        bool                active;
+        uint8_t             pending;        // reads to queue
+        uint8_t             outstanding;    // reads queued
+        uint8_t             answered;
+        TPmGridIncident     incident;
+    };
+
+    static int Read(uint16_t index, uint8_t subIndex)
+    {
+        if (index == PM_SDO_GRID_CODE)
+        {
+            return (subIndex == 0) ? READ_GRID_CODE : -1;
+        }
+
+        if ((index == PM_SDO_GRID_FAULT_RECORD) &&
+            (subIndex >= PM_SDO_GRID_FAULT_TYPE_IDX) && (subIndex <= PM_SDO_GRID_READING_VALUE_IDX))
+        {
+            return READ_FAULT_TYPE + subIndex - PM_SDO_GRID_FAULT_TYPE_IDX;
+        }
+
+        return -1;
+    }
+
+    void Begin(uint8_t node, uint32_t rising, uint64_t nowMs)
+    {
+        TNode&           n        = m_nodes[node];
+        TPmGridIncident& incident = n.incident;
+        uint32_t         before   = (n.head < PM_GRID_FAULT_BEFORE) ? n.head : PM_GRID_FAULT_BEFORE;
+
+        memset(&incident, 0, sizeof(incident));
+        incident.node       = node;
+        incident.edgeMs     = nowMs;
+        incident.risingBits = rising;
+        incident.status     = n.status;
+
+        for (uint32_t i = 0; i < before; i++)
+        {
+            incident.window[i] = n.ring[(n.head - before + i) & (PM_GRID_FAULT_RING - 1)];
+        }
+
+        incident.count = (uint8_t)before;
+        incident.edge  = (uint8_t)(before - 1);
+
+        n.active      = true;
+        n.answered    = 0;
+        n.outstanding = 0;
+        n.pending     = (uint8_t)(READ_RECORD |
+                                  ((n.gridCode == PM_GRID_CODE_UNKNOWN) ? (1u << READ_GRID_CODE) : 0));
+    }
+
+    void Pump()
+    {
+        for (unsigned node = 1; node <= COPM_MAX_NODE_ID; node++)
+        {
+            TNode& n = m_nodes[node];
+
+            if (n.pending && !n.outstanding)
+            {
+                int read = __builtin_ctz(n.pending);
+
+                if (!m_client.SdoRead((uint8_t)node,
+                                      (read == READ_GRID_CODE) ? PM_SDO_GRID_CODE : PM_SDO_GRID_FAULT_RECORD,
+                                      (read == READ_GRID_CODE) ? 0 : (uint8_t)(PM_SDO_GRID_FAULT_TYPE_IDX + read)))
+                {
+                    return;
+                }
+
+                n.pending     &= (uint8_t)~(1u << read);
+                n.outstanding |= (uint8_t)(1u << read);
+            }
+        }
+    }
+
+    void Complete(uint8_t node, uint64_t nowMs)
+    {
+        TNode&           n        = m_nodes[node];
+        TPmGridIncident& incident = n.incident;
+        bool             reads    = !n.pending && !n.outstanding;
+        bool             window   = incident.count >= incident.edge + 1 + PM_GRID_FAULT_AFTER;
+        bool             timedOut = (nowMs - incident.edgeMs) >= m_timeoutMs;
+
+        if (!n.active || !(timedOut || (reads && window)))
+        {
+            return;
+        }
+
+        // Late answers of a timed out incident are ignored
+        n.active      = false;
+        n.pending     = 0;
+        n.outstanding = 0;
+
+        incident.record.valid = (n.answered & READ_RECORD) == READ_RECORD;
+        incident.gridCode     = n.gridCode;
+        incident.timedOut     = !(reads && window);
+
+        m_sink.OnGridIncident(incident);
+    }
+
+    ICoSdoClient&       m_client;
+    IPmGridFaultSink&   m_sink;
+    uint32_t            m_timeoutMs;
+    TNode               m_nodes[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COPM_GRID_FAULT_H__
@@ -0,0 +1,429 @@
+#ifndef __INTERFACE_COPM_GRID_FREQUENCY_H__
+#define __INTERFACE_COPM_GRID_FREQUENCY_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # Grid frequency monitor
+///
+/// Fuses the grid frequency of PM_PDO_2 of many power modules into one site frequency
+/// and derives the rate of change of frequency (ROCOF), to warn before the modules trip
+/// with AC_GridFail or AC_GridIslanding.
+///
+/// A stream is one module: stream = bus \* (COPM_MAX_NODE_ID + 1) + node. OnPdo2()
+/// only stores the reading, O(1). Update(), called at a fixed rate, e.g. every 20 ms:
+///
+/// - takes the readings younger than the stale time,
+/// - rejects outliers further than *k* median absolute deviations (at least the
+///   minimum band) from the median and averages the rest,
+/// - adds the fused frequency to a fast and a slow sliding window; the ROCOF of a
+///   window is the slope of a least squares line, kept with running sums, so adding
+///   and evicting a sample is O(1),
+/// - raises and clears alerts with hysteresis and passes the edges to the sink.
+///
+/// | Alert                     | Condition                                          |
+/// |---------------------------|----------------------------------------------------|
+/// | PM_FREQ_ALERT_UNDER       | fused < nominal - deviation                        |
+/// | PM_FREQ_ALERT_OVER        | fused > nominal + deviation                        |
+/// | PM_FREQ_ALERT_ROCOF       | \|fast ROCOF\| > rocof                             |
+/// | PM_FREQ_ALERT_ROCOF_SLOW  | \|slow ROCOF\| > rocof / 2                         |
+/// | PM_FREQ_ALERT_DIVERGENCE  | a fresh module is rejected as outlier (islanded?)  |
+///
+/// An alert clears when its value is back below PM_FREQ_HYSTERESIS of the threshold.
+/// The defaults are below the loss of mains settings of G99 (1 Hz/s) and the stage 1
+/// frequency limits, so the alert comes before the trip.
+
+#define PM_FREQ_MAX_STREAMS             512
+#define PM_FREQ_WINDOW_SAMPLES          256     // per window, power of two
+#define PM_FREQ_DEFAULT_SCALE           0.01    // Hz per LSB of PM_PDO_2 frequency
+#define PM_FREQ_DEFAULT_NOMINAL         50.0    // Hz
+#define PM_FREQ_DEFAULT_DEVIATION       0.2     // Hz
+#define PM_FREQ_DEFAULT_ROCOF           0.5     // Hz/s
+#define PM_FREQ_DEFAULT_STALE_MS        200
+#define PM_FREQ_DEFAULT_FAST_MS         200
+#define PM_FREQ_DEFAULT_SLOW_MS         1000
+#define PM_FREQ_DEFAULT_OUTLIER_K       4.0     // median absolute deviations
+#define PM_FREQ_DEFAULT_OUTLIER_BAND    0.05    // Hz, minimum band around the median
+#define PM_FREQ_HYSTERESIS              0.8
+#define PM_FREQ_MIN_REGRESSION          3       // samples before a ROCOF is reported
+#define PM_FREQ_REBASE_MS               60000
+
+enum TPmFrequencyAlert
+{
+    PM_FREQ_ALERT_UNDER         = 1 << 0,
+    PM_FREQ_ALERT_OVER          = 1 << 1,
+    PM_FREQ_ALERT_ROCOF         = 1 << 2,
+    PM_FREQ_ALERT_ROCOF_SLOW    = 1 << 3,
+    PM_FREQ_ALERT_DIVERGENCE    = 1 << 4,
+};
+
+inline const char* PmFrequencyAlert2String(unsigned alert)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (alert)
+    {
+    case PM_FREQ_ALERT_UNDER:       retValue = "UNDER"; break;
+    case PM_FREQ_ALERT_OVER:        retValue = "OVER"; break;
+    case PM_FREQ_ALERT_ROCOF:       retValue = "ROCOF"; break;
+    case PM_FREQ_ALERT_ROCOF_SLOW:  retValue = "ROCOF_SLOW"; break;
+    case PM_FREQ_ALERT_DIVERGENCE:  retValue = "DIVERGENCE"; break;
+    }
+
+    return retValue;
+}
+
+typedef struct
+{
+    uint64_t    timestampMs;
+    double      frequency;          // fused [Hz], 0 without fresh readings
+    double      rocofFast;          // Hz/s
+    double      rocofSlow;          // Hz/s
+    uint16_t    streams;            // fresh readings
+    uint16_t    outliers;           // rejected readings
+    uint32_t    alerts;             // TPmFrequencyAlert bits that are active
+}TPmFrequencyState;
+
+class IPmFrequencySink
+{
+public:
+    virtual ~IPmFrequencySink() {}
+
+    /// *raised* and *cleared* hold the TPmFrequencyAlert bits that changed
+    virtual void OnFrequencyAlert(const TPmFrequencyState& state, uint32_t raised, uint32_t cleared) = 0;
+};
+
+/// Least squares slope over a sliding time window, O(1) per sample
+class CCoSlidingRegression
+{
+public:
+    explicit CCoSlidingRegression(uint32_t windowMs = PM_FREQ_DEFAULT_FAST_MS)
+        : m_windowMs(windowMs)
+    {
+        Clear();
+    }
+
+    void SetWindow(uint32_t windowMs) { m_windowMs = windowMs; }
+
+    void Clear()
+    {
+        m_head   = 0;
+        m_tail   = 0;
+        m_baseMs = 0;
+        m_st = m_sy = m_stt = m_sty = 0;
+    }
+
+    void Add(uint64_t timestampMs, double value)
+    {
+        if (m_head == m_tail)
+        {
+            m_baseMs = timestampMs;
+        }
+
+        if (m_head - m_tail == PM_FREQ_WINDOW_SAMPLES)
+        {
+            Evict();
+        }
+
+        while ((m_head != m_tail) && (timestampMs - m_samples[m_tail & (PM_FREQ_WINDOW_SAMPLES - 1)].timestampMs > m_windowMs))
+        {
+            Evict();
+        }
+
+        // Keeps the offsets small, so the sums do not lose precision
+        if (timestampMs - m_baseMs > PM_FREQ_REBASE_MS)
+        {
+            Rebase(timestampMs);
+        }
+
+        TSample& sample = m_samples[m_head++ & (PM_FREQ_WINDOW_SAMPLES - 1)];
+
+        sample.timestampMs = timestampMs;
+        sample.value       = value;
+        Sum(sample, 1.0);
+    }
+
+    unsigned Count() const { return m_head - m_tail; }
+
+    /// Slope per second, 0 with less than *minSamples*
+    double Slope(unsigned minSamples = PM_FREQ_MIN_REGRESSION) const
+    {
+        double n     = (double)Count();
+        double denom = n * m_stt - m_st * m_st;
+
+        if ((Count() < minSamples) || (denom <= 0))
+        {
+            return 0.0;
+        }
+
+        return (n * m_sty - m_st * m_sy) / denom * 1000.0;
+    }
+
+private:
+    struct TSample
+    {
+        uint64_t    timestampMs;
+        double      value;
+    };
+
+    void Sum(const TSample& sample, double sign)
+    {
+        double t = (double)(sample.timestampMs - m_baseMs);
+
+        m_st  += sign * t;
+        m_sy  += sign * sample.value;
+        m_stt += sign * t * t;
+        m_sty += sign * t * sample.value;
+    }
+
+    void Evict()
+    {
+        Sum(m_samples[m_tail++ & (PM_FREQ_WINDOW_SAMPLES - 1)], -1.0);
+    }
+
+    /// Recomputes the sums from the window, once per PM_FREQ_REBASE_MS
+    void Rebase(uint64_t baseMs)
+    {
+        m_baseMs = baseMs;
+        m_st = m_sy = m_stt = m_sty = 0;
+
+        for (unsigned i = m_tail; i != m_head; i++)
+        {
+            Sum(m_samples[i & (PM_FREQ_WINDOW_SAMPLES - 1)], 1.0);
+        }
+    }
+
+    uint32_t    m_windowMs;
+    unsigned    m_head;
+    unsigned    m_tail;
+    uint64_t    m_baseMs;
+    double      m_st;
+    double      m_sy;
+    double      m_stt;
+    double      m_sty;
+    TSample     m_samples[PM_FREQ_WINDOW_SAMPLES];
+};
+
+class CPmGridFrequencyMonitor
+{
+public:
+    explicit CPmGridFrequencyMonitor(IPmFrequencySink& sink)
+        : m_sink(sink)
+        , m_scale(PM_FREQ_DEFAULT_SCALE)
+        , m_nominal(PM_FREQ_DEFAULT_NOMINAL)
+        , m_deviation(PM_FREQ_DEFAULT_DEVIATION)
+        , m_rocof(PM_FREQ_DEFAULT_ROCOF)
+        , m_staleMs(PM_FREQ_DEFAULT_STALE_MS)
+        , m_outlierK(PM_FREQ_DEFAULT_OUTLIER_K)
+        , m_outlierBand(PM_FREQ_DEFAULT_OUTLIER_BAND)
+        , m_fast(PM_FREQ_DEFAULT_FAST_MS)
+        , m_slow(PM_FREQ_DEFAULT_SLOW_MS)
+    {
+        memset(m_streams, 0, sizeof(m_streams));
+        memset(&m_state, 0, sizeof(m_state));
+    }
+
+    /// Hz per LSB of the PM_PDO_2 frequency
+    void SetScale(double hzPerLsb) { m_scale = hzPerLsb; }
+
+    void SetNominal(double hz) { m_nominal = hz; }
+
+    void SetThresholds(double deviationHz, double rocofHzPerSec)
+    {
+        m_deviation = deviationHz;
+        m_rocof     = rocofHzPerSec;
+    }
+
+    void SetWindows(uint32_t fastMs, uint32_t slowMs)
+    {
+        m_fast.SetWindow(fastMs);
+        m_slow.SetWindow(slowMs);
+    }
+
+    void SetStale(uint32_t staleMs) { m_staleMs = staleMs; }
+
+    void SetOutlier(double k, double bandHz)
+    {
+        m_outlierK    = k;
+        m_outlierBand = bandHz;
+    }
+
+    static unsigned Stream(unsigned bus, uint8_t node)
+    {
+        return bus * (COPM_MAX_NODE_ID + 1) + (node & COPM_MAX_NODE_ID);
+    }
+
+    void OnPdo2(unsigned stream, const PM_PDO_2& pdo, uint64_t nowMs)
+    {
+        if (stream < PM_FREQ_MAX_STREAMS)
+        {
+            m_streams[stream].frequency   = pdo.frequency;
+            m_streams[stream].timestampMs = nowMs;
+            m_streams[stream].seen        = true;
+        }
+    }
+
+    /// Fuses the fresh readings and evaluates the alerts
+    const TPmFrequencyState& Update(uint64_t nowMs)
+    {
+        unsigned count = 0;
+
+        for (unsigned s = 0; s < PM_FREQ_MAX_STREAMS; s++)
+        {
+            TStream& stream = m_streams[s];
+
+            stream.outlier = false;
+
+            if (stream.seen && (nowMs - stream.timestampMs <= m_staleMs))
+            {
+                m_fresh[count]  = (uint16_t)s;
+                m_values[count] = stream.frequency * m_scale;
+                count++;
+            }
+        }
+
+        uint32_t alerts = m_state.alerts;
+
+        m_state.timestampMs = nowMs;
+        m_state.streams     = (uint16_t)count;
+        m_state.outliers    = 0;
+
+        if (count)
+        {
+            double   median;
+            double   band;
+            double   sum  = 0;
+            unsigned used = 0;
+
+            memcpy(m_scratch, m_values, count * sizeof(double));
+            median = Median(m_scratch, count);
+
+            for (unsigned i = 0; i < count; i++)
+            {
+                m_scratch[i] = fabs(m_values[i] - median);
+            }
+
+            band = std::max(m_outlierK * Median(m_scratch, count), m_outlierBand);
+
+            for (unsigned i = 0; i < count; i++)
+            {
+                if (fabs(m_values[i] - median) > band)
+                {
+                    m_streams[m_fresh[i]].outlier = true;
+                    m_state.outliers++;
+                }
+                else
+                {
+                    sum += m_values[i];
+                    used++;
+                }
+            }
+
+            m_state.frequency = sum / used;
+            m_fast.Add(nowMs, m_state.frequency);
+            m_slow.Add(nowMs, m_state.frequency);
+            m_state.rocofFast = m_fast.Slope();
+            m_state.rocofSlow = m_slow.Slope();
+
+            double offset = m_state.frequency - m_nominal;
+
+            alerts = Hysteresis(alerts, PM_FREQ_ALERT_UNDER, -offset, m_deviation);
+            alerts = Hysteresis(alerts, PM_FREQ_ALERT_OVER, offset, m_deviation);
+            alerts = Hysteresis(alerts, PM_FREQ_ALERT_ROCOF, fabs(m_state.rocofFast), m_rocof);
+            alerts = Hysteresis(alerts, PM_FREQ_ALERT_ROCOF_SLOW, fabs(m_state.rocofSlow), m_rocof / 2);
+            alerts = m_state.outliers ? (alerts | PM_FREQ_ALERT_DIVERGENCE) : (alerts & ~PM_FREQ_ALERT_DIVERGENCE);
+        }
+        else
+        {
+            // Without readings nothing is known; the windows restart with the next one
+            m_state.frequency = 0;
+            m_state.rocofFast = 0;
+            m_state.rocofSlow = 0;
+            m_fast.Clear();
+            m_slow.Clear();
+            alerts = 0;
+        }
+
+        uint32_t raised  = alerts & ~m_state.alerts;
+        uint32_t cleared = m_state.alerts & ~alerts;
+
+        m_state.alerts = alerts;
+
+        if (raised || cleared)
+        {
+            m_sink.OnFrequencyAlert(m_state, raised, cleared);
+        }
+
+        return m_state;
+    }
+
+    const TPmFrequencyState& State() const { return m_state; }
+
+    /// True when the last Update() rejected the reading of the stream
+    bool Outlier(unsigned stream) const
+    {
+        return (stream < PM_FREQ_MAX_STREAMS) && m_streams[stream].outlier;
+    }
+
+private:
+    struct TStream
+    {
+        uint64_t    timestampMs;
+        uint16_t    frequency;
+        bool        seen;
+        bool        outlier;
+    };
+
+    /// Reorders *values*
+    static double Median(double* values, unsigned count)
+    {
+        std::nth_element(values, values + count / 2, values + count);
+
+        double upper = values[count / 2];
+
+        if (count & 1)
+        {
+            return upper;
+        }
+
+        return (upper + *std::max_element(values, values + count / 2)) / 2;
+    }
+
+    static uint32_t Hysteresis(uint32_t alerts, uint32_t bit, double value, double threshold)
+    {
+        if (value > threshold)
+        {
+            return alerts | bit;
+        }
+
+        if (value < threshold * PM_FREQ_HYSTERESIS)
+        {
+            return alerts & ~bit;
+        }
+
+        return alerts;
+    }
+
+    IPmFrequencySink&       m_sink;
+    double                  m_scale;
+    double                  m_nominal;
+    double                  m_deviation;
+    double                  m_rocof;
+    uint32_t                m_staleMs;
+    double                  m_outlierK;
+    double                  m_outlierBand;
+    CCoSlidingRegression    m_fast;
+    CCoSlidingRegression    m_slow;
+    TPmFrequencyState       m_state;
+    TStream                 m_streams[PM_FREQ_MAX_STREAMS];
+    uint16_t                m_fresh[PM_FREQ_MAX_STREAMS];
+    double                  m_values[PM_FREQ_MAX_STREAMS];
+    double                  m_scratch[PM_FREQ_MAX_STREAMS];
+};
+
+#endif // __INTERFACE_COPM_GRID_FREQUENCY_H__
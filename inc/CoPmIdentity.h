@@ -0,0 +1,525 @@
+#ifndef __INTERFACE_COPM_IDENTITY_H__
+#define __INTERFACE_COPM_IDENTITY_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CoPm.h"
+
+/// # Power module identity
+///
+/// Decoders and encoders for the identity objects of a power module, and an inventory
+/// index that maps the module serial to the node, site and hardware of the module.
+///
+/// | Object | Description                  | Decoded as             |
+/// |--------|------------------------------|------------------------|
+/// | 2150   | Power board (DCB) version    | TPmVersionString       |
+/// | 2151   | NTC board version            | TPmVersionString       |
+/// | 2152   | Production date              | TPmProdDate            |
+/// | 2153   | Power module serial          | uint32                 |
+/// | 2155   | DCB HW version               | TPmVersionString       |
+/// | 2159   | HW components identifiers    | TPmHwComponents        |
+/// | 215b   | 4epy code of whole assembly  | TPm4EpyCode            |
+/// | 215c   | Hardware ID                  | uint8                  |
+
+typedef struct
+{
+    uint8_t     day;
+    uint8_t     month;
+    uint16_t    year;
+}TPmProdDate;
+
+/// Low byte: day, second byte: month, high bytes: year
+constexpr TPmProdDate PmDecodeProdDate(uint32_t raw)
+{
+    return TPmProdDate{ (uint8_t)raw, (uint8_t)(raw >> 8), (uint16_t)(raw >> 16) };
+}
+
+constexpr uint32_t PmEncodeProdDate(const TPmProdDate& date)
+{
+    return (uint32_t)date.day | ((uint32_t)date.month << 8) | ((uint32_t)date.year << 16);
+}
+
+constexpr bool PmValidProdDate(const TPmProdDate& date)
+{
+    return (date.day >= 1) && (date.day <= 31) && (date.month >= 1) && (date.month <= 12);
+}
+
+static_assert(PmDecodeProdDate(0x07DD0C13).day == 19 && PmDecodeProdDate(0x07DD0C13).month == 12 &&
+              PmDecodeProdDate(0x07DD0C13).year == 2013, "2152 example: 19th of December 2013");
+
+/// 4EPYxxxxxx-y Rev z
+typedef struct
+{
+    uint32_t    number;     // xxxxxx, bit 0..19
+    uint8_t     variant;    // y,      bit 20..26
+    char        revision;   // z,      bit 27..31 = ASCII(z) - 0x40
+}TPm4EpyCode;
+
+#define PM_4EPY_NUMBER_MASK             0x000FFFFFu
+#define PM_4EPY_VARIANT_SHIFT           20
+#define PM_4EPY_VARIANT_MASK            0x7Fu
+#define PM_4EPY_REVISION_SHIFT          27
+
+/// Note: the example in the description of 215b (4EPY550011-1 RevB = 135816315)
+/// decodes to Rev A with the documented formula; the formula is followed here.
+constexpr TPm4EpyCode PmDecode4Epy(uint32_t raw)
+{
+    return TPm4EpyCode{ raw & PM_4EPY_NUMBER_MASK,
+                        (uint8_t)((raw >> PM_4EPY_VARIANT_SHIFT) & PM_4EPY_VARIANT_MASK),
+                        (char)((raw >> PM_4EPY_REVISION_SHIFT) + 0x40) };
+}
+
+constexpr uint32_t PmEncode4Epy(const TPm4EpyCode& code)
+{
+    return (code.number & PM_4EPY_NUMBER_MASK) |
+           (((uint32_t)code.variant & PM_4EPY_VARIANT_MASK) << PM_4EPY_VARIANT_SHIFT) |
+           ((uint32_t)(code.revision - 0x40) << PM_4EPY_REVISION_SHIFT);
+}
+
+constexpr bool PmValid4Epy(const TPm4EpyCode& code)
+{
+    return (code.number <= 999999) && (code.variant <= 99) && (code.revision >= 'A') && (code.revision <= 'Z');
+}
+
+static_assert(PmEncode4Epy(PmDecode4Epy(135816315)) == 135816315, "215b round trip");
+static_assert(PmDecode4Epy(135816315).number == 550011 && PmDecode4Epy(135816315).variant == 1, "215b example");
+
+/// Formats "4EPYxxxxxx-y Rev z", returns the snprintf result
+inline int PmFormat4Epy(const TPm4EpyCode& code, char* text, size_t size)
+{
+    return snprintf(text, size, "4EPY%06u-%u Rev%c", (unsigned)code.number, (unsigned)code.variant, code.revision);
+}
+
+/// 4 ASCII characters, the first character is transmitted first (least significant byte)
+typedef struct
+{
+    char        text[5];
+}TPmVersionString;
+
+constexpr TPmVersionString PmDecodeVersion(uint32_t raw)
+{
+    return TPmVersionString{ { (char)raw, (char)(raw >> 8), (char)(raw >> 16), (char)(raw >> 24), 0 } };
+}
+
+constexpr uint32_t PmEncodeVersion(const char (&text)[5])
+{
+    return (uint32_t)(uint8_t)text[0] | ((uint32_t)(uint8_t)text[1] << 8) |
+           ((uint32_t)(uint8_t)text[2] << 16) | ((uint32_t)(uint8_t)text[3] << 24);
+}
+
+static_assert(PmEncodeVersion(PmDecodeVersion(0x31304241).text) == 0x31304241, "version round trip");
+
+#define PM_SDO_HW_COMPONENTS_SILICON_IDX    1
+#define PM_SDO_HW_COMPONENTS_MAGNETIC_IDX   2
+#define PM_SDO_HW_COMPONENTS_HEATSINK_IDX   3
+
+enum TPmSiliconType
+{
+    PM_SILICON_UNDEFINED = 0,
+    PM_SILICON_ESMERALDA = 1,
+    PM_SILICON_MAGELLAN = 2,
+    PM_SILICON_ESMERALDA_LEADED_RECTIFIER = 3,
+    PM_SILICON_ESMERALDA_1200V_IGBT = 4,
+    PM_SILICON_UNDEFINED_FFFF = 0xFFFF
+};
+
+enum TPmMagneticType
+{
+    PM_MAGNETIC_UNDEFINED = 0,
+    PM_MAGNETIC_ESMERALDA = 1,
+    PM_MAGNETIC_MAGELLAN = 2,
+    PM_MAGNETIC_DENZA = 3,
+    PM_MAGNETIC_UNDEFINED_FFFF = 0xFFFF
+};
+
+typedef struct
+{
+    uint16_t    silicon;    // TPmSiliconType
+    uint16_t    magnetic;   // TPmMagneticType
+    uint16_t    heatsink;
+}TPmHwComponents;
+
+/// Packs 2159[1..3] in one value: silicon in bit 0..15, magnetic 16..31, heatsink 32..47
+constexpr uint64_t PmEncodeHwComponents(const TPmHwComponents& hw)
+{
+    return (uint64_t)hw.silicon | ((uint64_t)hw.magnetic << 16) | ((uint64_t)hw.heatsink << 32);
+}
+
+constexpr TPmHwComponents PmDecodeHwComponents(uint64_t packed)
+{
+    return TPmHwComponents{ (uint16_t)packed, (uint16_t)(packed >> 16), (uint16_t)(packed >> 32) };
+}
+
+inline const char* PmSiliconType2String(unsigned type)
+{
+    const char* retValue = "Undefined";
+
+    switch(type)
+    {
+    case PM_SILICON_ESMERALDA:                  retValue = "Esmeralda"; break;
+    case PM_SILICON_MAGELLAN:                   retValue = "Magellan"; break;
+    case PM_SILICON_ESMERALDA_LEADED_RECTIFIER: retValue = "Esmeralda, leaded output rectifier"; break;
+    case PM_SILICON_ESMERALDA_1200V_IGBT:       retValue = "Esmeralda, 1200V IGBT"; break;
+    }
+
+    return retValue;
+}
+
+inline const char* PmMagneticType2String(unsigned type)
+{
+    const char* retValue = "Undefined";
+
+    switch(type)
+    {
+    case PM_MAGNETIC_ESMERALDA: retValue = "Esmeralda"; break;
+    case PM_MAGNETIC_MAGELLAN:  retValue = "Magellan"; break;
+    case PM_MAGNETIC_DENZA:     retValue = "Denza"; break;
+    }
+
+    return retValue;
+}
+
+/// ## Inventory index
+///
+/// Open addressed hash table (linear probing, backward shift deletion) of
+/// TPmInventoryRecord, keyed by serial, in a memory mapped file. Opening the index
+/// only maps the file, so the load time does not depend on the number of modules.
+/// Serial 0 marks an empty slot. Records are modified in place and Erase() moves
+/// records within a cluster, so there is no consistency for a reader while another
+/// process writes: open the index read-only only when no writer has it open.
+///
+/// | Offset | Description                                | Size                 |
+/// |--------|--------------------------------------------|----------------------|
+/// | 0      | PM_INVENTORY_MAGIC                         | uint32               |
+/// | 4      | PM_INVENTORY_VERSION                       | uint32               |
+/// | 8      | sizeof(TPmInventoryRecord)                 | uint32               |
+/// | 12     | Capacity (power of 2)                      | uint32               |
+/// | 16     | Number of records                          | uint32               |
+/// | 64     | Slots                                      | TPmInventoryRecord[] |
+
+#define PM_INVENTORY_MAGIC              0x564e4950  // "PINV"
+#define PM_INVENTORY_VERSION            1
+#define PM_INVENTORY_HEADER_SIZE        64
+#define PM_INVENTORY_MIN_CAPACITY       64
+
+typedef struct
+{
+    uint32_t    serial;         // 2153
+    uint32_t    site;
+    uint32_t    code4Epy;       // 215b
+    uint32_t    prodDate;       // 2152
+    uint32_t    dcbVersion;     // 2150
+    uint32_t    ntcVersion;     // 2151
+    uint32_t    hwVersion;      // 2155
+    uint16_t    silicon;        // 2159[1]
+    uint16_t    magnetic;       // 2159[2]
+    uint16_t    heatsink;       // 2159[3]
+    uint16_t    converterType;  // 2158
+    uint8_t     node;           // 2156
+    uint8_t     hwId;           // 215c
+    uint8_t     reserved[2];
+}TPmInventoryRecord;
+
+static_assert(sizeof(TPmInventoryRecord) == 40, "inventory record layout");
+
+class CPmInventory
+{
+public:
+    CPmInventory()
+        : m_fd(-1)
+        , m_writable(false)
+        , m_size(0)
+        , m_header(0)
+        , m_slots(0)
+    {
+    }
+
+    ~CPmInventory()
+    {
+        Close();
+    }
+
+    /// Maps the index at path, creates it with room for *capacity* modules when it
+    /// does not exist yet. A read-only index can not be modified.
+    bool Open(const char* path, uint32_t capacity = PM_INVENTORY_MIN_CAPACITY, bool readOnly = false)
+    {
+        Close();
+        snprintf(m_path, sizeof(m_path), "%s", path);
+
+        int fd = open(path, readOnly ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+
+        if ((fstat(fd, &info) != 0) || ((info.st_size == 0) && (readOnly || !Format(fd, SlotsFor(capacity)))))
+        {
+            close(fd);
+            return false;
+        }
+
+        return Map(fd, !readOnly);
+    }
+
+    void Close()
+    {
+        if (m_header)
+        {
+            munmap(m_header, m_size);
+        }
+
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+
+        m_fd     = -1;
+        m_size   = 0;
+        m_header = 0;
+        m_slots  = 0;
+    }
+
+    bool IsOpen() const { return m_header != 0; }
+
+    uint32_t Size() const { return m_header ? m_header[4] : 0; }
+
+    uint32_t Capacity() const { return m_header ? m_header[3] : 0; }
+
+    const TPmInventoryRecord* Find(uint32_t serial) const
+    {
+        if (!m_header || !serial)
+        {
+            return 0;
+        }
+
+        uint32_t mask = Capacity() - 1;
+
+        for (uint32_t slot = Hash(serial) & mask; m_slots[slot].serial; slot = (slot + 1) & mask)
+        {
+            if (m_slots[slot].serial == serial)
+            {
+                return &m_slots[slot];
+            }
+        }
+
+        return 0;
+    }
+
+    /// Inserts or replaces the record of record.serial, grows the index when needed
+    bool Upsert(const TPmInventoryRecord& record)
+    {
+        if (!m_writable || !record.serial)
+        {
+            return false;
+        }
+
+        if (((uint64_t)(Size() + 1) * 4 > (uint64_t)Capacity() * 3) && !Grow())
+        {
+            return false;
+        }
+
+        uint32_t mask = Capacity() - 1;
+        uint32_t slot = Hash(record.serial) & mask;
+
+        while (m_slots[slot].serial && (m_slots[slot].serial != record.serial))
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        if (!m_slots[slot].serial)
+        {
+            m_header[4]++;
+        }
+
+        m_slots[slot] = record;
+
+        return true;
+    }
+
+    bool Erase(uint32_t serial)
+    {
+        const TPmInventoryRecord* record = m_writable ? Find(serial) : 0;
+
+        if (!record)
+        {
+            return false;
+        }
+
+        uint32_t mask = Capacity() - 1;
+        uint32_t hole = (uint32_t)(record - m_slots);
+
+        // Backward shift: move later records of the cluster into the hole when their
+        // home slot is not between the hole and their current slot
+        for (uint32_t slot = (hole + 1) & mask; m_slots[slot].serial; slot = (slot + 1) & mask)
+        {
+            uint32_t home = Hash(m_slots[slot].serial) & mask;
+
+            if (((slot - home) & mask) >= ((slot - hole) & mask))
+            {
+                m_slots[hole] = m_slots[slot];
+                hole          = slot;
+            }
+        }
+
+        memset(&m_slots[hole], 0, sizeof(m_slots[hole]));
+        m_header[4]--;
+
+        return true;
+    }
+
+    /// Calls fn(const TPmInventoryRecord&) for every record
+    template <typename F>
+    void ForEach(F fn) const
+    {
+        for (uint32_t slot = 0; slot < Capacity(); slot++)
+        {
+            if (m_slots[slot].serial)
+            {
+                fn(m_slots[slot]);
+            }
+        }
+    }
+
+    bool Sync() const
+    {
+        return m_header && (msync(m_header, m_size, MS_SYNC) == 0);
+    }
+
+private:
+    static uint32_t Hash(uint32_t serial)
+    {
+        serial ^= serial >> 16;
+        serial *= 0x7feb352du;
+        serial ^= serial >> 15;
+        serial *= 0x846ca68bu;
+        serial ^= serial >> 16;
+
+        return serial;
+    }
+
+    static uint32_t SlotsFor(uint32_t capacity)
+    {
+        uint32_t slots = PM_INVENTORY_MIN_CAPACITY;
+
+        while ((uint64_t)slots * 3 < (uint64_t)capacity * 4)
+        {
+            slots <<= 1;
+        }
+
+        return slots;
+    }
+
+    static size_t FileSize(uint32_t slots)
+    {
+        return PM_INVENTORY_HEADER_SIZE + (size_t)slots * sizeof(TPmInventoryRecord);
+    }
+
+    static bool Format(int fd, uint32_t slots)
+    {
+        uint32_t header[PM_INVENTORY_HEADER_SIZE / 4] = { PM_INVENTORY_MAGIC, PM_INVENTORY_VERSION,
+                                                          (uint32_t)sizeof(TPmInventoryRecord), slots, 0 };
+
+        // ftruncate() zero fills, which marks every slot empty
+        return (ftruncate(fd, (off_t)FileSize(slots)) == 0) &&
+               (pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    }
+
+    bool Map(int fd, bool writable)
+    {
+        struct stat info;
+        void*       base;
+
+        if ((fstat(fd, &info) != 0) || ((size_t)info.st_size < PM_INVENTORY_HEADER_SIZE))
+        {
+            close(fd);
+            return false;
+        }
+
+        base = mmap(0, (size_t)info.st_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        uint32_t* header = (uint32_t*)base;
+
+        if ((header[0] != PM_INVENTORY_MAGIC) || (header[1] != PM_INVENTORY_VERSION) ||
+            (header[2] != sizeof(TPmInventoryRecord)) || (header[3] < PM_INVENTORY_MIN_CAPACITY) ||
+            (header[3] & (header[3] - 1)) || (header[4] >= header[3]) ||
+            ((size_t)info.st_size < FileSize(header[3])))
+        {
+            munmap(base, (size_t)info.st_size);
+            close(fd);
+            return false;
+        }
+
+        m_fd       = fd;
+        m_writable = writable;
+        m_size     = (size_t)info.st_size;
+        m_header   = header;
+        m_slots    = (TPmInventoryRecord*)((uint8_t*)base + PM_INVENTORY_HEADER_SIZE);
+
+        return true;
+    }
+
+    /// Rehashes into a file twice the size and atomically replaces the index with it
+    bool Grow()
+    {
+        char         temp[sizeof(m_path) + 8];
+        CPmInventory grown;
+
+        snprintf(temp, sizeof(temp), "%s.tmp", m_path);
+        unlink(temp);
+
+        if (!grown.Open(temp, Capacity()))
+        {
+            return false;
+        }
+
+        for (uint32_t slot = 0; slot < Capacity(); slot++)
+        {
+            if (m_slots[slot].serial)
+            {
+                grown.Upsert(m_slots[slot]);
+            }
+        }
+
+        if (!grown.Sync() || (rename(temp, m_path) != 0))
+        {
+            return false;
+        }
+
+        Close();
+
+        m_fd       = grown.m_fd;
+        m_writable = grown.m_writable;
+        m_size     = grown.m_size;
+        m_header   = grown.m_header;
+        m_slots    = grown.m_slots;
+
+        grown.m_fd     = -1;
+        grown.m_header = 0;
+
+        return true;
+    }
+
+    char                    m_path[512];
+    int                     m_fd;
+    bool                    m_writable;
+    size_t                  m_size;
+    uint32_t*               m_header;
+    TPmInventoryRecord*     m_slots;
+};
+
+#endif // __INTERFACE_COPM_IDENTITY_H__
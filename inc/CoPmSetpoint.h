@@ -0,0 +1,265 @@
+#ifndef __INTERFACE_COPM_SETPOINT_H__
+#define __INTERFACE_COPM_SETPOINT_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # Set-point writer
+///
+/// Sits between the control loop and the CANopen stack for the set-points of the
+/// power modules:
+///
+/// | Object                                | Size   | Unit |
+/// |---------------------------------------|--------|------|
+/// | PM_SDO_DC_OUTPUT_U_SETPOINT 2109      | uint16 | 0.1V |
+/// | PM_SDO_DC_OUTPUT_I_SETPOINT 210a      | uint16 | 0.1A |
+/// | PM_SDO_VOLTAGE_SETPOINT_OFFSET 210d   | uint16 | mV   |
+///
+/// Set() only records the wanted value; Poll() writes. Per (node, object) there is at
+/// most one write waiting, so a value that is set again before it was written replaces
+/// the older one. A value within the dead band of the last written value is not
+/// written. Every set-point that is in use is written again at least once per refresh
+/// interval, so the module does not raise PM_STATUS_SETPOINT_TIMEOUT while the loop
+/// keeps the value constant; refreshes go before changes when the budget per Poll()
+/// is limited. Choose the refresh interval well below the set-point timeout of the
+/// modules, with margin for the latency of the bus.
+
+#define PM_SETPOINT_DEFAULT_REFRESH_MS  1000
+#define PM_SETPOINT_SIZE                2
+
+enum TPmSetpointObject
+{
+    PM_SETPOINT_VOLTAGE = 0,        // 2109
+    PM_SETPOINT_CURRENT,            // 210a
+    PM_SETPOINT_VOLTAGE_OFFSET,     // 210d
+    PM_SETPOINT_OBJECTS
+};
+
+typedef struct
+{
+    uint64_t    requested;          // Set() calls
+    uint64_t    suppressed;         // within the dead band
+    uint64_t    merged;             // replaced a value that was not written yet
+    uint64_t    written;            // changes written
+    uint64_t    refreshed;          // unchanged values written again
+    uint64_t    aborted;
+    uint64_t    repeatedAborts;     // aborted again after a retry of the same value
+}TPmSetpointStatistics;
+
+class CPmSetpointWriter
+{
+public:
+    explicit CPmSetpointWriter(ICoSdoClient& client)
+        : m_client(client)
+        , m_refreshMs(PM_SETPOINT_DEFAULT_REFRESH_MS)
+        , m_budget(0)
+        , m_next(0)
+        , m_stopped(0)
+    {
+        memset(m_entries, 0, sizeof(m_entries));
+        memset(m_deadBand, 0, sizeof(m_deadBand));
+        memset(&m_statistics, 0, sizeof(m_statistics));
+    }
+
+    void SetRefresh(uint32_t refreshMs) { m_refreshMs = refreshMs; }
+
+    /// Dead band in units of the object, 0 suppresses only equal values
+    void SetDeadBand(TPmSetpointObject object, uint16_t deadBand) { m_deadBand[object] = deadBand; }
+
+    /// Maximum writes per Poll(), 0 is unlimited
+    void SetBudget(unsigned writes) { m_budget = writes; }
+
+    static uint16_t Index(TPmSetpointObject object)
+    {
+        static const uint16_t s_index[PM_SETPOINT_OBJECTS] = { PM_SDO_DC_OUTPUT_U_SETPOINT, PM_SDO_DC_OUTPUT_I_SETPOINT,
+                                                               PM_SDO_VOLTAGE_SETPOINT_OFFSET };
+
+        return s_index[object];
+    }
+
+    void Set(uint8_t node, TPmSetpointObject object, uint16_t value)
+    {
+        TEntry& e = m_entries[node & COPM_MAX_NODE_ID][object];
+        int     delta = (int)value - (int)e.written;
+
+        m_statistics.requested++;
+
+        if (e.dirty)
+        {
+            m_statistics.merged++;
+        }
+
+        // A new value may be accepted where the aborted one was not
+        if (value != e.value)
+        {
+            e.held   = false;
+            e.aborts = 0;
+        }
+
+        e.value = value;
+        e.used  = true;
+
+        if (e.known && (delta <= m_deadBand[object]) && (-delta <= m_deadBand[object]))
+        {
+            e.dirty = false;
+            m_statistics.suppressed++;
+            return;
+        }
+
+        e.dirty = true;
+    }
+
+    /// Stops writing and refreshing the set-points of a node, e.g. when it is switched off
+    void Release(uint8_t node)
+    {
+        memset(m_entries[node & COPM_MAX_NODE_ID], 0, sizeof(m_entries[0]));
+    }
+
+    /// A write that was aborted is repeated one refresh interval after the aborted
+    /// write, or by the next Poll() after Set() changed the value, so a module that keeps
+    /// rejecting a value is not flooded. The module does not hold the rejected value, so
+    /// it is no longer known: Set() can not suppress the retry within the dead band and
+    /// the refresh interval starts again with the retry.
+    bool OnSdoAbort(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        int object = Object(index);
+
+        if ((object < 0) || (subIndex != 0) || !m_entries[node & COPM_MAX_NODE_ID][object].used)
+        {
+            return false;
+        }
+
+        TEntry& e = m_entries[node & COPM_MAX_NODE_ID][object];
+
+        if (e.aborts)
+        {
+            m_statistics.repeatedAborts++;
+        }
+
+        e.dirty  = true;
+        e.known  = false;
+        e.held   = true;
+        e.aborts = (e.aborts < UINT8_MAX) ? (uint8_t)(e.aborts + 1) : e.aborts;
+        m_statistics.aborted++;
+
+        return true;
+    }
+
+    /// Writes the refreshes that are due, then the changes; returns the number of writes
+    unsigned Poll(uint64_t nowMs)
+    {
+        unsigned writes = 0;
+        bool     full   = false;
+
+        // Refreshes first, they keep the modules running
+        for (unsigned i = 0; !full && (i < ENTRIES); i++)
+        {
+            unsigned slot = (m_next + i) % ENTRIES;
+            TEntry&  e    = Entry(slot);
+
+            if (e.used && e.known && (nowMs - e.writtenMs >= m_refreshMs))
+            {
+                full = !Write(slot, nowMs, writes);
+            }
+        }
+
+        for (unsigned i = 0; !full && (i < ENTRIES); i++)
+        {
+            unsigned slot = (m_next + i) % ENTRIES;
+            TEntry&  e    = Entry(slot);
+
+            // writtenMs is the time of the aborted write while held
+            if (e.dirty && (!e.held || (nowMs - e.writtenMs >= m_refreshMs)))
+            {
+                full = !Write(slot, nowMs, writes);
+            }
+        }
+
+        // The next Poll() starts where this one stopped
+        m_next = full ? m_stopped : m_next;
+
+        return writes;
+    }
+
+    const TPmSetpointStatistics& Statistics() const { return m_statistics; }
+
+private:
+    enum { ENTRIES = (COPM_MAX_NODE_ID + 1) * PM_SETPOINT_OBJECTS };
+
+    struct TEntry
+    {
+        uint64_t    writtenMs;
+        uint16_t    value;          // wanted
+        uint16_t    written;        // last written
+        bool        used;
+        bool        known;          // written at least once
+        bool        dirty;          // value has to be written
+        bool        held;           // aborted, waits for the retry
+        uint8_t     aborts;         // of this value
+    };
+
+    static int Object(uint16_t index)
+    {
+        for (unsigned object = 0; object < PM_SETPOINT_OBJECTS; object++)
+        {
+            if (Index((TPmSetpointObject)object) == index)
+            {
+                return (int)object;
+            }
+        }
+
+        return -1;
+    }
+
+    TEntry& Entry(unsigned slot)
+    {
+        return m_entries[slot / PM_SETPOINT_OBJECTS][slot % PM_SETPOINT_OBJECTS];
+    }
+
+    /// False when the budget is used up or the stack does not accept the write
+    bool Write(unsigned slot, uint64_t nowMs, unsigned& writes)
+    {
+        TEntry&           e      = Entry(slot);
+        TPmSetpointObject object = (TPmSetpointObject)(slot % PM_SETPOINT_OBJECTS);
+
+        if ((m_budget && (writes >= m_budget)) ||
+            !m_client.SdoWrite(CoSdoAccess((uint8_t)(slot / PM_SETPOINT_OBJECTS), Index(object), 0,
+                                           PM_SETPOINT_SIZE, e.value)))
+        {
+            m_stopped = slot;
+            return false;
+        }
+
+        if (e.dirty)
+        {
+            m_statistics.written++;
+        }
+        else
+        {
+            m_statistics.refreshed++;
+        }
+
+        e.written   = e.value;
+        e.writtenMs = nowMs;
+        e.known     = true;
+        e.dirty     = false;
+        e.held      = false;
+        writes++;
+
+        return true;
+    }
+
+    ICoSdoClient&           m_client;
+    uint32_t                m_refreshMs;
+    unsigned                m_budget;
+    unsigned                m_next;
+    unsigned                m_stopped;
+    uint16_t                m_deadBand[PM_SETPOINT_OBJECTS];
+    TEntry                  m_entries[COPM_MAX_NODE_ID + 1][PM_SETPOINT_OBJECTS];
+    TPmSetpointStatistics   m_statistics;
+};
+
+#endif // __INTERFACE_COPM_SETPOINT_H__
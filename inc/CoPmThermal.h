@@ -0,0 +1,257 @@
+#ifndef __INTERFACE_COPM_THERMAL_H__
+#define __INTERFACE_COPM_THERMAL_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "CoPm.h"
+#include "CoSdo.h"
+
+/// # Thermal model
+///
+/// Fits a first order thermal model per power module while it runs and forecasts the
+/// temperature headroom of PM_SDO_CONV_TEMP (2104), e.g. to reduce the set-point
+/// before the module derates by itself.
+///
+///     h[k+1] = a * h[k] + b * P[k] + c * F[k] + d
+///
+/// | Symbol | Value                                                        |
+/// |--------|--------------------------------------------------------------|
+/// | h      | headroom until OTP [°C], 2104 bits 0..9                      |
+/// | P      | output power [kW]                                            |
+/// | F      | fan PWM set with PM_SDO_FAN_SPEED (2113) [0..1]              |
+/// | d      | ambient and losses that do not depend on P                   |
+///
+/// The parameters are estimated with recursive least squares with exponential
+/// forgetting, so the model follows ageing and changes of the ambient temperature.
+/// Sample() must be called once per period with the latest values; an update takes a
+/// few dozen multiplications, so a site of 100 modules is updated in a few
+/// microseconds. A gap of more than two periods restarts the regression, not the
+/// model.
+///
+/// Forecast() holds P and F and solves the model in closed form: the headroom N
+/// minutes ahead, the steady state headroom and the minutes until derating starts
+/// (25 °C headroom, derating type 1 of 2104). The hottest measured temperature
+/// (2112) and the hottest firmware prediction (2116) are kept for the report.
+
+#define PM_THERMAL_PARAMETERS           4
+#define PM_THERMAL_DEFAULT_PERIOD_MS    10000
+#define PM_THERMAL_DEFAULT_FORGETTING   0.998
+#define PM_THERMAL_INITIAL_COVARIANCE   1000.0
+#define PM_THERMAL_MAX_COVARIANCE       1.0e6   // trace that restarts the estimation
+#define PM_THERMAL_MIN_SAMPLES          20      // before a forecast is made
+#define PM_THERMAL_DERATE_HEADROOM      25.0    // °C, start of derating slope 1
+#define PM_THERMAL_HEADROOM_SCALE       0.1     // °C per LSB
+#define PM_THERMAL_DERATE_SHIFT         14
+
+typedef struct
+{
+    bool        valid;              // enough samples and a stable model
+    double      headroom;           // °C, last sample
+    double      headroomAhead;      // °C, after the requested minutes
+    double      steadyState;        // °C, with the current power and fan
+    double      minutesToDerate;    // -1 when derating is not reached
+    uint8_t     derateType;         // 2104 bits 14..15 of the last sample
+    uint16_t    maxMeasured;        // 0.1 °C, hottest sensor of 2112
+    uint16_t    maxPredicted;       // 0.1 °C, hottest prediction of 2116
+    double      parameters[PM_THERMAL_PARAMETERS];  // a, b, c, d
+    uint32_t    samples;
+}TPmThermalForecast;
+
+class CPmThermalModel
+{
+public:
+    CPmThermalModel()
+        : m_periodMs(PM_THERMAL_DEFAULT_PERIOD_MS)
+        , m_forgetting(PM_THERMAL_DEFAULT_FORGETTING)
+    {
+        memset(m_modules, 0, sizeof(m_modules));
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            Reset((uint8_t)node);
+        }
+    }
+
+    void SetPeriod(uint32_t periodMs) { m_periodMs = periodMs; }
+
+    void SetForgetting(double lambda) { m_forgetting = lambda; }
+
+    /// Forgets the model, e.g. after a fan or firmware change
+    void Reset(uint8_t node)
+    {
+        TModule& m = m_modules[node & COPM_MAX_NODE_ID];
+
+        memset(m.theta, 0, sizeof(m.theta));
+        memset(m.p, 0, sizeof(m.p));
+
+        for (unsigned i = 0; i < PM_THERMAL_PARAMETERS; i++)
+        {
+            m.p[i][i] = PM_THERMAL_INITIAL_COVARIANCE;
+        }
+
+        m.samples = 0;
+        m.primed  = false;
+    }
+
+    /// Adds the sample of one period: 2104 as read, output power [W] and fan PWM [0..1]
+    void Sample(uint8_t node, uint16_t convTemp, double powerW, double fanPwm, uint64_t nowMs)
+    {
+        TModule& m        = m_modules[node & COPM_MAX_NODE_ID];
+        double   headroom = (convTemp & PM_SDO_CONV_TEMP_MASK) * PM_THERMAL_HEADROOM_SCALE;
+        double   x[PM_THERMAL_PARAMETERS];
+
+        if (m.primed && (nowMs - m.lastMs <= 2 * (uint64_t)m_periodMs))
+        {
+            x[0] = m.headroom;
+            x[1] = m.powerKw;
+            x[2] = m.fan;
+            x[3] = 1.0;
+            Update(m, x, headroom);
+        }
+
+        m.headroom   = headroom;
+        m.powerKw    = powerW / 1000.0;
+        m.fan        = fanPwm;
+        m.derateType = (uint8_t)(convTemp >> PM_THERMAL_DERATE_SHIFT);
+        m.lastMs     = nowMs;
+        m.primed     = true;
+    }
+
+    /// Keeps the hottest value of 2112 and 2116 since the last Forecast()
+    bool OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex, const uint8_t* data, unsigned size)
+    {
+        if ((size < 2) || (subIndex == 0) ||
+            ((index != PM_SDO_MEASUREMENTS_TEMPERATURE) && (index != PM_SDO_TEMPERATURE_PREDICTIONS)))
+        {
+            return false;
+        }
+
+        TModule&  m     = m_modules[node & COPM_MAX_NODE_ID];
+        uint16_t  value = CoGetLe16(data);
+        uint16_t& max   = (index == PM_SDO_MEASUREMENTS_TEMPERATURE) ? m.maxMeasured : m.maxPredicted;
+
+        max = (value > max) ? value : max;
+
+        return true;
+    }
+
+    TPmThermalForecast Forecast(uint8_t node, double minutes)
+    {
+        TModule&           m = m_modules[node & COPM_MAX_NODE_ID];
+        TPmThermalForecast forecast;
+        double             a = m.theta[0];
+
+        forecast.headroom        = m.headroom;
+        forecast.headroomAhead   = m.headroom;
+        forecast.steadyState     = m.headroom;
+        forecast.minutesToDerate = -1;
+        forecast.derateType      = m.derateType;
+        forecast.maxMeasured     = m.maxMeasured;
+        forecast.maxPredicted    = m.maxPredicted;
+        forecast.samples         = m.samples;
+        memcpy(forecast.parameters, m.theta, sizeof(forecast.parameters));
+
+        m.maxMeasured  = 0;
+        m.maxPredicted = 0;
+
+        // A stable first order model has 0 < a < 1
+        forecast.valid = (m.samples >= PM_THERMAL_MIN_SAMPLES) && (a > 0.0) && (a < 1.0);
+
+        if (!forecast.valid)
+        {
+            return forecast;
+        }
+
+        double steps  = minutes * 60000.0 / (double)m_periodMs;
+        double input  = m.theta[1] * m.powerKw + m.theta[2] * m.fan + m.theta[3];
+        double steady = input / (1.0 - a);
+
+        forecast.steadyState   = steady;
+        forecast.headroomAhead = steady + (m.headroom - steady) * pow(a, steps);
+
+        if (m.headroom <= PM_THERMAL_DERATE_HEADROOM)
+        {
+            forecast.minutesToDerate = 0;
+        }
+        else if (steady < PM_THERMAL_DERATE_HEADROOM)
+        {
+            double n = log((PM_THERMAL_DERATE_HEADROOM - steady) / (m.headroom - steady)) / log(a);
+
+            forecast.minutesToDerate = n * (double)m_periodMs / 60000.0;
+        }
+
+        return forecast;
+    }
+
+private:
+    struct TModule
+    {
+        double      theta[PM_THERMAL_PARAMETERS];
+        double      p[PM_THERMAL_PARAMETERS][PM_THERMAL_PARAMETERS];
+        double      headroom;
+        double      powerKw;
+        double      fan;
+        uint64_t    lastMs;
+        uint32_t    samples;
+        uint16_t    maxMeasured;
+        uint16_t    maxPredicted;
+        uint8_t     derateType;
+        bool        primed;
+    };
+
+    void Update(TModule& m, const double* x, double y)
+    {
+        double px[PM_THERMAL_PARAMETERS];
+        double denominator = m_forgetting;
+        double error       = y;
+        double trace       = 0;
+
+        for (unsigned i = 0; i < PM_THERMAL_PARAMETERS; i++)
+        {
+            px[i] = 0;
+
+            for (unsigned j = 0; j < PM_THERMAL_PARAMETERS; j++)
+            {
+                px[i] += m.p[i][j] * x[j];
+            }
+
+            denominator += x[i] * px[i];
+            error       -= m.theta[i] * x[i];
+        }
+
+        for (unsigned i = 0; i < PM_THERMAL_PARAMETERS; i++)
+        {
+            m.theta[i] += px[i] / denominator * error;
+
+            // P is symmetric, so P x x' P = px px'
+            for (unsigned j = 0; j < PM_THERMAL_PARAMETERS; j++)
+            {
+                m.p[i][j] = (m.p[i][j] - px[i] * px[j] / denominator) / m_forgetting;
+            }
+
+            trace += m.p[i][i];
+        }
+
+        m.samples++;
+
+        // Without excitation (constant power and fan) the forgetting inflates P
+        if (!(trace < PM_THERMAL_MAX_COVARIANCE))
+        {
+            for (unsigned i = 0; i < PM_THERMAL_PARAMETERS; i++)
+            {
+                for (unsigned j = 0; j < PM_THERMAL_PARAMETERS; j++)
+                {
+                    m.p[i][j] = (i == j) ? PM_THERMAL_INITIAL_COVARIANCE : 0.0;
+                }
+            }
+        }
+    }
+
+    uint32_t    m_periodMs;
+    double      m_forgetting;
+    TModule     m_modules[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COPM_THERMAL_H__
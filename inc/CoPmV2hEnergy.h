@@ -0,0 +1,291 @@
+#ifndef __INTERFACE_COPM_V2H_ENERGY_H__
+#define __INTERFACE_COPM_V2H_ENERGY_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "CoPm.h"
+#include "CoPmAcMeter.h"
+
+/// # V2H energy accounting
+///
+/// Integrates the signed acpower of PM_PDO_2 of one bidirectional module
+/// (PM_SDO_V2H_MODE = 1) over a session. Positive power is charging, negative power
+/// is discharging; SetPowerScale() sets the W per LSB and a negative scale swaps the
+/// direction.
+///
+/// Between two samples the power is integrated as a trapezoid over the actual time
+/// difference. When the sign changes the trapezoid is split at the zero crossing, so
+/// the charged and discharged energy are each exact for a linear power curve. An
+/// interval longer than the maximum gap (lost PDOs, bus off) is not integrated but
+/// counted as a gap. The sums use compensated (Neumaier) summation, so a session of
+/// millions of samples loses no precision.
+///
+/// The power distribution is kept in a log-bucket sketch of fixed size, weighted by
+/// the time of the interval: every percentile is within PM_V2H_SKETCH_ACCURACY of the
+/// true value. CrossCheck() compares the integrated energy with the increase of the
+/// PM_SDO_AC_ENERGY (2122) counters of the module during the session.
+///
+/// A session takes about 10 kB, independent of its length.
+
+#define PM_V2H_DEFAULT_POWER_SCALE      1.0     // W per LSB of acpower
+#define PM_V2H_DEFAULT_MAX_GAP_MS       5000
+#define PM_V2H_SKETCH_GAMMA             1.02    // bucket ratio
+#define PM_V2H_SKETCH_ACCURACY          0.01    // (gamma - 1) / (gamma + 1)
+#define PM_V2H_SKETCH_BUCKETS           600     // per sign, up to 1.02^600 W (144 kW)
+#define PM_V2H_CHECK_ABS_WH             2.0     // resolution of 2122 plus one sample
+#define PM_V2H_CHECK_REL                0.02
+
+/// Neumaier compensated sum
+typedef struct
+{
+    double      sum;
+    double      compensation;
+}TCoCompensatedSum;
+
+inline void CoCompensatedAdd(TCoCompensatedSum& s, double value)
+{
+    double t = s.sum + value;
+
+    if (fabs(s.sum) >= fabs(value))
+    {
+        s.compensation += (s.sum - t) + value;
+    }
+    else
+    {
+        s.compensation += (value - t) + s.sum;
+    }
+
+    s.sum = t;
+}
+
+inline double CoCompensatedValue(const TCoCompensatedSum& s)
+{
+    return s.sum + s.compensation;
+}
+
+typedef struct
+{
+    uint64_t    samples;
+    uint64_t    durationMs;         // integrated time
+    uint64_t    gapMs;              // time not integrated
+    uint32_t    gaps;
+    double      chargedWh;
+    double      dischargedWh;       // positive
+    double      netWh;              // charged - discharged
+    double      meanW;              // net energy / integrated time
+    double      minW;
+    double      maxW;
+    uint16_t    minFrequency;       // raw PM_PDO_2 frequency
+    uint16_t    maxFrequency;
+}TPmV2hSummary;
+
+typedef struct
+{
+    bool        valid;              // two meter readings exist
+    double      integratedChargedWh;
+    double      integratedDischargedWh;
+    uint64_t    meterChargedWh;     // increase of 2122[1]
+    uint64_t    meterDischargedWh;  // increase of 2122[2]
+    double      chargedError;       // integrated - meter [Wh]
+    double      dischargedError;
+    bool        ok;                 // both errors within the tolerance
+}TPmV2hCrossCheck;
+
+class CPmV2hSession
+{
+public:
+    CPmV2hSession()
+        : m_scale(PM_V2H_DEFAULT_POWER_SCALE)
+        , m_maxGapMs(PM_V2H_DEFAULT_MAX_GAP_MS)
+    {
+        Start();
+    }
+
+    void SetPowerScale(double wattPerLsb) { m_scale = wattPerLsb; }
+
+    void SetMaxGap(uint32_t maxGapMs) { m_maxGapMs = maxGapMs; }
+
+    /// Clears the session
+    void Start()
+    {
+        memset(&m_summary, 0, sizeof(m_summary));
+        memset(&m_charged, 0, sizeof(m_charged));
+        memset(&m_discharged, 0, sizeof(m_discharged));
+        memset(&m_meterCharged, 0, sizeof(m_meterCharged));
+        memset(&m_meterDischarged, 0, sizeof(m_meterDischarged));
+        memset(m_sketch, 0, sizeof(m_sketch));
+        m_sketchWeight  = 0;
+        m_meterReadings = 0;
+        m_lastMs        = 0;
+        m_lastW         = 0;
+    }
+
+    void OnPdo2(const PM_PDO_2& pdo, uint64_t nowMs)
+    {
+        Add(nowMs, pdo.acpower, pdo.frequency);
+    }
+
+    void Add(uint64_t nowMs, int16_t acpower, uint16_t frequency = 0)
+    {
+        double power = acpower * m_scale;
+
+        if (m_summary.samples)
+        {
+            uint64_t dt = nowMs - m_lastMs;
+
+            if ((nowMs < m_lastMs) || (dt > m_maxGapMs))
+            {
+                m_summary.gaps++;
+                m_summary.gapMs += (nowMs > m_lastMs) ? dt : 0;
+            }
+            else if (dt)
+            {
+                Integrate(m_lastW, power, (double)dt);
+                m_summary.durationMs += dt;
+                Record(power, dt);
+            }
+        }
+
+        m_summary.minW         = (!m_summary.samples || (power < m_summary.minW)) ? power : m_summary.minW;
+        m_summary.maxW         = (!m_summary.samples || (power > m_summary.maxW)) ? power : m_summary.maxW;
+        m_summary.minFrequency = (!m_summary.samples || (frequency < m_summary.minFrequency)) ? frequency : m_summary.minFrequency;
+        m_summary.maxFrequency = (!m_summary.samples || (frequency > m_summary.maxFrequency)) ? frequency : m_summary.maxFrequency;
+        m_summary.samples++;
+        m_lastMs = nowMs;
+        m_lastW  = power;
+    }
+
+    /// Reading of 2122[1..2], the first reading of the session is the base
+    void OnMeter(uint16_t chargedWh, uint16_t dischargedWh)
+    {
+        PmExtendCounter16(m_meterCharged, chargedWh);
+        PmExtendCounter16(m_meterDischarged, dischargedWh);
+        m_meterReadings++;
+    }
+
+    TPmV2hSummary Summary() const
+    {
+        TPmV2hSummary summary = m_summary;
+
+        summary.chargedWh    = CoCompensatedValue(m_charged) / 3600000.0;
+        summary.dischargedWh = CoCompensatedValue(m_discharged) / 3600000.0;
+        summary.netWh        = summary.chargedWh - summary.dischargedWh;
+        summary.meanW        = summary.durationMs ? summary.netWh * 3600000.0 / (double)summary.durationMs : 0.0;
+
+        return summary;
+    }
+
+    /// Power [W] below which the given fraction of the integrated time was spent
+    double Percentile(double fraction) const
+    {
+        uint64_t rank = (uint64_t)((double)m_sketchWeight * fraction);
+        uint64_t seen = 0;
+
+        if (!m_sketchWeight)
+        {
+            return 0.0;
+        }
+
+        for (int b = -PM_V2H_SKETCH_BUCKETS; b <= PM_V2H_SKETCH_BUCKETS; b++)
+        {
+            seen += m_sketch[b + PM_V2H_SKETCH_BUCKETS];
+
+            if (seen > rank)
+            {
+                return BucketValue(b);
+            }
+        }
+
+        return m_summary.maxW;
+    }
+
+    TPmV2hCrossCheck CrossCheck(double absWh = PM_V2H_CHECK_ABS_WH, double rel = PM_V2H_CHECK_REL) const
+    {
+        TPmV2hCrossCheck check;
+        TPmV2hSummary    summary = Summary();
+
+        check.valid                  = m_meterReadings >= 2;
+        check.integratedChargedWh    = summary.chargedWh;
+        check.integratedDischargedWh = summary.dischargedWh;
+        check.meterChargedWh         = m_meterCharged.total;
+        check.meterDischargedWh      = m_meterDischarged.total;
+        check.chargedError           = summary.chargedWh - (double)m_meterCharged.total;
+        check.dischargedError        = summary.dischargedWh - (double)m_meterDischarged.total;
+        check.ok = check.valid &&
+                   (fabs(check.chargedError) <= absWh + rel * (double)m_meterCharged.total) &&
+                   (fabs(check.dischargedError) <= absWh + rel * (double)m_meterDischarged.total);
+
+        return check;
+    }
+
+private:
+    /// Adds the trapezoid between p0 and p1 [W] over dt [ms], in Wms
+    void Integrate(double p0, double p1, double dt)
+    {
+        if ((p0 >= 0) == (p1 >= 0))
+        {
+            CoCompensatedAdd((p0 >= 0) ? m_charged : m_discharged, fabs(p0 + p1) * dt / 2);
+        }
+        else
+        {
+            double t0 = dt * p0 / (p0 - p1);    // time of the zero crossing
+
+            CoCompensatedAdd((p0 >= 0) ? m_charged : m_discharged, fabs(p0) * t0 / 2);
+            CoCompensatedAdd((p1 >= 0) ? m_charged : m_discharged, fabs(p1) * (dt - t0) / 2);
+        }
+    }
+
+    void Record(double power, uint64_t weight)
+    {
+        m_sketch[Bucket(power) + PM_V2H_SKETCH_BUCKETS] += weight;
+        m_sketchWeight += weight;
+    }
+
+    /// 0 below 1 W, otherwise the signed bucket of |power|
+    static int Bucket(double power)
+    {
+        double magnitude = fabs(power);
+
+        if (magnitude < 1.0)
+        {
+            return 0;
+        }
+
+        int b = 1 + (int)ceil(log(magnitude) / log(PM_V2H_SKETCH_GAMMA));
+
+        b = (b > PM_V2H_SKETCH_BUCKETS) ? PM_V2H_SKETCH_BUCKETS : b;
+
+        return (power < 0) ? -b : b;
+    }
+
+    /// Value with the least relative error to every value of the bucket
+    static double BucketValue(int b)
+    {
+        if (b == 0)
+        {
+            return 0.0;
+        }
+
+        double value = 2.0 * pow(PM_V2H_SKETCH_GAMMA, abs(b) - 1) / (PM_V2H_SKETCH_GAMMA + 1.0);
+
+        return (b < 0) ? -value : value;
+    }
+
+    double              m_scale;
+    uint32_t            m_maxGapMs;
+    TPmV2hSummary       m_summary;
+    TCoCompensatedSum   m_charged;          // Wms
+    TCoCompensatedSum   m_discharged;       // Wms
+    TPmCounter16        m_meterCharged;
+    TPmCounter16        m_meterDischarged;
+    uint32_t            m_meterReadings;
+    uint64_t            m_sketch[2 * PM_V2H_SKETCH_BUCKETS + 1];
+    uint64_t            m_sketchWeight;     // ms
+    uint64_t            m_lastMs;
+    double              m_lastW;
+};
+
+#endif // __INTERFACE_COPM_V2H_ENERGY_H__
@@ -0,0 +1,258 @@
+#ifndef __INTERFACE_COREPLAY_H__
+#define __INTERFACE_COREPLAY_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoSdo.h"
+#include "CoTrace.h"
+
+/// # Replay
+///
+/// Feeds the frames of a mapped trace (CCoTraceReader) to a sink, decoded by
+/// CANopen function code. The payload is passed as a reference into the mapping, no
+/// frame is copied. The sink is a template parameter, so the calls are inlined and a
+/// replay is deterministic: the same trace always gives the same calls in the same
+/// order with the recorded timestamps.
+///
+/// | COB-ID        | Sink call                                   |
+/// |---------------|---------------------------------------------|
+/// | 0x180 + node  | OnPmStatus (PM_PDO_1) or OnPwbStatus (PWB_PDO_1) for nodes marked with SetBridge() |
+/// | 0x280 + node  | OnPmSignal (PM_PDO_2)                       |
+/// | 0x380 + node  | OnPmConstraint (TPmConstraint)              |
+/// | 0x580 + node  | OnSdoResponse / OnSdoAbort                  |
+/// | 0x600 + node  | OnSdoRequest                                |
+/// | other         | OnFrame                                     |
+///
+/// A sink derives from CCoReplaySink and hides the calls it needs; the results of
+/// uploads can be passed straight to e.g. CPwbBridgePollers or CPmDiscovery:
+///
+///     struct CSink : CCoReplaySink
+///     {
+///         void OnSdoResponse(uint8_t node, uint16_t index, uint8_t subIndex,
+///                            const uint8_t* data, unsigned size, uint64_t timestampNs)
+///         {
+///             pollers.OnSdoResponse(node, index, subIndex, data, size);
+///         }
+///     };
+///
+///     CCoReplay<CSink> replay(reader, sink);
+///     replay.Run();           // as fast as possible
+///     replay.Run(1.0);        // in real time
+///
+/// A PDO shorter than its structure or an SDO response shorter than 8 bytes is not
+/// passed to the sink; it is counted in Malformed().
+
+#define COREPLAY_COB_PDO1               0x180
+#define COREPLAY_COB_PDO2               0x280
+#define COREPLAY_COB_PDO3               0x380
+#define COREPLAY_COB_SDO_TX             0x580   // server to client
+#define COREPLAY_COB_SDO_RX             0x600   // client to server
+
+/// Default sink, ignores every frame
+struct CCoReplaySink
+{
+    void OnPmStatus(uint8_t, const PM_PDO_1&, uint64_t) {}
+    void OnPmSignal(uint8_t, const PM_PDO_2&, uint64_t) {}
+    void OnPmConstraint(uint8_t, const TPmConstraint&, uint64_t) {}
+    void OnPwbStatus(uint8_t, const PWB_PDO_1&, uint64_t) {}
+    void OnSdoResponse(uint8_t, uint16_t, uint8_t, const uint8_t*, unsigned, uint64_t) {}
+    void OnSdoAbort(uint8_t, uint16_t, uint8_t, uint32_t, uint64_t) {}
+    void OnSdoRequest(uint8_t, const TCoTraceFrame&) {}
+    void OnFrame(const TCoTraceFrame&) {}
+};
+
+template <typename Sink>
+class CCoReplay
+{
+public:
+    CCoReplay(const CCoTraceReader& reader, Sink& sink)
+        : m_reader(reader)
+        , m_sink(sink)
+        , m_position(0)
+        , m_malformed(0)
+    {
+        memset(m_bridges, 0, sizeof(m_bridges));
+    }
+
+    /// Marks a node as PowerBridge, its PDO_1 is passed to OnPwbStatus
+    void SetBridge(uint8_t node, bool bridge = true)
+    {
+        m_bridges[node & COPM_MAX_NODE_ID] = bridge;
+    }
+
+    /// Continues at the first frame at or after *timestampNs*
+    void Seek(uint64_t timestampNs) { m_position = m_reader.Seek(timestampNs); }
+
+    size_t Position() const { return m_position; }
+
+    bool Done() const { return m_position >= m_reader.Count(); }
+
+    /// Frames skipped because their payload is too short for their COB-ID
+    uint64_t Malformed() const { return m_malformed; }
+
+    /// Replays up to *count* frames as fast as possible, returns the number replayed
+    size_t Step(size_t count)
+    {
+        const TCoTraceFrame* frame = m_reader.Begin() + m_position;
+        const TCoTraceFrame* end   = m_reader.End();
+
+        if ((size_t)(end - frame) > count)
+        {
+            end = frame + count;
+        }
+
+        for (const TCoTraceFrame* f = frame; f < end; f++)
+        {
+            Dispatch(*f);
+        }
+
+        m_position += (size_t)(end - frame);
+
+        return (size_t)(end - frame);
+    }
+
+    /// Replays until *endNs* (exclusive) or the end of the trace. A *speed* of 0
+    /// replays as fast as possible, otherwise the recorded gaps are reproduced divided
+    /// by *speed*.
+    size_t Run(double speed = 0.0, uint64_t endNs = UINT64_MAX)
+    {
+        const TCoTraceFrame* begin = m_reader.Begin() + m_position;
+        const TCoTraceFrame* end   = m_reader.End();
+        const TCoTraceFrame* f     = begin;
+
+        if (speed <= 0.0)
+        {
+            for (; (f < end) && (f->timestampNs < endNs); f++)
+            {
+                Dispatch(*f);
+            }
+        }
+        else if (f < end)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            uint64_t                              first = f->timestampNs;
+
+            for (; (f < end) && (f->timestampNs < endNs); f++)
+            {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(
+                    (int64_t)((double)(f->timestampNs - first) / speed)));
+                Dispatch(*f);
+            }
+        }
+
+        m_position += (size_t)(f - begin);
+
+        return (size_t)(f - begin);
+    }
+
+    void Dispatch(const TCoTraceFrame& frame)
+    {
+        if (frame.flags & (COTRACE_FLAG_EXTENDED | COTRACE_FLAG_RTR | COTRACE_FLAG_ERROR))
+        {
+            m_sink.OnFrame(frame);
+            return;
+        }
+
+        uint8_t node = (uint8_t)(frame.id & COPM_MAX_NODE_ID);
+
+        switch (frame.id & 0x780)
+        {
+        case COREPLAY_COB_PDO1:
+            if (!Fits(frame, m_bridges[node] ? sizeof(PWB_PDO_1) : sizeof(PM_PDO_1)))
+            {
+                break;
+            }
+
+            if (m_bridges[node])
+            {
+                m_sink.OnPwbStatus(node, *(const PWB_PDO_1*)frame.data, frame.timestampNs);
+            }
+            else
+            {
+                m_sink.OnPmStatus(node, *(const PM_PDO_1*)frame.data, frame.timestampNs);
+            }
+            break;
+
+        case COREPLAY_COB_PDO2:
+            if (Fits(frame, sizeof(PM_PDO_2)))
+            {
+                m_sink.OnPmSignal(node, *(const PM_PDO_2*)frame.data, frame.timestampNs);
+            }
+            break;
+
+        case COREPLAY_COB_PDO3:
+            if (Fits(frame, sizeof(TPmConstraint)))
+            {
+                m_sink.OnPmConstraint(node, *(const TPmConstraint*)frame.data, frame.timestampNs);
+            }
+            break;
+
+        case COREPLAY_COB_SDO_TX:
+            if (Fits(frame, 8))
+            {
+                DispatchSdo(node, frame);
+            }
+            break;
+
+        case COREPLAY_COB_SDO_RX:
+            m_sink.OnSdoRequest(node, frame);
+            break;
+
+        default:
+            m_sink.OnFrame(frame);
+            break;
+        }
+    }
+
+private:
+    bool Fits(const TCoTraceFrame& frame, size_t size)
+    {
+        if (frame.dlc >= size)
+        {
+            return true;
+        }
+
+        m_malformed++;
+
+        return false;
+    }
+
+    void DispatchSdo(uint8_t node, const TCoTraceFrame& frame)
+    {
+        uint8_t  command  = frame.data[0];
+        uint16_t index    = CoGetLe16(&frame.data[1]);
+        uint8_t  subIndex = frame.data[3];
+
+        if (command == 0x80)
+        {
+            m_sink.OnSdoAbort(node, index, subIndex, CoGetLe32(&frame.data[4]), frame.timestampNs);
+        }
+        else if ((command & 0xe3) == 0x43)
+        {
+            // Expedited upload response, n = number of bytes without data
+            m_sink.OnSdoResponse(node, index, subIndex, &frame.data[4], 4u - ((command >> 2) & 3), frame.timestampNs);
+        }
+        else if ((command & 0xe3) == 0x42)
+        {
+            // Expedited upload response without size indication
+            m_sink.OnSdoResponse(node, index, subIndex, &frame.data[4], 4u, frame.timestampNs);
+        }
+        else
+        {
+            m_sink.OnFrame(frame);
+        }
+    }
+
+    const CCoTraceReader&   m_reader;
+    Sink&                   m_sink;
+    size_t                  m_position;
+    uint64_t                m_malformed;
+    bool                    m_bridges[COPM_MAX_NODE_ID + 1];
+};
+
+#endif // __INTERFACE_COREPLAY_H__
@@ -0,0 +1,74 @@
+#ifndef __INTERFACE_COSDO_H__
+#define __INTERFACE_COSDO_H__
+
+#include <stdint.h>
+
+/// # SDO access
+///
+/// Common description of a single expedited SDO transfer. The helpers built on top
+/// of CoPm and CoBridge use it to hand the objects that have to be written or read
+/// to the CANopen stack of the application.
+
+#define COPM_MAX_NODE_ID                127
+
+/// Expedited SDO access (download or upload) of one sub-index of one node.
+///
+/// | Field    | Description                                | Size   |
+/// |----------|--------------------------------------------|--------|
+/// | node     | CANopen node id (1..127)                   | uint8  |
+/// | index    | Object index, e.g. PWB_SDO_CONFIG_PM_GROUP | uint16 |
+/// | subIndex | Object sub-index                           | uint8  |
+/// | size     | Number of data bytes (1, 2 or 4)           | uint8  |
+/// | value    | Data, zero extended to 32 bits             | uint32 |
+
+typedef struct
+{
+    uint8_t     node;
+    uint16_t    index;
+    uint8_t     subIndex;
+    uint8_t     size;
+    uint32_t    value;
+}TCoSdoAccess;
+
+inline TCoSdoAccess CoSdoAccess(uint8_t node, uint16_t index, uint8_t subIndex, uint8_t size, uint32_t value)
+{
+    TCoSdoAccess access;
+
+    access.node     = node;
+    access.index    = index;
+    access.subIndex = subIndex;
+    access.size     = size;
+    access.value    = value;
+
+    return access;
+}
+
+inline uint16_t CoGetLe16(const uint8_t* data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+inline uint32_t CoGetLe32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/// Interface to the CANopen stack of the application.
+///
+/// Requests are only queued by the stack and must not block. The outcome of a read
+/// is passed back by the application to the helper that issued it, normally with an
+/// OnSdoResponse() or OnSdoAbort() method of that helper.
+
+class ICoSdoClient
+{
+public:
+    virtual ~ICoSdoClient() {}
+
+    /// Queues an upload, returns false when the request cannot be queued right now
+    virtual bool SdoRead(uint8_t node, uint16_t index, uint8_t subIndex) = 0;
+
+    /// Queues a download, returns false when the request cannot be queued right now
+    virtual bool SdoWrite(const TCoSdoAccess& access) = 0;
+};
+
+#endif // __INTERFACE_COSDO_H__
@@ -0,0 +1,373 @@
+#ifndef __INTERFACE_COSDO_SCHEDULER_H__
+#define __INTERFACE_COSDO_SCHEDULER_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+
+#include "CoPm.h"
+#include "CoBridge.h"
+#include "CoSdo.h"
+
+/// # SDO scheduler
+///
+/// Sits between the helpers (or the application) and the CANopen stack and decides
+/// which SDO request goes on the bus next. It is an ICoSdoClient itself, so every
+/// helper can use it in place of the stack.
+///
+/// | Class                | Scheduling      | Default objects                              |
+/// |----------------------|-----------------|----------------------------------------------|
+/// | COSDO_CLASS_SAFETY   | strict priority | writes of 2100, 2109, 210a, 210d, 210e, 2402 |
+/// | COSDO_CLASS_CONTROL  | weighted (8)    | other writes                                 |
+/// | COSDO_CLASS_MONITOR  | weighted (4)    | other reads                                  |
+/// | COSDO_CLASS_BULK     | weighted (1)    | 2130, 2ff3, 2ff4, 2440..2442                 |
+///
+/// A safety request is issued before any queued request of another class. The other
+/// classes share the rest by smooth weighted round robin, so bulk transfers progress
+/// but cannot starve the monitoring. Within a class the nodes are served round robin.
+///
+/// In flight limits: per node *nodeLimit* requests (1 for a stack with one SDO channel
+/// per node), on the bus *window* requests of which one is reserved for the safety
+/// class. A safety write therefore never waits behind queued traffic; at most it waits
+/// for the answer of the one expedited transfer that is already in flight to its node,
+/// a single frame.
+///
+/// The application reports the end of every transfer issued through the scheduler with
+/// OnSdoComplete() (response or abort) and calls Poll() regularly; a transfer without
+/// an answer is released after the timeout.
+
+#define COSDO_DEFAULT_WINDOW            8
+#define COSDO_DEFAULT_NODE_LIMIT        1
+#define COSDO_MAX_NODE_INFLIGHT         4
+#define COSDO_DEFAULT_TIMEOUT_MS        1000
+#define COSDO_MAX_QUEUED                4096    // per class
+
+enum TCoSdoClass
+{
+    COSDO_CLASS_SAFETY = 0,
+    COSDO_CLASS_CONTROL,
+    COSDO_CLASS_MONITOR,
+    COSDO_CLASS_BULK,
+    COSDO_CLASSES
+};
+
+inline const char* CoSdoClass2String(unsigned sdoClass)
+{
+    const char* retValue = "UNKNOWN";
+
+    switch (sdoClass)
+    {
+    case COSDO_CLASS_SAFETY:    retValue = "SAFETY"; break;
+    case COSDO_CLASS_CONTROL:   retValue = "CONTROL"; break;
+    case COSDO_CLASS_MONITOR:   retValue = "MONITOR"; break;
+    case COSDO_CLASS_BULK:      retValue = "BULK"; break;
+    }
+
+    return retValue;
+}
+
+/// Default class of a request
+inline TCoSdoClass CoSdoClassify(uint16_t index, bool write)
+{
+    switch (index)
+    {
+    case PM_SDO_CONV_ENABLE:
+    case PM_SDO_DC_OUTPUT_U_SETPOINT:
+    case PM_SDO_DC_OUTPUT_I_SETPOINT:
+    case PM_SDO_VOLTAGE_SETPOINT_OFFSET:
+    case PM_SDO_CONV_INHIBIT:
+    case PWB_SDO_INTERLINK_DC_CONTACTOR:
+        return write ? COSDO_CLASS_SAFETY : COSDO_CLASS_MONITOR;
+
+    case PM_SDO_NV_STATISTICS:
+    case PM_SDO_READ_EEPROM:
+    case PM_SDO_WRITE_EEPROM:
+    case PWB_SDO_UPDATE_START:
+    case PWB_SDO_UPDATE_STATUS:
+    case PWB_SDO_UPDATE_DATA_FRAME:
+        return COSDO_CLASS_BULK;
+    }
+
+    return write ? COSDO_CLASS_CONTROL : COSDO_CLASS_MONITOR;
+}
+
+typedef struct
+{
+    uint64_t    queued;
+    uint64_t    issued;
+    uint64_t    rejected;           // queue full
+    uint64_t    timeouts;
+    uint32_t    waiting;            // in the queue now
+}TCoSdoClassStatistics;
+
+class CCoSdoScheduler : public ICoSdoClient
+{
+public:
+    CCoSdoScheduler(ICoSdoClient& stack, unsigned window = COSDO_DEFAULT_WINDOW,
+                    unsigned nodeLimit = COSDO_DEFAULT_NODE_LIMIT)
+        : m_stack(stack)
+        , m_window(window > 1 ? window : 2)
+        , m_nodeLimit((nodeLimit < 1) ? 1 : (nodeLimit > COSDO_MAX_NODE_INFLIGHT ? COSDO_MAX_NODE_INFLIGHT : nodeLimit))
+        , m_timeoutMs(COSDO_DEFAULT_TIMEOUT_MS)
+        , m_inFlight(0)
+        , m_nowMs(0)
+    {
+        static const int s_weight[COSDO_CLASSES] = { 0, 8, 4, 1 };
+
+        memcpy(m_weight, s_weight, sizeof(m_weight));
+        memset(m_current, 0, sizeof(m_current));
+        memset(m_next, 0, sizeof(m_next));
+        memset(m_nodes, 0, sizeof(m_nodes));
+        memset(m_statistics, 0, sizeof(m_statistics));
+    }
+
+    /// Weight of a weighted class, at least 1
+    void SetWeight(TCoSdoClass sdoClass, int weight)
+    {
+        if (sdoClass != COSDO_CLASS_SAFETY)
+        {
+            m_weight[sdoClass] = (weight < 1) ? 1 : weight;
+        }
+    }
+
+    void SetTimeout(uint32_t timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    /// ICoSdoClient: queues with the default class
+    virtual bool SdoRead(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        return Read(CoSdoClassify(index, false), node, index, subIndex);
+    }
+
+    virtual bool SdoWrite(const TCoSdoAccess& access)
+    {
+        return Write(CoSdoClassify(access.index, true), access);
+    }
+
+    bool Read(TCoSdoClass sdoClass, uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        return Queue(sdoClass, CoSdoAccess(node, index, subIndex, 0, 0), false);
+    }
+
+    bool Write(TCoSdoClass sdoClass, const TCoSdoAccess& access)
+    {
+        return Queue(sdoClass, access, true);
+    }
+
+    /// Response or abort of a transfer issued by the scheduler
+    bool OnSdoComplete(uint8_t node, uint16_t index, uint8_t subIndex)
+    {
+        TNode& n = m_nodes[node & COPM_MAX_NODE_ID];
+
+        for (unsigned i = 0; i < n.inFlight; i++)
+        {
+            if ((n.transfers[i].index == index) && (n.transfers[i].subIndex == subIndex))
+            {
+                Release(n, i);
+                Dispatch();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Releases transfers without an answer and issues what is queued
+    void Poll(uint64_t nowMs)
+    {
+        m_nowMs = nowMs;
+
+        for (unsigned node = 0; node <= COPM_MAX_NODE_ID; node++)
+        {
+            TNode& n = m_nodes[node];
+
+            for (unsigned i = 0; i < n.inFlight; )
+            {
+                if (nowMs - n.transfers[i].startMs >= m_timeoutMs)
+                {
+                    m_statistics[n.transfers[i].sdoClass].timeouts++;
+                    Release(n, i);
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+
+        Dispatch();
+    }
+
+    /// Issues queued requests as long as the limits and the stack allow
+    unsigned Dispatch()
+    {
+        unsigned issued = 0;
+
+        for (;;)
+        {
+            int sdoClass = COSDO_CLASS_SAFETY;
+            int node     = Eligible(COSDO_CLASS_SAFETY);
+
+            if (node < 0)
+            {
+                sdoClass = Pick(node);
+            }
+
+            if ((sdoClass < 0) || (node < 0) || !Issue((TCoSdoClass)sdoClass, (uint8_t)node))
+            {
+                return issued;
+            }
+
+            issued++;
+        }
+    }
+
+    unsigned InFlight() const { return m_inFlight; }
+
+    const TCoSdoClassStatistics& Statistics(TCoSdoClass sdoClass) const { return m_statistics[sdoClass]; }
+
+private:
+    struct TRequest
+    {
+        TCoSdoAccess    access;
+        bool            write;
+    };
+
+    struct TTransfer
+    {
+        uint64_t    startMs;
+        uint16_t    index;
+        uint8_t     subIndex;
+        uint8_t     sdoClass;
+    };
+
+    struct TNode
+    {
+        unsigned    inFlight;
+        TTransfer   transfers[COSDO_MAX_NODE_INFLIGHT];
+    };
+
+    bool Queue(TCoSdoClass sdoClass, const TCoSdoAccess& access, bool write)
+    {
+        TCoSdoClassStatistics& statistics = m_statistics[sdoClass];
+
+        if (statistics.waiting >= COSDO_MAX_QUEUED)
+        {
+            statistics.rejected++;
+            return false;
+        }
+
+        TRequest request;
+
+        request.access = access;
+        request.write  = write;
+        m_queues[sdoClass][access.node & COPM_MAX_NODE_ID].push_back(request);
+        statistics.queued++;
+        statistics.waiting++;
+
+        Dispatch();
+
+        return true;
+    }
+
+    /// Next node of the class with a request and a free slot, -1 if none
+    int Eligible(unsigned sdoClass)
+    {
+        // One slot of the window is kept for the safety class
+        unsigned window = (sdoClass == COSDO_CLASS_SAFETY) ? m_window : m_window - 1;
+
+        if (!m_statistics[sdoClass].waiting || (m_inFlight >= window))
+        {
+            return -1;
+        }
+
+        for (unsigned i = 0; i <= COPM_MAX_NODE_ID; i++)
+        {
+            unsigned node = (m_next[sdoClass] + i) & COPM_MAX_NODE_ID;
+
+            if (!m_queues[sdoClass][node].empty() && (m_nodes[node].inFlight < m_nodeLimit))
+            {
+                return (int)node;
+            }
+        }
+
+        return -1;
+    }
+
+    /// Smooth weighted round robin over the weighted classes that can issue
+    int Pick(int& node)
+    {
+        int nodes[COSDO_CLASSES];
+        int total = 0;
+        int best  = -1;
+
+        for (unsigned c = COSDO_CLASS_SAFETY + 1; c < COSDO_CLASSES; c++)
+        {
+            nodes[c] = Eligible(c);
+
+            if (nodes[c] >= 0)
+            {
+                m_current[c] += m_weight[c];
+                total        += m_weight[c];
+                best          = ((best < 0) || (m_current[c] > m_current[best])) ? (int)c : best;
+            }
+        }
+
+        if (best >= 0)
+        {
+            m_current[best] -= total;
+            node = nodes[best];
+        }
+
+        return best;
+    }
+
+    bool Issue(TCoSdoClass sdoClass, uint8_t node)
+    {
+        std::deque<TRequest>& queue   = m_queues[sdoClass][node];
+        const TRequest&       request = queue.front();
+        bool                  queued  = request.write ? m_stack.SdoWrite(request.access) :
+                                                        m_stack.SdoRead(node, request.access.index, request.access.subIndex);
+
+        if (!queued)
+        {
+            return false;
+        }
+
+        TNode&     n        = m_nodes[node];
+        TTransfer& transfer = n.transfers[n.inFlight++];
+
+        transfer.startMs  = m_nowMs;
+        transfer.index    = request.access.index;
+        transfer.subIndex = request.access.subIndex;
+        transfer.sdoClass = (uint8_t)sdoClass;
+
+        queue.pop_front();
+        m_inFlight++;
+        m_next[sdoClass] = (uint8_t)((node + 1) & COPM_MAX_NODE_ID);
+        m_statistics[sdoClass].issued++;
+        m_statistics[sdoClass].waiting--;
+
+        return true;
+    }
+
+    void Release(TNode& n, unsigned i)
+    {
+        n.transfers[i] = n.transfers[--n.inFlight];
+        m_inFlight--;
+    }
+
+    ICoSdoClient&           m_stack;
+    unsigned                m_window;
+    unsigned                m_nodeLimit;
+    uint32_t                m_timeoutMs;
+    unsigned                m_inFlight;
+    uint64_t                m_nowMs;            // time of the last Poll()
+    int                     m_weight[COSDO_CLASSES];
+    int                     m_current[COSDO_CLASSES];
+    uint8_t                 m_next[COSDO_CLASSES];
+    TNode                   m_nodes[COPM_MAX_NODE_ID + 1];
+    std::deque<TRequest>    m_queues[COSDO_CLASSES][COPM_MAX_NODE_ID + 1];
+    TCoSdoClassStatistics   m_statistics[COSDO_CLASSES];
+};
+
+#endif // __INTERFACE_COSDO_SCHEDULER_H__
@@ -0,0 +1,105 @@
+#ifndef __INTERFACE_COSEQLOCK_H__
+#define __INTERFACE_COSEQLOCK_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+/// # Sequence lock
+///
+/// Single writer, many readers. The writer never waits; a reader copies the data and
+/// retries when the writer was active during the copy. T must be trivially copyable.
+/// The lock holds no pointers, so it can also be placed in shared memory.
+
+template <typename T>
+class CCoSeqLock
+{
+public:
+    CCoSeqLock()
+        : m_sequence(0)
+    {
+        memset(&m_data, 0, sizeof(m_data));
+    }
+
+    /// Starts a modification of the data in place, must be followed by EndWrite()
+    T& BeginWrite()
+    {
+        uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        return m_data;
+    }
+
+    void EndWrite()
+    {
+        m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void Write(const T& data)
+    {
+        memcpy(&BeginWrite(), &data, sizeof(T));
+        EndWrite();
+    }
+
+    /// Copies a consistent snapshot, returns the (even) sequence number of the copy.
+    /// Waits as long as the writer is active, see TryRead() when it may have died.
+    uint32_t Read(T& data) const
+    {
+        uint32_t sequence;
+
+        while (!Copy(data, sequence))
+        {
+        }
+
+        return sequence;
+    }
+
+    /// Like Read(), but gives up after *maxRetries* copies that overlapped a write,
+    /// e.g. when the writer died between BeginWrite() and EndWrite()
+    bool TryRead(T& data, unsigned maxRetries, uint32_t* sequence = 0) const
+    {
+        uint32_t copied;
+
+        for (unsigned retry = 0; retry <= maxRetries; retry++)
+        {
+            if (Copy(data, copied))
+            {
+                if (sequence)
+                {
+                    *sequence = copied;
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Number of completed writes
+    uint32_t Version() const
+    {
+        return m_sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+private:
+    /// One attempt, false when the writer was active during the copy
+    bool Copy(T& data, uint32_t& sequence) const
+    {
+        uint32_t before = m_sequence.load(std::memory_order_acquire);
+
+        memcpy(&data, (const void*)&m_data, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        sequence = before;
+
+        return !(before & 1) && (before == m_sequence.load(std::memory_order_relaxed));
+    }
+
+    std::atomic<uint32_t>   m_sequence;
+    T                       m_data;
+};
+
+#endif // __INTERFACE_COSEQLOCK_H__
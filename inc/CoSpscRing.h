@@ -0,0 +1,83 @@
+#ifndef __INTERFACE_COSPSCRING_H__
+#define __INTERFACE_COSPSCRING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/// # Single producer, single consumer ring
+///
+/// Lock-free and wait-free for both sides. The producer never blocks: Push() fails
+/// when the ring is full. The capacity is rounded up to a power of two. T must be
+/// trivially copyable.
+
+template <typename T>
+class CCoSpscRing
+{
+public:
+    explicit CCoSpscRing(size_t capacity)
+        : m_head(0)
+        , m_tail(0)
+    {
+        size_t size = 2;
+
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    size_t Capacity() const { return m_mask + 1; }
+
+    /// Producer: returns false when the ring is full
+    bool Push(const T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head - m_tail.load(std::memory_order_acquire) > m_mask)
+        {
+            return false;
+        }
+
+        m_items[head & m_mask] = item;
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /// Consumer: copies up to *max* items, returns the number copied
+    size_t Pop(T* items, size_t max)
+    {
+        size_t tail  = m_tail.load(std::memory_order_relaxed);
+        size_t count = m_head.load(std::memory_order_acquire) - tail;
+
+        count = (count < max) ? count : max;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            items[i] = m_items[(tail + i) & m_mask];
+        }
+
+        m_tail.store(tail + count, std::memory_order_release);
+
+        return count;
+    }
+
+    bool Empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Head and tail on their own cache line, so producer and consumer do not share one
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    alignas(64) size_t              m_mask;
+    std::vector<T>                  m_items;
+};
+
+#endif // __INTERFACE_COSPSCRING_H__
@@ -0,0 +1,317 @@
+#ifndef __INTERFACE_COTIMER_WHEEL_H__
+#define __INTERFACE_COTIMER_WHEEL_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/// # Timer wheel
+///
+/// Hierarchical timer wheel for many periodic deadlines on one thread, e.g. keepalive
+/// writes and node liveness timeouts. The timers are intrusive: the application
+/// derives from CCoTimer and owns the object, the wheel only links it, so scheduling
+/// allocates nothing and Schedule() and Cancel() are O(1).
+///
+/// | Level | Slots | Span per slot   | Span of the level (1 ms tick) |
+/// |-------|-------|-----------------|-------------------------------|
+/// | 0     | 64    | 1 tick          | 64 ms                         |
+/// | 1     | 64    | 64 ticks        | 4.1 s                         |
+/// | 2     | 64    | 4096 ticks      | 4.4 min                       |
+/// | 3     | 64    | 262144 ticks    | 4.7 h                         |
+///
+/// A timer further away waits in the last slot of level 3 and is placed again when
+/// that slot is reached. Advance() moves the wheel to the current time and calls
+/// OnTimer() of every expired timer with the time it is late, so the caller can
+/// report missed deadlines. A timer may be scheduled again from its own OnTimer().
+/// Advance() jumps over the ticks where no slot expires or cascades, so its cost
+/// depends on the occupied slots, not on the time since the last call.
+///
+/// A timer that is destroyed while scheduled cancels itself, and the wheel unlinks
+/// the timers still scheduled when it is destroyed. An owner still declares the
+/// wheel after its timers, so the wheel goes first and never sees a destroyed timer.
+
+#define COTIMER_SLOT_BITS               6
+#define COTIMER_SLOTS                   (1 << COTIMER_SLOT_BITS)
+#define COTIMER_LEVELS                  4
+
+class CCoTimerWheel;
+
+class CCoTimer
+{
+public:
+    CCoTimer()
+        : m_wheel(0)
+        , m_next(0)
+        , m_prev(0)
+        , m_expiresMs(0)
+        , m_tick(0)
+    {
+    }
+
+    inline virtual ~CCoTimer();
+
+    bool Scheduled() const { return m_prev != 0; }
+
+    uint64_t ExpiresMs() const { return m_expiresMs; }
+
+    /// Called by CCoTimerWheel::Advance(), *lateMs* is the time since the expiry
+    virtual void OnTimer(uint64_t nowMs, uint64_t lateMs) = 0;
+
+private:
+    friend class CCoTimerWheel;
+
+    CCoTimerWheel*  m_wheel;        // 0 when not scheduled, always 0 for a list head
+    CCoTimer*       m_next;
+    CCoTimer*       m_prev;         // 0 when not scheduled
+    uint64_t        m_expiresMs;
+    uint64_t        m_tick;
+};
+
+class CCoTimerWheel
+{
+public:
+    explicit CCoTimerWheel(uint64_t nowMs, uint32_t tickMs = 1)
+        : m_tickMs(tickMs ? tickMs : 1)
+        , m_tick(nowMs / (tickMs ? tickMs : 1))
+        , m_nowMs(nowMs)
+        , m_count(0)
+    {
+        for (unsigned level = 0; level < COTIMER_LEVELS; level++)
+        {
+            for (unsigned slot = 0; slot < COTIMER_SLOTS; slot++)
+            {
+                Head(level, slot).m_next = &Head(level, slot);
+                Head(level, slot).m_prev = &Head(level, slot);
+            }
+        }
+    }
+
+    ~CCoTimerWheel()
+    {
+        for (unsigned level = 0; level < COTIMER_LEVELS; level++)
+        {
+            for (unsigned slot = 0; slot < COTIMER_SLOTS; slot++)
+            {
+                while (Head(level, slot).m_next != &Head(level, slot))
+                {
+                    Unlink(*Head(level, slot).m_next);
+                }
+            }
+        }
+    }
+
+    /// (Re)schedules *timer*, a time in the past expires with the next Advance()
+    void Schedule(CCoTimer& timer, uint64_t expiresMs)
+    {
+        if (timer.Scheduled())
+        {
+            Unlink(timer);
+        }
+
+        timer.m_expiresMs = expiresMs;
+        timer.m_tick      = (expiresMs + m_tickMs - 1) / m_tickMs;
+        Insert(timer);
+        m_count++;
+    }
+
+    void Cancel(CCoTimer& timer)
+    {
+        if (timer.Scheduled())
+        {
+            Unlink(timer);
+        }
+    }
+
+    /// Expires the timers up to *nowMs*, returns the number of OnTimer() calls
+    unsigned Advance(uint64_t nowMs)
+    {
+        uint64_t target = nowMs / m_tickMs;
+        unsigned fired  = 0;
+
+        m_nowMs = nowMs;
+
+        while (m_tick < target)
+        {
+            // A short step is cheaper tick by tick than looking for the next occupied slot
+            uint64_t next = !m_count ? target + 1
+                          : (target - m_tick <= COTIMER_SLOTS) ? m_tick + 1 : Next();
+
+            if (next > target)
+            {
+                m_tick = target;
+                break;
+            }
+
+            // Nothing happens on the ticks in between
+            m_tick = next;
+
+            // Moves the timers of the next slot of a higher level down when a level wraps
+            for (unsigned level = 1; level < COTIMER_LEVELS; level++)
+            {
+                if ((m_tick & ((1ull << (COTIMER_SLOT_BITS * level)) - 1)) != 0)
+                {
+                    break;
+                }
+
+                Cascade(level, (unsigned)(m_tick >> (COTIMER_SLOT_BITS * level)) & (COTIMER_SLOTS - 1));
+            }
+
+            fired += Expire(Head(0, (unsigned)m_tick & (COTIMER_SLOTS - 1)), nowMs);
+        }
+
+        return fired;
+    }
+
+    unsigned Count() const { return m_count; }
+
+    uint64_t NowMs() const { return m_nowMs; }
+
+private:
+    /// List heads use the link fields of a CCoTimer only
+    class CHead : public CCoTimer
+    {
+    public:
+        virtual void OnTimer(uint64_t, uint64_t) {}
+    };
+
+    CCoTimer& Head(unsigned level, unsigned slot)
+    {
+        return m_slots[level][slot];
+    }
+
+    /// First tick after m_tick that expires or cascades a non-empty slot
+    uint64_t Next()
+    {
+        uint64_t next = ~0ull;
+
+        for (unsigned level = 0; level < COTIMER_LEVELS; level++)
+        {
+            unsigned shift = COTIMER_SLOT_BITS * level;
+            uint64_t base  = m_tick >> shift;
+
+            for (uint64_t k = 1; k <= COTIMER_SLOTS; k++)
+            {
+                uint64_t  tick = (base + k) << shift;
+                CCoTimer& head = Head(level, (unsigned)(base + k) & (COTIMER_SLOTS - 1));
+
+                if (tick >= next)
+                {
+                    break;
+                }
+
+                if (head.m_next != &head)
+                {
+                    next = tick;
+                    break;
+                }
+            }
+        }
+
+        return next;
+    }
+
+    void Insert(CCoTimer& timer)
+    {
+        uint64_t delta = (timer.m_tick > m_tick) ? timer.m_tick - m_tick : 0;
+        unsigned level = 0;
+
+        while ((level < COTIMER_LEVELS - 1) && (delta >= (1ull << (COTIMER_SLOT_BITS * (level + 1)))))
+        {
+            level++;
+        }
+
+        // Past the last level: park in the furthest slot, placed again when it is reached
+        uint64_t tick = (delta >= (1ull << (COTIMER_SLOT_BITS * COTIMER_LEVELS)))
+                        ? m_tick + (1ull << (COTIMER_SLOT_BITS * COTIMER_LEVELS)) - 1
+                        : ((delta == 0) ? m_tick + 1 : timer.m_tick);
+        unsigned slot = (unsigned)(tick >> (COTIMER_SLOT_BITS * level)) & (COTIMER_SLOTS - 1);
+
+        Link(timer, Head(level, slot));
+    }
+
+    void Link(CCoTimer& timer, CCoTimer& head)
+    {
+        timer.m_wheel        = this;
+        timer.m_next         = &head;
+        timer.m_prev         = head.m_prev;
+        head.m_prev->m_next  = &timer;
+        head.m_prev          = &timer;
+    }
+
+    void Unlink(CCoTimer& timer)
+    {
+        timer.m_prev->m_next = timer.m_next;
+        timer.m_next->m_prev = timer.m_prev;
+        timer.m_wheel        = 0;
+        timer.m_next         = 0;
+        timer.m_prev         = 0;
+        m_count--;
+    }
+
+    void Cascade(unsigned level, unsigned slot)
+    {
+        CCoTimer& head = Head(level, slot);
+        CCoTimer* list = head.m_next;
+
+        head.m_next = &head;
+        head.m_prev = &head;
+
+        while (list != &head)
+        {
+            CCoTimer* next = list->m_next;
+
+            // Due at the tick being processed: expire it with this tick, not the next
+            if (list->m_tick <= m_tick)
+            {
+                Link(*list, Head(0, (unsigned)m_tick & (COTIMER_SLOTS - 1)));
+            }
+            else
+            {
+                Insert(*list);
+            }
+
+            list = next;
+        }
+    }
+
+    unsigned Expire(CCoTimer& head, uint64_t nowMs)
+    {
+        unsigned fired = 0;
+
+        // OnTimer() may schedule again into this slot, so take one timer at a time
+        while (head.m_next != &head)
+        {
+            CCoTimer& timer = *head.m_next;
+
+            if (timer.m_tick > m_tick)
+            {
+                // Parked beyond the last level, place it again
+                Unlink(timer);
+                m_count++;
+                Insert(timer);
+                continue;
+            }
+
+            Unlink(timer);
+            timer.OnTimer(nowMs, (nowMs > timer.m_expiresMs) ? nowMs - timer.m_expiresMs : 0);
+            fired++;
+        }
+
+        return fired;
+    }
+
+    uint32_t    m_tickMs;
+    uint64_t    m_tick;         // last processed tick
+    uint64_t    m_nowMs;
+    unsigned    m_count;
+    CHead       m_slots[COTIMER_LEVELS][COTIMER_SLOTS];
+};
+
+inline CCoTimer::~CCoTimer()
+{
+    if (m_wheel)
+    {
+        m_wheel->Cancel(*this);
+    }
+}
+
+#endif // __INTERFACE_COTIMER_WHEEL_H__
@@ -0,0 +1,668 @@
+#ifndef __INTERFACE_COTRACE_H__
+#define __INTERFACE_COTRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CoSpscRing.h"
+
+/// # CAN trace
+///
+/// Binary recording of the CAN traffic (PDOs, SDO requests and responses) with fixed
+/// size records, so a trace can be mapped and used in place:
+///
+/// | Offset          | Description                                | Size                 |
+/// |-----------------|--------------------------------------------|----------------------|
+/// | 0               | TCoTraceHeader                             | 32                   |
+/// | 32              | Frames                                     | n \* TCoTraceFrame   |
+/// | 32 + 24 \* n    | Index: timestamp of every *interval* frame | (n + N - 1) / N \* 8 |
+/// | end - 24        | TCoTraceFooter                             | 24                   |
+///
+/// The records are stored as they are in memory, so all values are in the byte order
+/// of the recording host. The header holds COTRACE_BYTE_ORDER as written by that host;
+/// a reader with the other byte order rejects the trace. Frames are stored in order
+/// of arrival and stamped with CLOCK_MONOTONIC, so timestamps are ascending even when
+/// the system time is set back. The header holds *epochNs*, CLOCK_REALTIME -
+/// CLOCK_MONOTONIC at Open(): the wall time of a frame is timestampNs + epochNs. Imported traces keep the wall time of
+/// the log as timestamp, their epochNs is 0. The index and the footer are written by
+/// Close(); a trace that was not closed (e.g. after a power loss) is still readable,
+/// the frame count is then derived from the file size and Seek() searches the frames
+/// directly.
+///
+/// CCoTraceRecorder does not block the RX path: Push() copies the frame into a
+/// lock-free ring and a writer thread stores it. When the ring is full the frame is
+/// dropped and counted; frames the writer thread cannot store (e.g. disk full) are
+/// counted as failed and Stop() returns false.
+///
+/// CoTraceImportCandump() and CoTraceExportCandump() convert from and to the text
+/// format of `candump -L`:
+///
+///     (1436509052.249713) can0 181#0F0E5802A0000000
+
+#define COTRACE_MAGIC                   0x52544f43  // "COTR"
+#define COTRACE_FOOTER_MAGIC            0x58444e49  // "INDX"
+#define COTRACE_VERSION                 2
+#define COTRACE_BYTE_ORDER              0x01020304  // 04 03 02 01 in a little-endian trace
+#define COTRACE_DEFAULT_INTERVAL        1024
+#define COTRACE_DEFAULT_RING            65536
+
+enum TCoTraceFlags
+{
+    COTRACE_FLAG_EXTENDED   = 1 << 0,   // 29 bit identifier
+    COTRACE_FLAG_RTR        = 1 << 1,
+    COTRACE_FLAG_ERROR      = 1 << 2,   // error frame
+    COTRACE_FLAG_TX         = 1 << 3,   // sent by us
+};
+
+#pragma pack(1)
+
+typedef struct
+{
+    uint32_t    magic;          // COTRACE_MAGIC
+    uint16_t    version;        // COTRACE_VERSION
+    uint16_t    frameSize;      // sizeof(TCoTraceFrame)
+    uint32_t    interval;       // frames per index entry
+    uint32_t    byteOrder;      // COTRACE_BYTE_ORDER
+    uint64_t    startNs;        // time of Open(), CLOCK_REALTIME
+    uint64_t    epochNs;        // wall time - timestampNs, 0 for imported traces
+}TCoTraceHeader;
+
+typedef struct
+{
+    uint64_t    timestampNs;    // CLOCK_MONOTONIC, see epochNs
+    uint32_t    id;             // 11 or 29 bit identifier
+    uint8_t     dlc;
+    uint8_t     flags;          // TCoTraceFlags
+    uint8_t     channel;        // e.g. 0 for can0
+    uint8_t     reserved;
+    uint8_t     data[8];
+}TCoTraceFrame;
+
+typedef struct
+{
+    uint64_t    frameCount;
+    uint64_t    indexOffset;
+    uint32_t    reserved;
+    uint32_t    magic;          // COTRACE_FOOTER_MAGIC
+}TCoTraceFooter;
+
+#pragma pack()
+
+static_assert(sizeof(TCoTraceHeader) == 32, "");
+static_assert(sizeof(TCoTraceFrame) == 24, "");
+static_assert(sizeof(TCoTraceFooter) == 24, "");
+
+inline uint64_t CoTraceClockNs(clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/// Timestamp of a recorded frame
+inline uint64_t CoTraceNowNs()
+{
+    return CoTraceClockNs(CLOCK_MONOTONIC);
+}
+
+/// Offset from CoTraceNowNs() to the wall time
+inline uint64_t CoTraceEpochNs()
+{
+    return CoTraceClockNs(CLOCK_REALTIME) - CoTraceNowNs();
+}
+
+/// Synchronous writer, used by the recorder thread and the converters
+class CCoTraceWriter
+{
+public:
+    CCoTraceWriter()
+        : m_file(0)
+        , m_interval(COTRACE_DEFAULT_INTERVAL)
+        , m_count(0)
+    {
+    }
+
+    ~CCoTraceWriter()
+    {
+        Close();
+    }
+
+    /// *epochNs* is 0 when the frames are stamped with the wall time
+    bool Open(const char* path, uint32_t interval = COTRACE_DEFAULT_INTERVAL, uint64_t epochNs = CoTraceEpochNs())
+    {
+        Close();
+
+        if ((m_file = fopen(path, "wb")) == 0)
+        {
+            return false;
+        }
+
+        TCoTraceHeader header;
+
+        memset(&header, 0, sizeof(header));
+        header.magic     = COTRACE_MAGIC;
+        header.version   = COTRACE_VERSION;
+        header.frameSize = sizeof(TCoTraceFrame);
+        header.interval  = interval ? interval : 1;
+        header.byteOrder = COTRACE_BYTE_ORDER;
+        header.startNs   = CoTraceClockNs(CLOCK_REALTIME);
+        header.epochNs   = epochNs;
+
+        m_interval = header.interval;
+        m_count    = 0;
+        m_index.clear();
+
+        return fwrite(&header, sizeof(header), 1, m_file) == 1;
+    }
+
+    bool IsOpen() const { return m_file != 0; }
+
+    uint64_t Count() const { return m_count; }
+
+    /// Only the frames that were stored are counted and indexed
+    bool Write(const TCoTraceFrame* frames, size_t count)
+    {
+        size_t written = m_file ? fwrite(frames, sizeof(TCoTraceFrame), count, m_file) : 0;
+
+        for (size_t i = 0; i < written; i++)
+        {
+            if (((m_count + i) % m_interval) == 0)
+            {
+                m_index.push_back(frames[i].timestampNs);
+            }
+        }
+
+        m_count += written;
+
+        return written == count;
+    }
+
+    /// Writes the index and the footer
+    bool Close()
+    {
+        if (!m_file)
+        {
+            return false;
+        }
+
+        TCoTraceFooter footer;
+
+        memset(&footer, 0, sizeof(footer));
+        footer.frameCount  = m_count;
+        footer.indexOffset = sizeof(TCoTraceHeader) + m_count * sizeof(TCoTraceFrame);
+        footer.magic       = COTRACE_FOOTER_MAGIC;
+
+        bool ok = (m_index.empty() || (fwrite(&m_index[0], sizeof(uint64_t), m_index.size(), m_file) == m_index.size())) &&
+                  (fwrite(&footer, sizeof(footer), 1, m_file) == 1);
+
+        ok = (fclose(m_file) == 0) && ok;
+        m_file = 0;
+
+        return ok;
+    }
+
+private:
+    FILE*                   m_file;
+    uint32_t                m_interval;
+    uint64_t                m_count;
+    std::vector<uint64_t>   m_index;
+};
+
+/// Records frames from the RX path without blocking it
+class CCoTraceRecorder
+{
+public:
+    explicit CCoTraceRecorder(size_t capacity = COTRACE_DEFAULT_RING)
+        : m_ring(capacity)
+        , m_running(false)
+        , m_dropped(0)
+        , m_written(0)
+        , m_failed(0)
+    {
+    }
+
+    ~CCoTraceRecorder()
+    {
+        Stop();
+    }
+
+    bool Start(const char* path, uint32_t interval = COTRACE_DEFAULT_INTERVAL)
+    {
+        if (m_running || !m_writer.Open(path, interval))
+        {
+            return false;
+        }
+
+        m_running = true;
+        m_thread  = std::thread(&CCoTraceRecorder::Run, this);
+
+        return true;
+    }
+
+    /// Stores the remaining frames and closes the trace, returns false when frames
+    /// could not be written
+    bool Stop()
+    {
+        if (!m_running)
+        {
+            return false;
+        }
+
+        m_running = false;
+        m_thread.join();
+
+        return m_writer.Close() && !Failed();
+    }
+
+    /// Called from the RX path, returns false when the frame was dropped
+    bool Push(const TCoTraceFrame& frame)
+    {
+        if (!m_ring.Push(frame))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool Push(uint32_t id, uint8_t dlc, const uint8_t* data, uint8_t flags = 0, uint8_t channel = 0)
+    {
+        TCoTraceFrame frame;
+
+        frame.timestampNs = CoTraceNowNs();
+        frame.id          = id;
+        frame.dlc         = (dlc <= 8) ? dlc : 8;
+        frame.flags       = flags;
+        frame.channel     = channel;
+        frame.reserved    = 0;
+        memset(frame.data, 0, sizeof(frame.data));
+        memcpy(frame.data, data, frame.dlc);
+
+        return Push(frame);
+    }
+
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    uint64_t Written() const { return m_written.load(std::memory_order_relaxed); }
+
+    /// Frames taken from the ring that could not be written to the trace
+    uint64_t Failed() const { return m_failed.load(std::memory_order_relaxed); }
+
+private:
+    void Run()
+    {
+        TCoTraceFrame batch[256];
+
+        for (;;)
+        {
+            bool   running = m_running;
+            size_t count   = m_ring.Pop(batch, sizeof(batch) / sizeof(batch[0]));
+
+            if (count)
+            {
+                uint64_t before = m_writer.Count();
+
+                if (!m_writer.Write(batch, count))
+                {
+                    m_failed.fetch_add(count - (m_writer.Count() - before), std::memory_order_relaxed);
+                }
+
+                m_written.fetch_add(m_writer.Count() - before, std::memory_order_relaxed);
+            }
+            else if (!running)
+            {
+                break;
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    CCoTraceWriter              m_writer;
+    CCoSpscRing<TCoTraceFrame>  m_ring;
+    std::thread                 m_thread;
+    std::atomic<bool>           m_running;
+    std::atomic<uint64_t>       m_dropped;
+    std::atomic<uint64_t>       m_written;
+    std::atomic<uint64_t>       m_failed;
+};
+
+/// Maps a trace read-only
+class CCoTraceReader
+{
+public:
+    CCoTraceReader()
+        : m_base(0)
+        , m_size(0)
+        , m_frames(0)
+        , m_count(0)
+        , m_index(0)
+        , m_indexCount(0)
+        , m_interval(1)
+    {
+    }
+
+    ~CCoTraceReader()
+    {
+        Close();
+    }
+
+    /// Fails when *path* is not a trace of this version written with this byte order
+    bool Open(const char* path)
+    {
+        Close();
+
+        int         fd = open(path, O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(TCoTraceHeader)))
+        {
+            close(fd);
+            return false;
+        }
+
+        void* base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        close(fd);
+
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_base = (const uint8_t*)base;
+        m_size = (size_t)st.st_size;
+
+        const TCoTraceHeader* header = (const TCoTraceHeader*)m_base;
+
+        if ((header->magic != COTRACE_MAGIC) || (header->version != COTRACE_VERSION) ||
+            (header->byteOrder != COTRACE_BYTE_ORDER) || (header->frameSize != sizeof(TCoTraceFrame)))
+        {
+            Close();
+            return false;
+        }
+
+        m_interval = header->interval ? header->interval : 1;
+        m_frames   = (const TCoTraceFrame*)(m_base + sizeof(TCoTraceHeader));
+        m_count    = (m_size - sizeof(TCoTraceHeader)) / sizeof(TCoTraceFrame);
+
+        if (m_size >= sizeof(TCoTraceHeader) + sizeof(TCoTraceFooter))
+        {
+            const TCoTraceFooter* footer = (const TCoTraceFooter*)(m_base + m_size - sizeof(TCoTraceFooter));
+            uint64_t              index  = (footer->frameCount + m_interval - 1) / m_interval;
+
+            if ((footer->magic == COTRACE_FOOTER_MAGIC) &&
+                (footer->indexOffset == sizeof(TCoTraceHeader) + footer->frameCount * sizeof(TCoTraceFrame)) &&
+                (footer->indexOffset + index * sizeof(uint64_t) + sizeof(TCoTraceFooter) == m_size))
+            {
+                m_count      = (size_t)footer->frameCount;
+                m_index      = (const uint64_t*)(m_base + footer->indexOffset);
+                m_indexCount = (size_t)index;
+            }
+        }
+
+        madvise((void*)m_base, m_size, MADV_SEQUENTIAL);
+
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_base)
+        {
+            munmap((void*)m_base, m_size);
+        }
+
+        m_base       = 0;
+        m_size       = 0;
+        m_frames     = 0;
+        m_count      = 0;
+        m_index      = 0;
+        m_indexCount = 0;
+    }
+
+    const TCoTraceHeader* Header() const { return (const TCoTraceHeader*)m_base; }
+
+    /// False for a trace that was not closed
+    bool Indexed() const { return m_index != 0; }
+
+    size_t Count() const { return m_count; }
+
+    const TCoTraceFrame* Begin() const { return m_frames; }
+    const TCoTraceFrame* End() const { return m_frames + m_count; }
+
+    const TCoTraceFrame& operator[](size_t i) const { return m_frames[i]; }
+
+    /// Returns the number of the first frame at or after *timestampNs*
+    size_t Seek(uint64_t timestampNs) const
+    {
+        size_t first = 0;
+        size_t last  = m_count;
+
+        if (m_index)
+        {
+            // Narrow down to one interval with the index
+            size_t lo = 0;
+            size_t hi = m_indexCount;
+
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+
+                if (m_index[mid] < timestampNs)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            first = lo ? (lo - 1) * m_interval : 0;
+            last  = (lo * (size_t)m_interval < m_count) ? lo * (size_t)m_interval : m_count;
+        }
+
+        while (first < last)
+        {
+            size_t mid = (first + last) / 2;
+
+            if (m_frames[mid].timestampNs < timestampNs)
+            {
+                first = mid + 1;
+            }
+            else
+            {
+                last = mid;
+            }
+        }
+
+        return first;
+    }
+
+private:
+    const uint8_t*          m_base;
+    size_t                  m_size;
+    const TCoTraceFrame*    m_frames;
+    size_t                  m_count;
+    const uint64_t*         m_index;
+    size_t                  m_indexCount;
+    uint32_t                m_interval;
+};
+
+/// Parses one line of `candump -L`, returns false for other lines and CAN FD frames
+inline bool CoTraceParseCandump(const char* line, TCoTraceFrame& frame)
+{
+    unsigned long long seconds;
+    unsigned long      micros;
+    char               iface[32];
+    char               payload[64];
+
+    if (sscanf(line, " (%llu.%lu) %31s %63s", &seconds, &micros, iface, payload) != 4)
+    {
+        return false;
+    }
+
+    const char* hash = strchr(payload, '#');
+
+    if (!hash || (hash[1] == '#'))
+    {
+        return false;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.timestampNs = seconds * 1000000000ull + (uint64_t)micros * 1000ull;
+    frame.id          = (uint32_t)strtoul(payload, 0, 16);
+
+    if ((hash - payload) > 3)
+    {
+        frame.flags |= COTRACE_FLAG_EXTENDED;
+    }
+
+    if (frame.id & 0x20000000)                 // CAN_ERR_FLAG
+    {
+        frame.flags |= COTRACE_FLAG_ERROR;
+        frame.flags &= (uint8_t)~COTRACE_FLAG_EXTENDED;
+        frame.id    &= 0x1fffffff;
+    }
+
+    for (const char* c = iface; *c; c++)
+    {
+        if ((*c >= '0') && (*c <= '9'))
+        {
+            frame.channel = (uint8_t)atoi(c);
+            break;
+        }
+    }
+
+    const char* data = hash + 1;
+
+    if ((*data == 'R') || (*data == 'r'))
+    {
+        frame.flags |= COTRACE_FLAG_RTR;
+        frame.dlc    = (uint8_t)((data[1] >= '0') && (data[1] <= '8') ? data[1] - '0' : 0);
+        return true;
+    }
+
+    while ((frame.dlc < 8) && data[0] && data[1])
+    {
+        char byte[3] = { data[0], data[1], 0 };
+
+        frame.data[frame.dlc++] = (uint8_t)strtoul(byte, 0, 16);
+        data += 2;
+    }
+
+    return true;
+}
+
+/// Formats a frame as a line of `candump -L` (without newline), returns the length;
+/// *epochNs* of the trace header turns the timestamp into the wall time
+inline int CoTraceFormatCandump(const TCoTraceFrame& frame, char* line, size_t size, const char* iface = "can",
+                                uint64_t epochNs = 0)
+{
+    uint32_t id  = frame.id | ((frame.flags & COTRACE_FLAG_ERROR) ? 0x20000000 : 0);
+    bool     ext = (frame.flags & (COTRACE_FLAG_EXTENDED | COTRACE_FLAG_ERROR)) != 0;
+    uint64_t ns  = frame.timestampNs + epochNs;
+    int      n   = snprintf(line, size, "(%llu.%06llu) %s%u %0*X#",
+                            (unsigned long long)(ns / 1000000000ull),
+                            (unsigned long long)((ns % 1000000000ull) / 1000ull),
+                            iface, frame.channel, ext ? 8 : 3, id);
+
+    if ((n < 0) || ((size_t)n >= size))
+    {
+        return -1;
+    }
+
+    if (frame.flags & COTRACE_FLAG_RTR)
+    {
+        return n + snprintf(line + n, size - n, frame.dlc ? "R%u" : "R", frame.dlc);
+    }
+
+    for (unsigned i = 0; (i < frame.dlc) && (i < 8) && ((size_t)n + 3 <= size); i++)
+    {
+        n += snprintf(line + n, size - n, "%02X", frame.data[i]);
+    }
+
+    return n;
+}
+
+/// Converts a `candump -L` log, returns the number of frames or -1
+inline long long CoTraceImportCandump(const char* logPath, const char* tracePath,
+                                      uint32_t interval = COTRACE_DEFAULT_INTERVAL)
+{
+    FILE*          in = fopen(logPath, "r");
+    CCoTraceWriter writer;
+    char           line[256];
+    bool           ok;
+
+    if (!in)
+    {
+        return -1;
+    }
+
+    ok = writer.Open(tracePath, interval, 0);
+
+    while (ok && fgets(line, sizeof(line), in))
+    {
+        TCoTraceFrame frame;
+
+        if (CoTraceParseCandump(line, frame))
+        {
+            ok = writer.Write(&frame, 1);
+        }
+    }
+
+    fclose(in);
+
+    long long count = (long long)writer.Count();
+
+    return (writer.Close() && ok) ? count : -1;
+}
+
+/// Converts a trace to a `candump -L` log, returns the number of frames or -1
+inline long long CoTraceExportCandump(const char* tracePath, const char* logPath, const char* iface = "can")
+{
+    CCoTraceReader reader;
+    char           line[256];
+
+    if (!reader.Open(tracePath))
+    {
+        return -1;
+    }
+
+    FILE* out = fopen(logPath, "w");
+    bool  ok  = out != 0;
+
+    for (size_t i = 0; ok && (i < reader.Count()); i++)
+    {
+        ok = (CoTraceFormatCandump(reader[i], line, sizeof(line), iface, reader.Header()->epochNs) > 0) &&
+             (fprintf(out, "%s\n", line) > 0);
+    }
+
+    ok = out && (fclose(out) == 0) && ok;
+
+    return ok ? (long long)reader.Count() : -1;
+}
+
+#endif // __INTERFACE_COTRACE_H__
@@ -0,0 +1,298 @@
+#ifndef __INTERFACE_COUNITS_H__
+#define __INTERFACE_COUNITS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/// # Units
+///
+/// Typed fixed-point wrappers for the units used by the objects in CoPm.h and
+/// CoBridge.h. The raw value is kept exactly as it is on the wire; the type carries
+/// the scale, so a 0.1 V value can not be mixed up with a 0.1 A or mV value.
+///
+/// | Type            | Raw      | Scale                 | Used by                       |
+/// |-----------------|----------|-----------------------|-------------------------------|
+/// | TDeciVolt       | uint16   | 0.1 V                 | 2107, 2109, 2400, PDO_1       |
+/// | TDeciAmp        | uint16   | 0.1 A                 | 2108, 210a, 2400, PDO_1       |
+/// | TDeciCelsius    | int16    | 0.1 °C                | 2104, 2112, 2116              |
+/// | TDeciAmpPerSec  | uint16   | 0.1 A/s               | 210b                          |
+/// | TMilliVolt      | uint16   | 1 mV                  | 210d                          |
+/// | TWattHour       | uint16   | 1 Wh                  | 2122                          |
+/// | TDeciKiloWatt   | uint16   | 0.1 kW                | 2110[7]                       |
+/// | TCtrQ8          | uint16   | 1/256                 | 211a current transfer ratio   |
+/// | TGainQ14        | uint16   | 1/16384               | 215a gains                    |
+/// | TCpuTicks       | uint32   | 11.11 ns              | 2135 execution times          |
+///
+///     TDeciVolt   voltage = TDeciVolt::FromRaw(CoGetLe16(data));
+///     double      volts   = voltage.Value();                   // V
+///     TMilliVolt  offset  = CoUnitCast<TMilliVolt>(voltage);   // exact, rounded
+///
+/// The bulk routines convert whole columns of raw values to float or double with
+/// SSE2 or AVX2 when the target supports them (-msse2 / -mavx2) and a scalar loop
+/// otherwise. All variants compute raw \* scale with the same scale, so the results do
+/// not depend on the instruction set.
+
+/// Physical quantities, only used to tell the unit types apart
+struct TCoVolt {};
+struct TCoAmp {};
+struct TCoCelsius {};
+struct TCoAmpPerSec {};
+struct TCoWattHour {};
+struct TCoWatt {};
+struct TCoRatio {};
+struct TCoSecond {};
+
+/// Value = raw \* Num / Den in the base unit of Quantity
+template <typename Rep, typename Quantity, int64_t Num, int64_t Den>
+class TCoFixed
+{
+public:
+    typedef Rep      TRep;
+    typedef Quantity TQuantity;
+
+    static constexpr int64_t num = Num;
+    static constexpr int64_t den = Den;
+
+    constexpr TCoFixed() : m_raw(0) {}
+
+    static constexpr TCoFixed FromRaw(Rep raw) { return TCoFixed(raw); }
+
+    /// Rounds a value in the base unit to the nearest raw value, saturating to Rep
+    static constexpr TCoFixed From(double value)
+    {
+        return TCoFixed(Saturate(value * (double)Den / (double)Num));
+    }
+
+    static constexpr double Scale() { return (double)Num / (double)Den; }
+
+    constexpr Rep Raw() const { return m_raw; }
+
+    constexpr double Value() const { return (double)m_raw * Scale(); }
+
+    constexpr float ValueF() const { return (float)m_raw * (float)Scale(); }
+
+    constexpr bool operator==(TCoFixed other) const { return m_raw == other.m_raw; }
+    constexpr bool operator!=(TCoFixed other) const { return m_raw != other.m_raw; }
+    constexpr bool operator< (TCoFixed other) const { return m_raw <  other.m_raw; }
+    constexpr bool operator> (TCoFixed other) const { return m_raw >  other.m_raw; }
+    constexpr bool operator<=(TCoFixed other) const { return m_raw <= other.m_raw; }
+    constexpr bool operator>=(TCoFixed other) const { return m_raw >= other.m_raw; }
+
+private:
+    explicit constexpr TCoFixed(Rep raw) : m_raw(raw) {}
+
+    static constexpr Rep Saturate(double value)
+    {
+        return (value <= (double)Min()) ? Min() :
+               (value >= (double)Max()) ? Max() :
+               (Rep)(value < 0 ? value - 0.5 : value + 0.5);
+    }
+
+    static constexpr Rep Min() { return (Rep)((Rep)-1 < 0 ? (Rep)1 << (8 * sizeof(Rep) - 1) : 0); }
+    static constexpr Rep Max() { return (Rep)~Min(); }
+
+    Rep m_raw;
+};
+
+typedef TCoFixed<uint16_t, TCoVolt,      1, 10>             TDeciVolt;
+typedef TCoFixed<uint16_t, TCoAmp,       1, 10>             TDeciAmp;
+typedef TCoFixed<int16_t,  TCoCelsius,   1, 10>             TDeciCelsius;
+typedef TCoFixed<uint16_t, TCoAmpPerSec, 1, 10>             TDeciAmpPerSec;
+typedef TCoFixed<uint16_t, TCoVolt,      1, 1000>           TMilliVolt;
+typedef TCoFixed<uint16_t, TCoWattHour,  1, 1>              TWattHour;
+typedef TCoFixed<uint16_t, TCoWatt,      100, 1>            TDeciKiloWatt;
+typedef TCoFixed<uint16_t, TCoRatio,     1, 256>            TCtrQ8;
+typedef TCoFixed<uint16_t, TCoRatio,     1, 16384>          TGainQ14;
+typedef TCoFixed<uint32_t, TCoSecond,    1111, 100000000000> TCpuTicks;
+
+/// Converts between units of the same quantity with integer arithmetic, rounded to
+/// nearest. The caller must make sure the result fits To::TRep.
+template <typename To, typename From>
+constexpr To CoUnitCast(From from)
+{
+    static_assert(std::is_same<typename To::TQuantity, typename From::TQuantity>::value, "different quantities");
+
+    return To::FromRaw((typename To::TRep)(
+        ((int64_t)from.Raw() * From::num * To::den +
+         ((from.Raw() < 0 ? -1 : 1) * (From::den * To::num / 2))) / (From::den * To::num)));
+}
+
+/// Execution time in ns, e.g. from 2135[2..4] (PM_SDO_SYSTEM_STATISTICS)
+constexpr uint64_t CoTicksToNs(uint32_t ticks)
+{
+    return ((uint64_t)ticks * 1111 + 50) / 100;
+}
+
+// Bulk conversion ----------------------------------------------------------------------
+
+/// out[i] = in[i] \* scale
+inline void CoConvertU16(const uint16_t* in, float* out, size_t count, float scale)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 s8 = _mm256_set1_ps(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), s8));
+    }
+#elif defined(__SSE2__)
+    const __m128  s4   = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)&in[i]);
+
+        _mm_storeu_ps(&out[i],     _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), s4));
+        _mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), s4));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = (float)in[i] * scale;
+    }
+}
+
+inline void CoConvertS16(const int16_t* in, float* out, size_t count, float scale)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 s8 = _mm256_set1_ps(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), s8));
+    }
+#elif defined(__SSE2__)
+    const __m128 s4 = _mm_set1_ps(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)&in[i]);
+
+        // Sign extension: the value in the upper half, shifted down arithmetically
+        _mm_storeu_ps(&out[i],     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), s4));
+        _mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), s4));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = (float)in[i] * scale;
+    }
+}
+
+inline void CoConvertU16(const uint16_t* in, double* out, size_t count, double scale)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256d s4 = _mm256_set1_pd(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+
+        _mm256_storeu_pd(&out[i],     _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s4));
+        _mm256_storeu_pd(&out[i + 4], _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s4));
+    }
+#elif defined(__SSE2__)
+    const __m128d s2   = _mm_set1_pd(scale);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i*)&in[i]);
+        __m128i lo = _mm_unpacklo_epi16(v, zero);
+        __m128i hi = _mm_unpackhi_epi16(v, zero);
+
+        _mm_storeu_pd(&out[i],     _mm_mul_pd(_mm_cvtepi32_pd(lo), s2));
+        _mm_storeu_pd(&out[i + 2], _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), s2));
+        _mm_storeu_pd(&out[i + 4], _mm_mul_pd(_mm_cvtepi32_pd(hi), s2));
+        _mm_storeu_pd(&out[i + 6], _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), s2));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = (double)in[i] * scale;
+    }
+}
+
+inline void CoConvertS16(const int16_t* in, double* out, size_t count, double scale)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256d s4 = _mm256_set1_pd(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+
+        _mm256_storeu_pd(&out[i],     _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s4));
+        _mm256_storeu_pd(&out[i + 4], _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s4));
+    }
+#elif defined(__SSE2__)
+    const __m128d s2 = _mm_set1_pd(scale);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i*)&in[i]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+        _mm_storeu_pd(&out[i],     _mm_mul_pd(_mm_cvtepi32_pd(lo), s2));
+        _mm_storeu_pd(&out[i + 2], _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), s2));
+        _mm_storeu_pd(&out[i + 4], _mm_mul_pd(_mm_cvtepi32_pd(hi), s2));
+        _mm_storeu_pd(&out[i + 6], _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), s2));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = (double)in[i] * scale;
+    }
+}
+
+/// Converts a column of raw Unit values to the base unit, e.g.
+/// CoConvert<TDeciVolt>(raw2107, volts, n)
+template <typename Unit, typename Out>
+inline void CoConvert(const uint16_t* in, Out* out, size_t count)
+{
+    static_assert(sizeof(typename Unit::TRep) == 2, "16 bit unit expected");
+
+    CoConvertU16(in, out, count, (Out)Unit::Scale());
+}
+
+template <typename Unit, typename Out>
+inline void CoConvert(const int16_t* in, Out* out, size_t count)
+{
+    static_assert(sizeof(typename Unit::TRep) == 2, "16 bit unit expected");
+
+    CoConvertS16(in, out, count, (Out)Unit::Scale());
+}
+
+static_assert(sizeof(TDeciVolt) == sizeof(uint16_t), "unit types must have the size of the raw value");
+static_assert(CoUnitCast<TMilliVolt>(TDeciVolt::FromRaw(123)).Raw() == 12300, "");
+static_assert(CoUnitCast<TDeciVolt>(TMilliVolt::FromRaw(12349)).Raw() == 123, "");
+static_assert(TDeciCelsius::From(-2.56).Raw() == -26, "");
+static_assert(CoTicksToNs(100) == 1111, "");
+
+#endif // __INTERFACE_COUNITS_H__
@@ -0,0 +1,87 @@
+// Compares reading status fields through the unions and through the descriptors.
+// Both should compile to a shift and a mask; the descriptors also vectorize.
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "CoBitField.h"
+
+#define VALUES          4096
+#define ROUNDS          20000
+
+static uint64_t NowNs()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/// Number of modules with a fan error or an over temperature, through the unions
+static __attribute__((noinline)) unsigned CountUnion(const TPmConverterStatus* status, unsigned count)
+{
+    unsigned result = 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        result += status[i].bits.bfFanError | status[i].bits.bfOTP;
+    }
+
+    return result;
+}
+
+/// The same through the descriptors
+static __attribute__((noinline)) unsigned CountFields(const TPmConverterStatus* status, unsigned count)
+{
+    typedef TPmConverterStatusFields F;
+
+    unsigned result = 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        result += CoGetField<F::FanError>(status[i]) | CoGetField<F::OTP>(status[i]);
+    }
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    static TPmConverterStatus status[VALUES];
+    unsigned                  rounds = (argc > 1) ? (unsigned)atoi(argv[1]) : ROUNDS;
+    unsigned                  sum[2] = { 0, 0 };
+    uint64_t                  ns[2];
+
+    srand(1);
+
+    for (unsigned i = 0; i < VALUES; i++)
+    {
+        status[i].value = (uint32_t)rand();
+    }
+
+    ns[0] = NowNs();
+
+    for (unsigned round = 0; round < rounds; round++)
+    {
+        sum[0] += CountUnion(status, VALUES);
+        __asm__ volatile("" ::: "memory");     // keeps the calls in the loop
+    }
+
+    ns[1] = NowNs();
+
+    for (unsigned round = 0; round < rounds; round++)
+    {
+        sum[1] += CountFields(status, VALUES);
+        __asm__ volatile("" ::: "memory");
+    }
+
+    uint64_t end    = NowNs();
+    double   values = (double)rounds * VALUES;
+
+    printf("union       %.3f ns/value\n", (double)(ns[1] - ns[0]) / values);
+    printf("descriptor  %.3f ns/value\n", (double)(end - ns[1]) / values);
+
+    return (sum[0] == sum[1]) ? 0 : 1;
+}
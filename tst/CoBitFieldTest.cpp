@@ -0,0 +1,325 @@
+// Checks that the bit field descriptors give the same result as the unions, byte for
+// byte, for random values read through and written through every field.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "CoBitField.h"
+
+#define ITERATIONS      100000
+
+static unsigned s_failures = 0;
+static uint32_t s_random   = 0x12345678u;
+
+static uint32_t Random()
+{
+    // xorshift32
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+
+    return s_random;
+}
+
+/// Reads the field through the union and the descriptor, then writes a random value
+/// through both and compares the bytes of the two unions
+#define CHECK_FIELD(U, member, Field)                                                                   \
+    do                                                                                                  \
+    {                                                                                                   \
+        U        viaUnion;                                                                              \
+        U        viaField;                                                                              \
+        uint32_t field = Random();                                                                      \
+                                                                                                        \
+        memset(&viaUnion, 0, sizeof(U));                                                                \
+        TCoBitFieldUnion<U>::SetValue(viaUnion, (TCoBitFieldUnion<U>::TFields::TStorage)Random());     \
+        viaField = viaUnion;                                                                            \
+                                                                                                        \
+        if ((uint32_t)viaUnion.member != (uint32_t)CoGetField<Field>(viaField))                         \
+        {                                                                                               \
+            printf("%s: read " #member " %u, descriptor %u\n", #U, (unsigned)viaUnion.member,           \
+                   (unsigned)CoGetField<Field>(viaField));                                              \
+            s_failures++;                                                                               \
+        }                                                                                               \
+                                                                                                        \
+        viaUnion.member = field;                                                                        \
+        CoSetField<Field>(viaField, (Field::TStorage)field);                                            \
+                                                                                                        \
+        if (memcmp(&viaUnion, &viaField, sizeof(U)) != 0)                                               \
+        {                                                                                               \
+            printf("%s: write " #member " differs\n", #U);                                              \
+            s_failures++;                                                                               \
+        }                                                                                               \
+    } while (0)
+
+static void CheckConverterStatus()
+{
+    typedef TPmConverterStatusFields F;
+
+    CHECK_FIELD(TPmConverterStatus, bits.bfConverterActive,   F::ConverterActive);
+    CHECK_FIELD(TPmConverterStatus, bits.bfGlobalError,       F::GlobalError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfOVPin,             F::OVPin);
+    CHECK_FIELD(TPmConverterStatus, bits.bfUVPin,             F::UVPin);
+    CHECK_FIELD(TPmConverterStatus, bits.bfOVPout,            F::OVPout);
+    CHECK_FIELD(TPmConverterStatus, bits.bfUVPout,            F::UVPout);
+    CHECK_FIELD(TPmConverterStatus, bits.bfFanError,          F::FanError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfOTP,               F::OTP);
+    CHECK_FIELD(TPmConverterStatus, bits.bfOCPin,             F::OCPin);
+    CHECK_FIELD(TPmConverterStatus, bits.bfOCPout,            F::OCPout);
+    CHECK_FIELD(TPmConverterStatus, bits.bfUVPAuxSupply,      F::UVPAuxSupply);
+    CHECK_FIELD(TPmConverterStatus, bits.bfInterlockDetected, F::InterlockDetected);
+    CHECK_FIELD(TPmConverterStatus, bits.bfResetProtection,   F::ResetProtection);
+    CHECK_FIELD(TPmConverterStatus, bits.bfSetpointTimeout,   F::SetpointTimeout);
+    CHECK_FIELD(TPmConverterStatus, bits.bfSetpointNotMet,    F::SetpointNotMet);
+    CHECK_FIELD(TPmConverterStatus, bits.bfPFCerror,          F::PFCerror);
+    CHECK_FIELD(TPmConverterStatus, bits.bfDumploadTooHot,    F::DumploadTooHot);
+    CHECK_FIELD(TPmConverterStatus, bits.bfDumploadError,     F::DumploadError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfCanIdError,        F::CanIdError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfInputCurrentDiff,  F::InputCurrentDiff);
+    CHECK_FIELD(TPmConverterStatus, bits.bfEepromError,       F::EepromError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfRelayError,        F::RelayError);
+    CHECK_FIELD(TPmConverterStatus, bits.bfFuseError,         F::FuseError);
+}
+
+static void CheckPmStatus()
+{
+    typedef TPmStatusFields F;
+
+    CHECK_FIELD(TPmStatus, m_bits.m_chargerOn,                F::ChargerOn);
+    CHECK_FIELD(TPmStatus, m_bits.m_globalError,              F::GlobalError);
+    CHECK_FIELD(TPmStatus, m_bits.m_inputOverVoltageDetect,   F::InputOverVoltageDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_inputUnderVoltageDetect,  F::InputUnderVoltageDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_outputOverVoltageDetect,  F::OutputOverVoltageDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_outputUnderVoltageDetect, F::OutputUnderVoltageDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_fanFailure,               F::FanFailure);
+    CHECK_FIELD(TPmStatus, m_bits.m_overTemperatureDetect,    F::OverTemperatureDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_inputOverCurrentProtect,  F::InputOverCurrentProtect);
+    CHECK_FIELD(TPmStatus, m_bits.m_outputOverCurrentProtect, F::OutputOverCurrentProtect);
+    CHECK_FIELD(TPmStatus, m_bits.m_auxUnderVoltageDetect,    F::AuxUnderVoltageDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_interlock,                F::Interlock);
+    CHECK_FIELD(TPmStatus, m_bits.m_resetDetect,              F::ResetDetect);
+    CHECK_FIELD(TPmStatus, m_bits.m_setpointTimeout,          F::SetpointTimeout);
+    CHECK_FIELD(TPmStatus, m_bits.m_setpointNotMet,           F::SetpointNotMet);
+    CHECK_FIELD(TPmStatus, m_bits.m_PFCerror,                 F::PFCerror);
+}
+
+static void CheckV2hPmStatus()
+{
+    typedef TV2hPmStatusFields F;
+
+    CHECK_FIELD(TV2hPmStatus, bits.DC_OverCurrent_HW,             F::DC_OverCurrent_HW);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_AmbientTemperatureAbnormal, F::DC_AmbientTemperatureAbnormal);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_OverTemperature,            F::DC_OverTemperature);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_OverCurrent,                F::DC_OverCurrent);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_BusOverVoltage,             F::DC_BusOverVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_BusUnderVoltage,            F::DC_BusUnderVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_OverVoltage,                F::DC_OverVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_UnderVoltage,               F::DC_UnderVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_Short,                      F::DC_Short);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_BusUnbalance,               F::DC_BusUnbalance);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_OverVoltage_HW,             F::DC_OverVoltage_HW);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_FanError,                   F::DC_FanError);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_ExternalCurrentSensorError, F::DC_ExternalCurrentSensorError);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_IpcVersionUnmatched,        F::DC_IpcVersionUnmatched);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_EepromError,                F::DC_EepromError);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_CanError,                   F::DC_CanError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_RelayError,                 F::AC_RelayError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_CurrentUnbalance,           F::AC_CurrentUnbalance);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_OverCurrent,                F::AC_OverCurrent);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_OverCurrent_HW,             F::AC_OverCurrent_HW);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_GridFail,                   F::AC_GridFail);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_DcInjectionError,           F::AC_DcInjectionError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_SoftStartFail,              F::AC_SoftStartFail);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_CurrentSensorError,         F::AC_CurrentSensorError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_GridIslanding,              F::AC_GridIslanding);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_BusVoltageSensorError,      F::AC_BusVoltageSensorError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_BusVoltageFail,             F::AC_BusVoltageFail);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_BusOverVoltage,             F::AC_BusOverVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_BusUnderVoltage,            F::AC_BusUnderVoltage);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_BusUnbalance,               F::AC_BusUnbalance);
+    CHECK_FIELD(TV2hPmStatus, bits.DC_DumpLoadError,              F::DC_DumpLoadError);
+    CHECK_FIELD(TV2hPmStatus, bits.AC_GeneralError,               F::AC_GeneralError);
+}
+
+static void CheckPwbStatus()
+{
+    typedef TPwbStatusFields F;
+
+    CHECK_FIELD(TPwbStatus, m_bits.m_bInterlinkDCPlusClose,  F::InterlinkDCPlusClose);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bInterlinkDCMinusClose, F::InterlinkDCMinusClose);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bHasOutletError,        F::HasOutletError);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bHasConfigurationError, F::HasConfigurationError);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bInterlinkDCPlusError,  F::InterlinkDCPlusError);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bInterlinkDCMinusError, F::InterlinkDCMinusError);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bHasGlobalInterlock,    F::HasGlobalInterlock);
+    CHECK_FIELD(TPwbStatus, m_bits.m_bHasLatchError,         F::HasLatchError);
+    CHECK_FIELD(TPwbStatus, m_bits.m_unused,                 F::Unused);
+}
+
+static void CheckSoftVersion()
+{
+    typedef TPmSoftVersionFields F;
+
+    CHECK_FIELD(TPmSoftVersion, DcDcDsp.value,     F::DcDcDsp);
+    CHECK_FIELD(TPmSoftVersion, DcDcDsp.bits.High, F::DcDcDspHigh);
+    CHECK_FIELD(TPmSoftVersion, DcDcDsp.bits.Low,  F::DcDcDspLow);
+    CHECK_FIELD(TPmSoftVersion, PfcDsp.value,      F::PfcDsp);
+    CHECK_FIELD(TPmSoftVersion, PfcDsp.bits.High,  F::PfcDspHigh);
+    CHECK_FIELD(TPmSoftVersion, PfcDsp.bits.Low,   F::PfcDspLow);
+}
+
+static void CheckBist()
+{
+    typedef TPmBistResultGeneral1Fields F1;
+
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfTestResult,          F1::TestResult);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfEeprom,              F1::Eeprom);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfFan,                 F1::Fan);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfLEMReference,        F1::LEMReference);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDcBusVoltageZero,    F1::DcBusVoltageZero);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDcCurrentZero,       F1::DcCurrentZero);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDumploadCurrentZero, F1::DumploadCurrentZero);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfAuxPower15V,         F1::AuxPower15V);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfAuxPower12V,         F1::AuxPower12V);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfSpiExtAdc,           F1::SpiExtAdc);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDcOutputCurrent,     F1::DcOutputCurrent);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfBusVoltage,          F1::BusVoltage);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfOutputVoltage,       F1::OutputVoltage);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDcCapacitors,        F1::DcCapacitors);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfDcBus,               F1::DcBus);
+    CHECK_FIELD(TPmBistResultGeneral1, bits.bfGridConnection,      F1::GridConnection);
+
+    typedef TUugreenBistResultGeneral1Fields U1;
+
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfTestResult,         U1::TestResult);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfSystemAcRelayClose, U1::SystemAcRelayClose);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfCommunication,      U1::Communication);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfAcOv,               U1::AcOv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfAcUv,               U1::AcUv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfPfcOv,              U1::PfcOv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfPfcUv,              U1::PfcUv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfPfcUnbalance,       U1::PfcUnbalance);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfDcOv,               U1::DcOv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfDcUv,               U1::DcUv);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfDcUnbalance,        U1::DcUnbalance);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfBleeder,            U1::Bleeder);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfFan,                U1::Fan);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfFanDriver,          U1::FanDriver);
+    CHECK_FIELD(TUugreenBistResultGeneral1, bits.bfPfcDcCommunication, U1::PfcDcCommunication);
+
+    typedef TPmBistResultGeneral2Fields F2;
+
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfCpldInterlock,        F2::CpldInterlock);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfCpldOVP,              F2::CpldOVP);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfCpldOCP,              F2::CpldOCP);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfCpldReset,            F2::CpldReset);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfDcOutputVoltageZero,  F2::DcOutputVoltageZero);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfDischargeSpeed,       F2::DischargeSpeed);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfDumploadCurrentSense, F2::DumploadCurrentSense);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfDumploadPowerLimit,   F2::DumploadPowerLimit);
+    CHECK_FIELD(TPmBistResultGeneral2, bits.bfDcOutputOvp,          F2::DcOutputOvp);
+
+    typedef TUugreenBistResultGeneral2Fields U2;
+
+    CHECK_FIELD(TUugreenBistResultGeneral2, bits.bfPfcEeprom, U2::PfcEeprom);
+    CHECK_FIELD(TUugreenBistResultGeneral2, bits.bfDcEeprom,  U2::DcEeprom);
+
+    typedef TPmBistConvXResultFields C;
+
+    CHECK_FIELD(TPmBistConvXResult, bits.bfLEMZero,            C::LEMZero);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfDcStageCurrentZero, C::DcStageCurrentZero);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfAcVoltage,          C::AcVoltage);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfAcCurrent,          C::AcCurrent);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfDvdt,               C::Dvdt);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfResonantStage,      C::ResonantStage);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfDcCurrent,          C::DcCurrent);
+    CHECK_FIELD(TPmBistConvXResult, bits.bfDcVoltage,          C::DcVoltage);
+
+    typedef TPmBistTemperatureControlFields T;
+
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureADC,   T::TemperatureADC);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureIGBT1, T::TemperatureIGBT1);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureRECT1, T::TemperatureRECT1);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureIGBT3, T::TemperatureIGBT3);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureDiode, T::TemperatureDiode);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureInd1,  T::TemperatureInd1);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureTr1,   T::TemperatureTr1);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureInd3,  T::TemperatureInd3);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperatureTr3,   T::TemperatureTr3);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperaturePCB1,  T::TemperaturePCB1);
+    CHECK_FIELD(TPmBistTemperatureControl, bits.bfTemperaturePCB2,  T::TemperaturePCB2);
+
+    typedef TBuckBoostBistGeneralResult1Fields B1;
+
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfTestResult,             B1::TestResult);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfEeprom,                 B1::Eeprom);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfImodZero,               B1::ImodZero);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfInletDcBusVoltage,      B1::InletDcBusVoltage);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfOutputDcBusVoltageZero, B1::OutputDcBusVoltageZero);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfFuse,                   B1::Fuse);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfPdpint,                 B1::Pdpint);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfInterlock,              B1::Interlock);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfOverCurrProtImod,       B1::OverCurrProtImod);
+    CHECK_FIELD(TBuckBoostBistGeneralResult1, bits.bfHwDischargePtc,         B1::HwDischargePtc);
+
+    typedef TBuckBoostBistGeneralResult2FanTestFields BF;
+
+    CHECK_FIELD(TBuckBoostBistGeneralResult2FanTest, bits.bfFanStop, BF::FanStop);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2FanTest, bits.bfFanIdle, BF::FanIdle);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2FanTest, bits.bfFanSlow, BF::FanSlow);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2FanTest, bits.bfFanFast, BF::FanFast);
+
+    typedef TBuckBoostBistGeneralResult2TempTestFields BT;
+
+    CHECK_FIELD(TBuckBoostBistGeneralResult2TempTest, bits.bfTemperatureBB,   BT::TemperatureBB);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2TempTest, bits.bfTemperatureChip, BT::TemperatureChip);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2TempTest, bits.bfTemperatureMA,   BT::TemperatureMA);
+    CHECK_FIELD(TBuckBoostBistGeneralResult2TempTest, bits.bfTemperatureMB,   BT::TemperatureMB);
+
+    typedef TBuckBoostBistConvXResultFields BC;
+
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfIphaseZero,              BC::IphaseZero);
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfOverCurrProtIphase,      BC::OverCurrProtIphase);
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfBuckHighVoltageSetpoint, BC::BuckHighVoltageSetpoint);
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfBuckLowVoltageSetpoint,  BC::BuckLowVoltageSetpoint);
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfBoostHighVoltageSetpoint,BC::BoostHighVoltageSetpoint);
+    CHECK_FIELD(TBuckBoostBistConvXResult, bits.bfBoostLowVoltageSetpoint, BC::BoostLowVoltageSetpoint);
+}
+
+/// Load() and Store() use the CANopen byte order whatever the host is
+static void CheckWireOrder()
+{
+    const uint8_t data[4] = { 0x41, 0x00, 0x20, 0x80 };
+    uint8_t       stored[4];
+    uint32_t      value   = TPmConverterStatusFields::Load(data);
+
+    TPmConverterStatusFields::Store(stored, value);
+
+    if ((value != 0x80200041u) || !TPmConverterStatusFields::FanError::Get(value) ||
+        !TPmConverterStatusFields::ConverterActive::Get(value) || (memcmp(data, stored, sizeof(data)) != 0))
+    {
+        printf("wire order: 0x%08x\n", (unsigned)value);
+        s_failures++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    CheckWireOrder();
+
+    for (unsigned i = 0; (i < ITERATIONS) && !s_failures; i++)
+    {
+        CheckConverterStatus();
+        CheckPmStatus();
+        CheckV2hPmStatus();
+        CheckPwbStatus();
+        CheckSoftVersion();
+        CheckBist();
+    }
+
+    printf("%s\n", s_failures ? "FAILED" : "passed");
+
+    return s_failures ? 1 : 0;
+}
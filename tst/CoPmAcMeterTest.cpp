@@ -0,0 +1,107 @@
+// Checks the energy rollup of CPmAcMeter when 2122 arrives one sub-index at a time:
+// a counter only counts from its own first reading, not from 0.
+#include <stdio.h>
+#include <stdint.h>
+
+#include "CoPmAcMeter.h"
+
+static unsigned s_failures = 0;
+
+#define CHECK(condition)                                                \
+    do                                                                  \
+    {                                                                   \
+        if (!(condition))                                               \
+        {                                                               \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #condition);      \
+            s_failures++;                                               \
+        }                                                               \
+    } while (0)
+
+static void Energy(CPmAcMeter& meter, uint8_t node, uint8_t subIndex, uint16_t wh)
+{
+    uint8_t data[2] = { (uint8_t)wh, (uint8_t)(wh >> 8) };
+
+    CHECK(meter.OnSdoResponse(node, PM_SDO_AC_ENERGY, subIndex, data, sizeof(data)));
+}
+
+/// Charged first, then discharged: neither reading adds energy in the first cycle
+static void CheckChargedFirst()
+{
+    CPmAcMeter meter;
+
+    meter.Add(1);
+    Energy(meter, 1, 1, 10000);
+    Energy(meter, 1, 2, 40000);
+
+    CHECK(meter.Site().chargedWh == 0);
+    CHECK(meter.Site().dischargedWh == 0);
+
+    Energy(meter, 1, 1, 10005);
+    Energy(meter, 1, 2, 40007);
+
+    CHECK(meter.Site().chargedWh == 5);
+    CHECK(meter.Site().dischargedWh == 7);
+    CHECK(meter.Group(0).chargedWh == 5);
+    CHECK(meter.Group(0).dischargedWh == 7);
+}
+
+/// Discharged first, then charged
+static void CheckDischargedFirst()
+{
+    CPmAcMeter meter;
+
+    meter.Add(2, 3);
+    Energy(meter, 2, 2, 30000);
+    Energy(meter, 2, 1, 20000);
+
+    CHECK(meter.Site().chargedWh == 0);
+    CHECK(meter.Site().dischargedWh == 0);
+
+    Energy(meter, 2, 2, 30010);
+    Energy(meter, 2, 1, 20001);
+
+    CHECK(meter.Group(3).chargedWh == 1);
+    CHECK(meter.Group(3).dischargedWh == 10);
+}
+
+/// Only one counter is ever read, the other one stays without a base
+static void CheckOneCounter()
+{
+    CPmAcMeter meter;
+
+    meter.Add(4);
+    Energy(meter, 4, 1, 65530);
+    Energy(meter, 4, 1, 4);     // wraps
+
+    CHECK(meter.Site().chargedWh == 10);
+    CHECK(meter.Site().dischargedWh == 0);
+    CHECK(!meter.Module(4).discharged.valid);
+}
+
+/// Both counters at once
+static void CheckOnEnergy()
+{
+    CPmAcMeter meter;
+
+    meter.Add(5);
+    meter.OnEnergy(5, 10000, 40000);
+    meter.OnEnergy(5, 10002, 40003);
+
+    CHECK(meter.Site().chargedWh == 2);
+    CHECK(meter.Site().dischargedWh == 3);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    CheckChargedFirst();
+    CheckDischargedFirst();
+    CheckOneCounter();
+    CheckOnEnergy();
+
+    printf("%s\n", s_failures ? "FAILED" : "passed");
+
+    return s_failures ? 1 : 0;
+}
@@ -2,6 +2,35 @@
 // Only test if it compiles e.g. no syntax errors
 #include "CoPm/CoPm.h"
 #include "CoPm/CoBridge.h"
+#include "CoPm/CoSdo.h"
+#include "CoPm/CoBridgeTopology.h"
+#include "CoPm/CoBridgeState.h"
+#include "CoPm/CoSeqLock.h"
+#include "CoPm/CoBridgePoller.h"
+#include "CoPm/CoPmCapabilities.h"
+#include "CoPm/CoPmIdentity.h"
+#include "CoPm/CoPmDiscovery.h"
+#include "CoPm/CoBitField.h"
+#include "CoPm/CoUnits.h"
+#include "CoPm/CoPmCalibration.h"
+#include "CoPm/CoSpscRing.h"
+#include "CoPm/CoTrace.h"
+#include "CoPm/CoReplay.h"
+#include "CoPm/CoLatency.h"
+#include "CoPm/CoMetrics.h"
+#include "CoPm/CoPmCanRates.h"
+#include "CoPm/CoPmExecTime.h"
+#include "CoPm/CoPmAcMeter.h"
+#include "CoPm/CoPmGridFault.h"
+#include "CoPm/CoPmV2hEnergy.h"
+#include "CoPm/CoPmGridFrequency.h"
+#include "CoPm/CoPmThermal.h"
+#include "CoPm/CoFanHealth.h"
+#include "CoPm/CoPmSetpoint.h"
+#include "CoPm/CoSdoScheduler.h"
+#include "CoPm/CoTimerWheel.h"
+#include "CoPm/CoBridgeKeepalive.h"
+#include "CoPm/CoLiveness.h"
 
 int main(int argc, char **argv)
 {